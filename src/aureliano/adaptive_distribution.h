@@ -0,0 +1,157 @@
+// adaptive_distribution.h: discrete distribution adapting online to the
+//      outcomes of its draws, for choosing moves of local search.
+// Author: LYL (Aureliano Lee)
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "xaureliano.h"
+
+AURELIANO_BEGIN
+// Discrete distribution over arms [0, size()), reweighted online by
+// probability matching (a multi-armed bandit rule). feedback(k, ...)
+// records an outcome of arm k during an epoch (e.g., a temperature of SA),
+// and update() blends the mean reward of every arm tried into its quality
+// at learning_rate, then makes the probabilities proportional to the
+// qualities, with min_share of the mass split evenly for exploration.
+// The reward of a draw is 1 if accepted, plus its gain in units of the
+// mean gain of the accepted draws of the epoch. Arms of initial weight 0
+// are never drawn.
+class adaptive_discrete_distribution {
+public:
+    adaptive_discrete_distribution() = default;
+
+    // Constructs from the initial weights of the arms.
+    // Throws: invalid_argument if a weight is negative or all are 0, or
+    //      learning_rate is not in (0, 1], or min_share not in [0, 1).
+    template<typename InIt>
+    adaptive_discrete_distribution(InIt first, InIt last,
+        double learning_rate = 0.3, double min_share = 0.1) :
+        probs_(first, last), learning_rate_(learning_rate),
+        min_share_(min_share) {
+        using namespace std;
+        if (any_of(probs_.cbegin(), probs_.cend(), [](double x) { return x < 0; }))
+            throw invalid_argument("Negative weight");
+        auto sum = accumulate(probs_.cbegin(), probs_.cend(), 0.0);
+        if (!(sum > 0))
+            throw invalid_argument("No arm to draw");
+        if (!(learning_rate > 0 && learning_rate <= 1) ||
+            !(min_share >= 0 && min_share < 1))
+            throw invalid_argument("Invalid argument");
+        for (auto &p : probs_)
+            p /= sum;
+        quality_.assign(size(), 0);
+        stats_.assign(size(), statistics());
+        make_cdf();
+    }
+
+    template<typename Eng>
+    std::size_t operator()(Eng &&eng) const {
+        assert(!empty());
+        auto x = std::uniform_real_distribution<>(0, cdf_.back())(
+            std::forward<Eng>(eng));
+        // Arms of probability 0 have empty intervals.
+        std::size_t k = std::upper_bound(cdf_.cbegin(), cdf_.cend(), x) - cdf_.cbegin();
+        return std::min(k, size() - 1);
+    }
+
+    // Records an outcome of arm k in the current epoch. Negative gains
+    // count as 0.
+    void feedback(std::size_t k, bool accepted, double gain = 0) noexcept {
+        assert(k < size());
+        auto &s = stats_[k];
+        ++s.tries;
+        if (accepted) {
+            ++s.accepts;
+            s.gain += std::max(gain, 0.0);
+        }
+    }
+
+    // Ends the current epoch, reweighting the arms from its outcomes.
+    void update() {
+        using namespace std;
+        size_t accepts = 0, num_tried = 0, num_arms = 0;
+        double gain = 0;
+        for (size_t k = 0; k != size(); ++k) {
+            accepts += stats_[k].accepts;
+            gain += stats_[k].gain;
+            num_tried += stats_[k].tries != 0;
+            num_arms += probs_[k] > 0;
+        }
+        double unit = accepts && gain > 0 ? gain / accepts : 0;
+        auto reward = [&](const statistics &s) {
+            return (s.accepts + (unit > 0 ? s.gain / unit : 0)) / s.tries;
+        };
+
+        if (fresh_ && num_tried) {
+            // Start from the initial weights, in units of the rewards.
+            double mean = 0;
+            for (auto &s : stats_)
+                if (s.tries)
+                    mean += reward(s) / num_tried;
+            for (size_t k = 0; k != size(); ++k)
+                quality_[k] = probs_[k] * num_arms * mean;
+            fresh_ = !(mean > 0);
+        }
+        for (size_t k = 0; k != size(); ++k) {
+            if (stats_[k].tries)
+                quality_[k] += learning_rate_ * (reward(stats_[k]) - quality_[k]);
+            stats_[k] = statistics();
+        }
+
+        auto sum = accumulate(quality_.cbegin(), quality_.cend(), 0.0);
+        if (fresh_ || !(sum > 0))
+            return;
+        double floor = min_share_ / num_arms;
+        for (size_t k = 0; k != size(); ++k)
+            if (probs_[k] > 0)
+                probs_[k] = floor + (1 - min_share_) * quality_[k] / sum;
+        make_cdf();
+    }
+
+    std::size_t size() const noexcept {
+        return probs_.size();
+    }
+
+    bool empty() const noexcept {
+        return probs_.empty();
+    }
+
+    // Current probability of arm k.
+    double probability(std::size_t k) const noexcept {
+        return probs_[k];
+    }
+
+    // Prints the current probabilities.
+    friend std::ostream &operator<<(std::ostream &out,
+        const adaptive_discrete_distribution &dist) {
+        for (auto p : dist.probs_)
+            out << p << " ";
+        return out;
+    }
+
+private:
+    struct statistics {
+        std::size_t tries = 0, accepts = 0;
+        double gain = 0;
+    };
+
+    void make_cdf() {
+        cdf_.resize(size());
+        std::partial_sum(probs_.cbegin(), probs_.cend(), cdf_.begin());
+    }
+
+    std::vector<double> probs_, cdf_;
+    std::vector<double> quality_;       // Smoothed mean reward of each arm
+    std::vector<statistics> stats_;     // Outcomes of the current epoch
+    double learning_rate_ = 0.3, min_share_ = 0.1;
+    bool fresh_ = true;                 // Whether quality_ is unset
+};
+AURELIANO_END
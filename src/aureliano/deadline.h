@@ -0,0 +1,78 @@
+// deadline.h: wall-clock deadline cheap enough to probe in inner loops.
+// Author: LYL (Aureliano Lee)
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include "xaureliano.h"
+
+AURELIANO_BEGIN
+// Wall-clock budget from construction, measured with steady_clock.
+// expired() reads the clock only on every stride-th call, so that it can
+// be probed once per move of a local search; once expired, it stays so.
+// Copies share the budget but not the probing counter, so each thread
+// probes its own copy. A default constructed deadline never expires.
+class deadline {
+public:
+    using clock = std::chrono::steady_clock;
+    using duration = clock::duration;
+    using time_point = clock::time_point;
+
+    deadline() noexcept : start_(clock::now()), end_(time_point::max()) { }
+
+    // Note: budget + now must be representable by time_point.
+    template<typename Rep, typename Period>
+    explicit deadline(const std::chrono::duration<Rep, Period> &budget,
+        std::size_t stride = 256) noexcept :
+        start_(clock::now()),
+        end_(start_ + std::chrono::duration_cast<duration>(budget)),
+        stride_(std::max(stride, std::size_t(1))), countdown_(stride_) { }
+
+    bool unlimited() const noexcept {
+        return end_ == time_point::max();
+    }
+
+    // Probes the clock on every stride-th call.
+    bool expired() noexcept {
+        if (expired_)
+            return true;
+        if (--countdown_)
+            return false;
+        countdown_ = stride_;
+        return expired_now();
+    }
+
+    // Probes the clock at once.
+    bool expired_now() noexcept {
+        if (!expired_ && !unlimited())
+            expired_ = clock::now() >= end_;
+        return expired_;
+    }
+
+    duration elapsed() const noexcept {
+        return clock::now() - start_;
+    }
+
+    // Returns: duration::max() if unlimited.
+    duration remaining() const noexcept {
+        if (unlimited())
+            return duration::max();
+        return std::max(end_ - clock::now(), duration::zero());
+    }
+
+    // Number of further steps taking step each that fit in the budget.
+    std::size_t steps_left(duration step) const noexcept {
+        auto left = remaining();
+        if (unlimited() || step <= duration::zero())
+            return static_cast<std::size_t>(-1);
+        return static_cast<std::size_t>(left / step);
+    }
+
+private:
+    time_point start_, end_;
+    std::size_t stride_ = 256, countdown_ = 256;
+    bool expired_ = false;
+};
+AURELIANO_END
@@ -0,0 +1,278 @@
+// hpwl.h: half-perimeter wirelength of nets, kept incrementally.
+// Author: LYL (Aureliano Lee)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "xaureliano.h"
+
+AURELIANO_BEGIN
+// Half-perimeter wirelength (hpwl) of nets over pins of modules, kept
+// incrementally as modules are placed; the wirelength of both polish and
+// seqpair. Nets are in CSR form: the pins of net i are pins net_offsets[i],
+// ..., net_offsets[i + 1] - 1, pin j lying on module pin_modules[j]. Pins
+// sit at the centres of their modules, or at given offsets, rotated with
+// the modules.
+// The positions of the pins, doubled to keep centres integral, are cached
+// in structures of arrays ordered by net, so that the bounding box of a
+// net is a reduction over contiguous pins, done by a bbox_function which
+// may be vectorised (see seqpair::get_bbox_kernels()). place() moves the
+// pins of a module and marks their nets, and update() recounts the marked
+// nets only. The changes are logged until commit(), so that rollback() can
+// return to the placement then without recounting them.
+// Note: doubled coordinates must fit in int32_t.
+class incremental_hpwl {
+public:
+    // Writes the bounding box of the points (xs[i], ys[i]), i in [0, n),
+    // n > 0, to box as { xmin, xmax, ymin, ymax }.
+    using bbox_function = void (*)(const std::int32_t *xs,
+        const std::int32_t *ys, std::size_t n, std::int32_t *box);
+
+    // Position and size of a module.
+    struct place_type {
+        bool operator==(const place_type &p) const noexcept {
+            return x == p.x && y == p.y && w == p.w && h == p.h;
+        }
+
+        int x, y, w, h;
+    };
+
+    incremental_hpwl() = default;
+
+    // Pins at the centres of num_modules modules.
+    incremental_hpwl(std::vector<std::size_t> net_offsets,
+        std::vector<std::size_t> pin_modules, std::size_t num_modules,
+        bbox_function bbox = scalar_bbox) :
+        net_offsets_(std::move(net_offsets)), pin_modules_(std::move(pin_modules)),
+        bbox_(bbox) {
+        build(num_modules);
+    }
+
+    // Pin j at (pin_x[j], pin_y[j]) from the lower left corner of its
+    // module m unrotated, widths[m] wide and heights[m] high. A module
+    // placed with another width is taken as rotated by 90 degrees
+    // counterclockwise; squares never are, their rotations being the same
+    // packing.
+    incremental_hpwl(std::vector<std::size_t> net_offsets,
+        std::vector<std::size_t> pin_modules, const std::vector<int> &pin_x,
+        const std::vector<int> &pin_y, std::vector<int> widths,
+        std::vector<int> heights, bbox_function bbox = scalar_bbox) :
+        net_offsets_(std::move(net_offsets)), pin_modules_(std::move(pin_modules)),
+        widths_(std::move(widths)), heights_(std::move(heights)), bbox_(bbox) {
+        assert(pin_x.size() == pin_modules_.size() && pin_y.size() == pin_modules_.size());
+        assert(widths_.size() == heights_.size());
+        dx_.resize(pin_x.size());
+        dy_.resize(pin_y.size());
+        for (std::size_t j = 0; j != pin_x.size(); ++j) {
+            dx_[j] = pin_x[j] << 1;
+            dy_[j] = pin_y[j] << 1;
+        }
+        build(widths_.size());
+    }
+
+    // Places module m at (x, y), w wide and h high. Its nets are recounted
+    // by the next update().
+    void place(std::size_t m, int x, int y, int w, int h) {
+        assert(m < num_modules());
+        place_type p{ x, y, w, h };
+        if (p == places_[m])
+            return;
+        moves_.emplace_back(m, places_[m]);
+        move(m, p);
+        for (auto k = module_offsets_[m]; k != module_offsets_[m + 1]; ++k) {
+            auto net = pin_nets_[module_pins_[k]];
+            if (!marked_[net]) {
+                marked_[net] = true;
+                dirty_.push_back(net);
+            }
+        }
+    }
+
+    // Recounts the nets of the modules placed since the last update().
+    // Returns: hpwl of the current placement.
+    double update() {
+        for (auto net : dirty_) {
+            edits_.emplace_back(net, boxes_[net]);
+            set_box(net, box_of(net));
+            marked_[net] = false;
+        }
+        dirty_.clear();
+        return value();
+    }
+
+    // Forgets the changes logged.
+    void commit() noexcept {
+        moves_.clear();
+        edits_.clear();
+    }
+
+    // Returns to the placement at the last commit(), dropping the modules
+    // placed since the last update().
+    void rollback() noexcept {
+        for (auto i = edits_.rbegin(); i != edits_.rend(); ++i)
+            set_box(i->first, i->second);
+        for (auto i = moves_.rbegin(); i != moves_.rend(); ++i)
+            move(i->first, i->second);
+        for (auto net : dirty_)
+            marked_[net] = false;
+        dirty_.clear();
+        commit();
+    }
+
+    // hpwl as of the last update().
+    double value() const noexcept {
+        return twice_ / 2.0;
+    }
+
+    // hpwl of modules m at place_of(m), counted from scratch.
+    template<typename PlaceOf>
+    double evaluate(PlaceOf place_of) const {
+        std::int64_t twice = 0;
+        for (std::size_t net = 0; net != num_nets(); ++net) {
+            auto first = net_offsets_[net], last = net_offsets_[net + 1];
+            if (first == last)
+                continue;
+            auto xy = pin_position(first, place_of(pin_modules_[first]));
+            box_type box{ xy.first, xy.first, xy.second, xy.second };
+            for (auto j = first + 1; j != last; ++j) {
+                xy = pin_position(j, place_of(pin_modules_[j]));
+                box[0] = std::min(box[0], xy.first);
+                box[1] = std::max(box[1], xy.first);
+                box[2] = std::min(box[2], xy.second);
+                box[3] = std::max(box[3], xy.second);
+            }
+            twice += half_perimeter(box);
+        }
+        return twice / 2.0;
+    }
+
+    // For debug: hpwl of the current placement counted from scratch.
+    double evaluate() const {
+        return evaluate([this](std::size_t m) { return places_[m]; });
+    }
+
+    std::size_t num_nets() const noexcept {
+        return net_offsets_.size() - 1;
+    }
+
+    std::size_t num_pins() const noexcept {
+        return pin_modules_.size();
+    }
+
+    std::size_t num_modules() const noexcept {
+        return places_.size();
+    }
+
+private:
+    using box_type = std::array<std::int32_t, 4>;   // xmin, xmax, ymin, ymax
+
+    static void scalar_bbox(const std::int32_t *xs, const std::int32_t *ys,
+        std::size_t n, std::int32_t *box) noexcept {
+        box[0] = box[1] = xs[0];
+        box[2] = box[3] = ys[0];
+        for (std::size_t i = 1; i != n; ++i) {
+            box[0] = std::min(box[0], xs[i]);
+            box[1] = std::max(box[1], xs[i]);
+            box[2] = std::min(box[2], ys[i]);
+            box[3] = std::max(box[3], ys[i]);
+        }
+    }
+
+    static std::int64_t half_perimeter(const box_type &box) noexcept {
+        return std::int64_t(box[1]) - box[0] + (std::int64_t(box[3]) - box[2]);
+    }
+
+    void build(std::size_t num_modules) {
+        using namespace std;
+        if (net_offsets_.empty())
+            net_offsets_.push_back(0);
+        assert(net_offsets_.back() == pin_modules_.size());
+        auto num_pins = pin_modules_.size();
+        // No module is placed at first, so that the first place() of each
+        // marks its nets.
+        places_.assign(num_modules, place_type{ 0, 0, -1, -1 });
+        boxes_.assign(num_nets(), box_type{ 0, 0, 0, 0 });
+        marked_.assign(num_nets(), false);
+        px_.assign(num_pins, 0);
+        py_.assign(num_pins, 0);
+
+        // Net of each pin, and pins of each module.
+        pin_nets_.resize(num_pins);
+        for (size_t net = 0; net != num_nets(); ++net)
+            fill(pin_nets_.begin() + net_offsets_[net],
+                pin_nets_.begin() + net_offsets_[net + 1], net);
+        module_offsets_.assign(num_modules + 1, 0);
+        for (auto m : pin_modules_) {
+            assert(m < num_modules);
+            ++module_offsets_[m + 1];
+        }
+        partial_sum(module_offsets_.begin(), module_offsets_.end(),
+            module_offsets_.begin());
+        module_pins_.resize(num_pins);
+        vector<size_t> next(module_offsets_.cbegin(), module_offsets_.cend() - 1);
+        for (size_t j = 0; j != num_pins; ++j)
+            module_pins_[next[pin_modules_[j]]++] = j;
+    }
+
+    // Doubled position of pin j on its module at p.
+    std::pair<std::int32_t, std::int32_t> pin_position(std::size_t j,
+        const place_type &p) const noexcept {
+        std::int32_t x = p.x << 1, y = p.y << 1;
+        if (dx_.empty())
+            return { x + p.w, y + p.h };
+        auto m = pin_modules_[j];
+        if (p.w == widths_[m])
+            return { x + dx_[j], y + dy_[j] };
+        // Rotated: (x, y) to (height - y, x).
+        return { x + (heights_[m] << 1) - dy_[j], y + dx_[j] };
+    }
+
+    // Moves the pins of module m to p.
+    void move(std::size_t m, const place_type &p) noexcept {
+        places_[m] = p;
+        for (auto k = module_offsets_[m]; k != module_offsets_[m + 1]; ++k) {
+            auto j = module_pins_[k];
+            std::tie(px_[j], py_[j]) = pin_position(j, p);
+        }
+    }
+
+    box_type box_of(std::size_t net) const noexcept {
+        box_type box{ 0, 0, 0, 0 };
+        auto first = net_offsets_[net], n = net_offsets_[net + 1] - first;
+        if (n)
+            bbox_(px_.data() + first, py_.data() + first, n, box.data());
+        return box;
+    }
+
+    void set_box(std::size_t net, const box_type &box) noexcept {
+        twice_ += half_perimeter(box) - half_perimeter(boxes_[net]);
+        boxes_[net] = box;
+    }
+
+    std::vector<std::size_t> net_offsets_{ 0 }, pin_modules_, pin_nets_;
+    std::vector<std::size_t> module_offsets_, module_pins_; // Pins of modules
+    std::vector<std::int32_t> dx_, dy_;     // Doubled pin offsets, empty if centred
+    std::vector<int> widths_, heights_;     // Unrotated sizes of modules
+    std::vector<place_type> places_;
+    std::vector<std::int32_t> px_, py_;     // Doubled pin positions
+    std::vector<box_type> boxes_;
+    std::int64_t twice_ = 0;                // Twice the hpwl
+    bbox_function bbox_ = scalar_bbox;
+
+    // Nets marked since the last update().
+    std::vector<std::size_t> dirty_;
+    std::vector<char> marked_;
+
+    // Changes since the last commit().
+    std::vector<std::pair<std::size_t, place_type>> moves_;
+    std::vector<std::pair<std::size_t, box_type>> edits_;
+};
+AURELIANO_END
@@ -0,0 +1,119 @@
+// thread_pool.h: fixed-size thread pool for index-parallel jobs.
+// Author: LYL (Aureliano Lee)
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "xaureliano.h"
+
+AURELIANO_BEGIN
+// Pool of worker threads running one job at a time, where a job invokes
+// func(i) for each i in [0, n). The calling thread takes part in the job,
+// so a pool of size 1 owns no worker thread.
+class thread_pool {
+public:
+    // Constructs a pool of num_threads threads (including the caller).
+    explicit thread_pool(std::size_t num_threads =
+        std::thread::hardware_concurrency()) {
+        if (num_threads == 0)
+            num_threads = 1;
+        workers_.reserve(num_threads - 1);
+        for (std::size_t i = 1; i != num_threads; ++i)
+            workers_.emplace_back([this] { work(); });
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        job_cv_.notify_all();
+        for (auto &t : workers_)
+            t.join();
+    }
+
+    std::size_t size() const noexcept {
+        return workers_.size() + 1;
+    }
+
+    // Invokes func(i) for each i in [0, n) on the pool, and waits for all of
+    // them. Invocations may run concurrently in any order.
+    // Throws: the first exception thrown by func, after all invocations end.
+    template<typename Func>
+    void parallel_for(std::size_t n, Func &&func) {
+        if (n == 0)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            job_ = [&func](std::size_t i) { func(i); };
+            job_size_ = n;
+            next_ = 0;
+            error_ = nullptr;
+            num_busy_ = workers_.size();
+            ++generation_;
+        }
+        job_cv_.notify_all();
+        run_job();
+
+        std::unique_lock<std::mutex> lock(mtx_);
+        done_cv_.wait(lock, [this] { return num_busy_ == 0; });
+        job_ = nullptr;
+        if (error_)
+            std::rethrow_exception(error_);
+    }
+
+private:
+    void work() {
+        std::size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mtx_);
+        for (;;) {
+            job_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+            lock.unlock();
+            run_job();
+            lock.lock();
+            if (--num_busy_ == 0)
+                done_cv_.notify_one();
+        }
+    }
+
+    // Takes indices of the current job until none is left.
+    void run_job() {
+        for (;;) {
+            auto i = next_++;
+            if (i >= job_size_)
+                break;
+            try {
+                job_(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (!error_)
+                    error_ = std::current_exception();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mtx_;
+    std::condition_variable job_cv_, done_cv_;
+    std::function<void(std::size_t)> job_;
+    std::size_t job_size_ = 0;
+    std::atomic<std::size_t> next_{ 0 };
+    std::size_t generation_ = 0;        // Number of jobs started
+    std::size_t num_busy_ = 0;          // Workers yet to finish the job
+    bool stop_ = false;
+    std::exception_ptr error_;
+};
+AURELIANO_END
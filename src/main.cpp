@@ -4,7 +4,10 @@
 #include <chrono>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <random>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 
@@ -12,14 +15,19 @@
 #include <boost/program_options.hpp>
 #include <boost/pool/pool_alloc.hpp>
 
+#include "deadline.h"
 #include "timeit.h"
+#include "thread_pool.h"
 #include "toolbox.h"
 #include "layout.h"
 #include "pack_generator.h"
 #include "sa_packer.h"
+#include "pt_packer.h"
+#include "wirelength.h"
 #include "verify.hpp"
 #include "verification.h"
 #include "interpreter.h"
+#include "netlist.h"
 #include "sa.hpp"
 
 using namespace std;
@@ -46,6 +54,11 @@ using tree_type = polish::polish_tree<
         boost::interprocess::null_mutex
     >
 >;
+using mt_vtree_type = polish::vectorized_polish_tree<>;
+using mt_tree_type = polish::polish_tree<>;
+using flat_vtree_type = polish::flat_vectorized_polish_tree<>;
+using arena_vtree_type = polish::arena_vectorized_polish_tree<>;
+using flat_tree_type = polish::flat_polish_tree<>;
 using char_allocator = boost::fast_pool_allocator<
     char,
     boost::default_user_allocator_new_delete,
@@ -54,8 +67,8 @@ using char_allocator = boost::fast_pool_allocator<
 
 namespace {
 
-    template<typename Generator, typename Alloc, typename FwdIt>
-    void run_packer(SaPacker<Generator> &packer, Layout<Alloc> &layout,
+    template<typename Packer, typename ChgDist, typename Alloc, typename FwdIt>
+    void run_packer(Packer &packer, ChgDist &chg_dist, Layout<Alloc> &layout,
         FwdIt first_line, FwdIt last_line, ostream &out,
         int verbose_level) {
         using namespace seqpair::verification;
@@ -63,9 +76,6 @@ namespace {
 
         cerr << packer.options();
 
-        // Change distribution 
-        PackGeneratorBase::default_change_distribution chg_dist;
-
         double cost = 0;
         auto runtime = aureliano::timeit([&] {
             cost = packer(layout, first_line, last_line,
@@ -86,7 +96,7 @@ namespace {
         }
         cerr << "Utilization: " << 1.0 * sum_rect_areas /
             (sln_area.first * sln_area.second) << "\n";
-        auto wirelen = sum_manhattan_distances(layout, first_line, last_line);
+        auto wirelen = packer.energy_function().hpwl.evaluate(layout);
         cerr << "Wirelength: " << wirelen << "\n";
         cerr << "Cost: " << cost << "\n";
 
@@ -104,6 +114,41 @@ namespace {
         out << layout.format(format_policy::no_delim);
     }
 
+    // Runs SaPacker, or PtPacker on num_threads threads if num_threads > 1.
+    // If adaptive, SaPacker learns the probabilities of changes. Either
+    // stops with its best solution by the deadline.
+    // Note: replicas of PtPacker run concurrently, so they allocate from
+    //      std::allocator rather than the single-threaded pool.
+    template<template<typename> class Generator, typename EFunc, typename Alloc,
+        typename FwdIt>
+    void run_method(const SaPackerBase::options_t &opts, size_t num_threads,
+        bool adaptive, const aureliano::deadline &deadline, const EFunc &func,
+        Layout<Alloc> &layout, FwdIt first_line, FwdIt last_line, ostream &out,
+        int verbose_level) {
+        PackGeneratorBase::default_change_distribution chg_dist;
+        if (num_threads > 1) {
+            if (adaptive)
+                cerr << "Warning: --adaptive is ignored by parallel tempering." << "\n";
+            PtPackerBase::tempering_options_t pt_opts;
+            pt_opts.num_threads = num_threads;
+            cerr << pt_opts;
+            auto packer = makePtPacker<Generator<std::allocator<char>>>(opts, pt_opts, func);
+            packer.set_deadline(deadline);
+            run_packer(packer, chg_dist, layout, first_line, last_line, out, verbose_level);
+        } else if (adaptive) {
+            PackGeneratorBase::adaptive_change_distribution adaptive_dist(chg_dist);
+            auto packer = makeSaPacker<Generator<char_allocator>>(opts, func);
+            packer.set_deadline(deadline);
+            run_packer(packer, adaptive_dist, layout, first_line, last_line, out,
+                verbose_level);
+            cerr << "Learned change probabilities:\n" << adaptive_dist << "\n";
+        } else {
+            auto packer = makeSaPacker<Generator<char_allocator>>(opts, func);
+            packer.set_deadline(deadline);
+            run_packer(packer, chg_dist, layout, first_line, last_line, out, verbose_level);
+        }
+    }
+
     unordered_map<string, size_t> make_modulename_index(const yal::Interpreter &i) {
         unordered_map<string, size_t> map;
         map.reserve(i.modules().size());
@@ -114,86 +159,157 @@ namespace {
         return map;
     }
 
+    // Runs SA rounds on a pool of num_threads threads until rounds
+    // consecutive rounds end without improving the best tree, or the
+    // deadline passes, which also cuts the rounds running short. If adaptive,
+    // SA learns the probabilities of move types in each round. If alpha < 1,
+    // SA minimises alpha * area + (1 - alpha) * hpwl. Each thread anneals a
+    // copy of the best tree with its own engine, and publishes its result
+    // under a mutex; the log of a round is written out at once.
+    // Returns: the best tree.
+    template<typename Tree, typename Eng>
+    Tree anneal_polish_tree(const Tree &init_tree, int rounds,
+        std::size_t num_threads, bool adaptive, const aureliano::deadline &deadline,
+        double alpha, const polish::incremental_hpwl &hpwl, Eng &eng) {
+        using namespace polish;
+
+        double init_accept_rate = 0.95, cooldown_ratio = 0.008, 
+            cooldown_speed = 0.01, ending_temperature = 20;
+        Tree tree = init_tree;
+        double best_utility = numeric_limits<double>::infinity();
+        std::int64_t utility_stable = 0;
+        mutex mtx;
+
+        aureliano::thread_pool pool(num_threads);
+        vector<default_random_engine> engines;
+        for (std::size_t i = 0; i != pool.size(); ++i)
+            engines.emplace_back(eng());
+
+        pool.parallel_for(pool.size(), [&](std::size_t k) {
+            auto &local_eng = engines[k];
+            auto local_deadline = deadline;
+            ostringstream log;
+            unique_lock<mutex> lock(mtx);
+            while (utility_stable < rounds && !local_deadline.expired_now()) {
+                Tree local_tree = tree;
+                lock.unlock();
+
+                SA<Tree> sa(local_tree, init_accept_rate, cooldown_ratio,
+                    cooldown_speed, ending_temperature, local_eng, log, alpha, hpwl);
+                sa.set_adaptive(adaptive);
+                sa.set_deadline(local_deadline);
+                while (!sa.reach_end()) {
+                    while (!sa.reach_balance()) {
+                        sa.take_step(local_eng);
+                    }
+                    sa.cool_down_by_both();
+                }
+                sa.print_statistics();
+
+                lock.lock();
+                cerr << log.str();
+                log.str("");
+                auto utility = sa.get_best_cost();
+                if (utility < best_utility) {
+                    utility_stable = 0;
+                    tree = sa.get_best_tree();
+                    best_utility = utility;
+                } else {
+                    utility_stable++;
+                }
+            }
+        });
+        return tree;
+    }
+
+    // hpwl of the nets of netlist, whose instances are the modules of
+    // interpreter in NETWORK order, i.e., the leaves of trees constructed
+    // with make_module_index(), counted with the bbox_kernels of seqpair.
+    polish::incremental_hpwl make_polish_hpwl(const yal::Interpreter &interpreter,
+        const yal::Netlist &netlist) {
+        vector<int> widths, heights;
+        for (auto i : interpreter.make_module_index()) {
+            const yal::Module &m = interpreter.modules()[i];
+            widths.push_back(m.xspan());
+            heights.push_back(m.yspan());
+        }
+        return polish::incremental_hpwl(netlist.net_offsets(), netlist.pin_modules(),
+            netlist.pin_x(), netlist.pin_y(), widths, heights,
+            get_bbox_kernels().bbox);
+    }
+
+    // Prints the hpwl of hpwl with modules at (x, y, w, h) tuples
+    // [first, last), in post-order of the leaves of tree, and the cost.
+    template<typename Tree, typename FwdIt>
+    void print_wirelength(const Tree &tree, FwdIt first, FwdIt last,
+        double alpha, polish::incremental_hpwl hpwl) {
+        std::int64_t w = 0, h = 0;
+        auto it = tree.begin();
+        for (; first != last; ++first) {
+            while (it->type != combine_type::LEAF)
+                ++it;
+            hpwl.place(it->id, std::get<0>(*first), std::get<1>(*first),
+                std::get<2>(*first), std::get<3>(*first));
+            w = max<std::int64_t>(w, std::get<0>(*first) + std::get<2>(*first));
+            h = max<std::int64_t>(h, std::get<1>(*first) + std::get<3>(*first));
+            ++it;
+        }
+        auto wirelen = hpwl.update();
+        cerr << "Wirelength: " << wirelen << endl;
+        cerr << "Cost: " << alpha * w * h + (1 - alpha) * wirelen << endl;
+    }
+
+    template<typename Tree>
     void run_vectorized_polish_tree(const yal::Interpreter &interpreter,
-        int rounds, std::ostream &out) {
+        int rounds, std::size_t num_threads, bool adaptive, std::size_t curve_limit,
+        const aureliano::deadline &deadline, double alpha,
+        const yal::Netlist &netlist, std::ostream &out) {
         using namespace polish;
         cerr <<  "Start simulate annealing..." << endl;
-        vtree_type vtree;
+        Tree vtree;
         auto module_index = interpreter.make_module_index();
         default_random_engine eng(random_device{}());
         vtree.construct(interpreter.modules().cbegin(),
             module_index.cbegin(), module_index.cend(), eng);
+        vtree.set_curve_limit(curve_limit);
+        auto hpwl = make_polish_hpwl(interpreter, netlist);
 
-        double init_accept_rate = 0.95, cooldown_ratio = 0.008, 
-            cooldown_speed = 0.01, ending_temperature = 20;
-        std::int64_t utility_stable = 0, pre_utility = 0, utility = 0;
-        while (utility_stable < rounds) {
-            SA<vtree_type> sa(vtree, init_accept_rate, cooldown_ratio,
-                cooldown_speed, ending_temperature, eng);
-            while (!sa.reach_end()) {
-                while (!sa.reach_balance()) {
-                    sa.take_step(eng);
-                }
-                sa.cool_down_by_both();
-            }
-            sa.print_statistics();
-            utility = sa.get_best_area();
-            if (pre_utility == utility) {
-                utility_stable++;
-            } else {
-                utility_stable = 0;
-            }
-            vtree = sa.get_best_tree();
-            pre_utility = utility;
-        }
+        vtree = anneal_polish_tree(vtree, rounds, num_threads, adaptive, deadline,
+            alpha, hpwl, eng);
         
-        std::vector<typename vtree_type::floorplan_entry> result;
-        std::size_t best_point = SA<vtree_type>::get_best_point(vtree);
+        std::vector<typename Tree::floorplan_entry> result;
+        std::size_t best_point = SA<Tree>::get_best_point(vtree);
         vtree.floorplan(best_point, back_inserter(result));
         for (auto &&e: result) {
             out << std::get<0>(e) << " " << std::get<1>(e) 
                 << " " << std::get<2>(e) << " " << std::get<3>(e) << std::endl;
         }
+        if (alpha < 1)
+            print_wirelength(vtree, result.cbegin(), result.cend(), alpha, hpwl);
         if (polish::overlap(result.begin(), result.end()))
             std::cerr << "Overlap error!!" << std::endl;
         else
             std::cerr << "Answer accepted." << std::endl;
     }
 
+    template<typename Tree>
     void run_polish_tree(const yal::Interpreter &interpreter,
-        int rounds, std::ostream &out) {
+        int rounds, std::size_t num_threads, bool adaptive,
+        const aureliano::deadline &deadline, double alpha,
+        const yal::Netlist &netlist, std::ostream &out) {
         using namespace polish;
         cerr << "Start simulate annealing..." << endl;
-        tree_type tree;
+        Tree tree;
         auto module_index = interpreter.make_module_index();
         default_random_engine eng(random_device{}());
         tree.construct(interpreter.modules().cbegin(),
             module_index.cbegin(), module_index.cend(), eng);
+        auto hpwl = make_polish_hpwl(interpreter, netlist);
 
-        double init_accept_rate = 0.95, cooldown_ratio = 0.008, 
-            cooldown_speed = 0.01, ending_temperature = 20;
-        std::int64_t utility_stable = 0, pre_utility = 0, utility = 0;
-        while (utility_stable < rounds) {
-            SA<tree_type> sa(tree, init_accept_rate, cooldown_ratio,
-                cooldown_speed, ending_temperature, eng);
-            while (!sa.reach_end()) {
-                while (!sa.reach_balance()) {
-                    sa.take_step(eng);
-                }
-                sa.cool_down_by_both();
-            }
-            sa.print_statistics();
-            utility = sa.get_best_area();
-            if (pre_utility == utility) {
-                utility_stable++;
-            } else {
-                utility_stable = 0;
-            }
-            tree = sa.get_best_tree();
-            pre_utility = utility;
-        }
+        tree = anneal_polish_tree(tree, rounds, num_threads, adaptive, deadline,
+            alpha, hpwl, eng);
 
-        std::vector<typename tree_type::floorplan_entry> result;
+        std::vector<typename Tree::floorplan_entry> result;
         tree.floorplan(back_inserter(result));
         std::vector<std::tuple<dimension_type, dimension_type,
             dimension_type, dimension_type>> detailed_result;
@@ -208,6 +324,9 @@ namespace {
                 ++it;
             } while (it != tree.end() && it->type != combine_type::LEAF);
         }
+        if (alpha < 1)
+            print_wirelength(tree, detailed_result.cbegin(), detailed_result.cend(),
+                alpha, hpwl);
         if (polish::overlap(detailed_result.cbegin(), detailed_result.cend())) 
             std::cerr << "Overlap error!!" << std::endl;
         else
@@ -226,11 +345,24 @@ int main(int argc, char **argv) {
         ("output,o", po::value< vector<string> >(),
             "output placement file (default cout)")
         ("rounds,r", po::value<int>()->default_value(10),
-            "required stable rounds for polish-curve/polish to stop")
+            "required stable rounds for polish methods to stop")
         ("option,O", po::value< vector<string> >(),
             "option file for lcs/dag")
+        ("candidates,k", po::value<size_t>()->default_value(1),
+            "candidate moves per step for lcs/dag, the best of which is tested")
+        ("threads,t", po::value<size_t>()->default_value(1),
+            "threads (parallel tempering for lcs/dag, concurrent rounds for polish methods)")
+        ("alpha", po::value<double>()->default_value(1.0),
+            "weight of area against wirelength in the cost (0-1; below 1 for lcs/dag/polish/polish-curve)")
+        ("adaptive",
+            "learn the probabilities of move types online (SA only)")
+        ("time-limit", po::value<double>()->default_value(0),
+            "wall-clock budget in seconds (0 unlimited); the best solution found is output when it runs out")
+        ("curve-limit", po::value<size_t>()->default_value(0),
+            "max points per shape curve for polish-curve methods (0 unlimited, otherwise at least 3)")
         ("method,m", po::value< vector<string> >(),
-            "method (polish-curve/polish/lcs/dag, default polish-curve)")
+            "method (polish-curve/polish/polish-curve-flat/polish-curve-arena/polish-flat/"
+            "lcs/lcs-fenwick/lcs-veb/lcs-inc/dag/flat-dag, default polish-curve)")
         ("verbose,v", po::value<int>()->default_value(1)->implicit_value(2),
             "verbose level (0-2)")
         ;
@@ -245,33 +377,48 @@ int main(int argc, char **argv) {
     }
 
     try {
+        // The budget covers parsing and output as well.
+        auto time_limit = vm["time-limit"].as<double>();
+        if (!(time_limit >= 0))
+            throw runtime_error("Invalid time limit");
+        auto deadline = time_limit > 0 ?
+            aureliano::deadline(chrono::duration<double>(time_limit)) :
+            aureliano::deadline();
+        if (time_limit > 0)
+            cerr << "Time limit: " << time_limit << "s" << endl;
+
         string method = "polish-curve";
         if (vm.count("method")) {
             method = vm["method"].as<vector<string>>().back();
             for (auto &e : method)
                 e = tolower(e);
-            if (method != "lcs" && method != "dag" 
-                && method != "polish" && method != "polish-curve")
+            if (method != "lcs" && method != "lcs-fenwick" && method != "lcs-veb"
+                && method != "lcs-inc"
+                && method != "dag" && method != "flat-dag"
+                && method != "polish" && method != "polish-curve"
+                && method != "polish-flat" && method != "polish-curve-flat"
+                && method != "polish-curve-arena")
                 throw runtime_error("Unrecognized method: " + method);
         }
 
         yal::Interpreter interpreter;
-        ifstream fin;
         if (vm.count("input")) {
             auto &&filename = vm["input"].as<vector<string>>().back();
             cerr << "Input stream: " << filename << endl;
-            fin.open(filename);
-            if (!fin.is_open())
-                throw runtime_error("Cannot open file");
-            interpreter.switch_input_stream(fin);
+            interpreter.parse_file(filename);
         } else {
             cerr << "Input stream: cin" << endl;
+            interpreter.parse();
         }
-
-        interpreter.parse();
         if (interpreter.parent_module().network.empty())
             throw runtime_error("Modules empty!");
 
+        auto alpha = vm["alpha"].as<double>();
+        if (!(alpha >= 0 && alpha <= 1))
+            throw runtime_error("Invalid alpha");
+        yal::Netlist netlist(interpreter.modules(), interpreter.parent_module(),
+            interpreter.make_module_index());
+
         ostream *out = &cout;
         ofstream fout;
         if (vm.count("output")) {
@@ -279,7 +426,9 @@ int main(int argc, char **argv) {
             out = &fout;
         }
 
-        if (method == "polish" || method == "polish-curve") {
+        if (method == "polish" || method == "polish-curve"
+            || method == "polish-flat" || method == "polish-curve-flat"
+            || method == "polish-curve-arena") {
             cerr <<  "Method: " << method << endl;
             int rounds = vm["rounds"].as<int>();
             if (rounds <= 0) {
@@ -288,13 +437,54 @@ int main(int argc, char **argv) {
             }
             cerr << "Stable rounds: " << rounds << endl;
 
-            auto runtime = method == "polish" ?
-                aureliano::timeit([&] { 
-                    run_polish_tree(interpreter, rounds, *out); 
-                }) :
-                aureliano::timeit([&] { 
-                    run_vectorized_polish_tree(interpreter, rounds, *out); 
-                });
+            auto num_threads = vm["threads"].as<size_t>();
+            cerr << "Threads: " << num_threads << endl;
+
+            bool adaptive = vm.count("adaptive");
+            cerr << "Adaptive moves: " << (adaptive ? "on" : "off") << endl;
+
+            // Flat trees do not place modules incrementally.
+            if (alpha < 1 && method != "polish" && method != "polish-curve")
+                throw runtime_error("Wirelength is not supported by method: " + method);
+            cerr << "Nets: " << netlist.num_nets() << ", pins: " << netlist.num_pins() << endl;
+            cerr << "Alpha: " << alpha << endl;
+
+            auto curve_limit = vm["curve-limit"].as<size_t>();
+            if (method == "polish-curve" || method == "polish-curve-flat"
+                || method == "polish-curve-arena") {
+                cerr << "Curve limit: " << curve_limit << endl;
+                cerr << "Curve kernels: " <<
+                    polish::to_string(polish::get_curve_kernels().isa) << endl;
+            }
+
+            // Trees shared between threads allocate from std::allocator
+            auto runtime = aureliano::timeit([&] {
+                if (method == "polish-flat") {
+                    run_polish_tree<flat_tree_type>(interpreter, rounds,
+                        num_threads, adaptive, deadline, alpha, netlist, *out);
+                } else if (method == "polish-curve-flat") {
+                    run_vectorized_polish_tree<flat_vtree_type>(interpreter, rounds,
+                        num_threads, adaptive, curve_limit, deadline, alpha, netlist, *out);
+                } else if (method == "polish-curve-arena") {
+                    run_vectorized_polish_tree<arena_vtree_type>(interpreter, rounds,
+                        num_threads, adaptive, curve_limit, deadline, alpha, netlist, *out);
+                } else if (method == "polish") {
+                    if (num_threads > 1)
+                        run_polish_tree<mt_tree_type>(interpreter, rounds, num_threads,
+                            adaptive, deadline, alpha, netlist, *out);
+                    else
+                        run_polish_tree<tree_type>(interpreter, rounds, 1, adaptive,
+                            deadline, alpha, netlist, *out);
+                } else {
+                    if (num_threads > 1)
+                        run_vectorized_polish_tree<mt_vtree_type>(interpreter, rounds,
+                            num_threads, adaptive, curve_limit, deadline, alpha, netlist,
+                            *out);
+                    else
+                        run_vectorized_polish_tree<vtree_type>(interpreter, rounds, 1,
+                            adaptive, curve_limit, deadline, alpha, netlist, *out);
+                }
+            });
 
             cerr << "Runtime: " << static_cast<double>(
                     chrono::duration_cast<chrono::milliseconds>(runtime).count()) / 1000 <<
@@ -323,22 +513,48 @@ int main(int argc, char **argv) {
                 opts.simulaions_per_temperature
                     = max(30 * layout.size(), static_cast<size_t>(1024));
             }
+            opts.candidates_per_move = vm["candidates"].as<size_t>();
 
             int verbose_level = vm["verbose"].as<int>();
+            auto num_threads = vm["threads"].as<size_t>();
+            bool adaptive = vm.count("adaptive");
 
+            // Nets are bound to the energy function rather than passed as lines.
             vector<pair<size_t, size_t>> nets;
 
             cerr << "Rectangles: " << layout.size() << "\n";
-            SaPackerBase::default_energy_function func(1.0);
+            cerr << "Nets: " << netlist.num_nets() << ", pins: " << netlist.num_pins() << "\n";
+            cerr << "Alpha: " << alpha << "\n";
+            if (alpha < 1)
+                cerr << "Bbox kernels: " << to_string(get_bbox_kernels().isa) << "\n";
+            hpwl_energy_function func(alpha, IncrementalHpwl(netlist.net_offsets(),
+                netlist.pin_modules(), netlist.pin_x(), netlist.pin_y(), layout.widths(),
+                layout.heights()));
 
             if (method == "dag") {
                 cerr << "Method: DAG" << "\n";
-                auto packer = makeSaPacker<DagPackGenerator<char_allocator>>(opts, func);
-                run_packer(packer, layout, begin(nets), end(nets), *out, verbose_level);
+                run_method<DagPackGenerator>(opts, num_threads, adaptive, deadline,
+                    func, layout, begin(nets), end(nets), *out, verbose_level);
             } else if (method == "lcs") {
                 cerr << "Method: LCS" << "\n";
-                auto packer = makeSaPacker<LcsPackGenerator<char_allocator>>(opts, func);
-                run_packer(packer, layout, begin(nets), end(nets), *out, verbose_level);
+                run_method<LcsPackGenerator>(opts, num_threads, adaptive, deadline,
+                    func, layout, begin(nets), end(nets), *out, verbose_level);
+            } else if (method == "lcs-fenwick") {
+                cerr << "Method: LCS (Fenwick)" << "\n";
+                run_method<FenwickLcsPackGenerator>(opts, num_threads, adaptive, deadline,
+                    func, layout, begin(nets), end(nets), *out, verbose_level);
+            } else if (method == "lcs-veb") {
+                cerr << "Method: LCS (vEB)" << "\n";
+                run_method<VebLcsPackGenerator>(opts, num_threads, adaptive, deadline,
+                    func, layout, begin(nets), end(nets), *out, verbose_level);
+            } else if (method == "lcs-inc") {
+                cerr << "Method: LCS (incremental)" << "\n";
+                run_method<IncrementalLcsPackGenerator>(opts, num_threads, adaptive, deadline,
+                    func, layout, begin(nets), end(nets), *out, verbose_level);
+            } else if (method == "flat-dag") {
+                cerr << "Method: flat DAG" << "\n";
+                run_method<FlatDagPackGenerator>(opts, num_threads, adaptive, deadline,
+                    func, layout, begin(nets), end(nets), *out, verbose_level);
             } else {
                 assert(false);
             }
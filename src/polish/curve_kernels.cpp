@@ -0,0 +1,556 @@
+//  curve_kernels.cpp
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <vector>
+
+#include "curve_kernels.hpp"
+
+#if POLISH_CURVE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace polish;
+
+namespace {
+
+    using dimension_type = std::int32_t;
+    using source_type = std::uint32_t;
+
+    // Each kernel has a variant writing sources as well (Sources), and
+    // takes null ls and rs otherwise.
+
+    // Portable kernels: two-pointer merges without data-dependent branches.
+
+    template<bool Sources>
+    size_t merge_vertical_portable(const dimension_type *lw,
+        const dimension_type *lh, size_t ln, const dimension_type *rw,
+        const dimension_type *rh, size_t rn, dimension_type *ow,
+        dimension_type *oh, source_type *ls, source_type *rs) {
+        size_t i = 0, j = 0, n = 0;
+        size_t pi = 0, pj = 0;              // Last points taken
+        dimension_type yi = 0, yj = 0;      // and their heights
+        bool si = false, sj = false;        // Whether any is taken
+        while (i != ln && j != rn) {
+            dimension_type xi = lw[i], xj = rw[j];
+            bool ti = xi <= xj, tj = xj <= xi;
+            yi = ti ? lh[i] : yi;
+            yj = tj ? rh[j] : yj;
+            si |= ti;
+            sj |= tj;
+            ow[n] = ti ? xi : xj;
+            oh[n] = yi + yj;
+            if (Sources) {
+                pi = ti ? i : pi;
+                pj = tj ? j : pj;
+                ls[n] = static_cast<source_type>(pi);
+                rs[n] = static_cast<source_type>(pj);
+            }
+            n += si & sj;
+            i += ti;
+            j += tj;
+        }
+        for (; i != ln; ++i, ++n) {
+            ow[n] = lw[i];
+            oh[n] = lh[i] + yj;
+            if (Sources) {
+                ls[n] = static_cast<source_type>(i);
+                rs[n] = static_cast<source_type>(pj);
+            }
+        }
+        for (; j != rn; ++j, ++n) {
+            ow[n] = rw[j];
+            oh[n] = rh[j] + yi;
+            if (Sources) {
+                ls[n] = static_cast<source_type>(pi);
+                rs[n] = static_cast<source_type>(j);
+            }
+        }
+        return n;
+    }
+
+    template<bool Sources>
+    size_t merge_horizontal_portable(const dimension_type *lw,
+        const dimension_type *lh, size_t ln, const dimension_type *rw,
+        const dimension_type *rh, size_t rn, dimension_type *ow,
+        dimension_type *oh, source_type *ls, source_type *rs) {
+        size_t i = 0, j = 0, n = 0;
+        while (i != ln && j != rn) {
+            dimension_type yi = lh[i], yj = rh[j];
+            ow[n] = lw[i] + rw[j];
+            oh[n] = std::max(yi, yj);
+            if (Sources) {
+                ls[n] = static_cast<source_type>(i);
+                rs[n] = static_cast<source_type>(j);
+            }
+            ++n;
+            i += yi >= yj;
+            j += yj >= yi;
+        }
+        return n;
+    }
+
+#if POLISH_CURVE_KERNELS_X86
+
+    // SIMD kernels merge keys with bitonic networks. Keys are widths for
+    // vertical merges and negated heights for horizontal ones, so both are
+    // ascending, and each is tagged with its curve in the lowest bit
+    // (0 for lc and 1 for rc). In the merged sequence, prefix counts of
+    // tags locate the points of lc and rc at or before each key: a vertical
+    // merge adds heights of the last points at or before it, and a
+    // horizontal merge adds widths of the first points at or after it.
+    // Of equal keys, a vertical merge keeps the last and a horizontal merge
+    // the first. Small curves go to the portable kernels.
+
+    constexpr std::size_t min_simd_points = 16;
+    constexpr dimension_type key_max = std::numeric_limits<dimension_type>::max();
+    constexpr dimension_type key_min = std::numeric_limits<dimension_type>::min();
+
+    // Scratch of a thread for tagged keys of lc and rc, and the merged
+    // sequence between sentinels.
+    thread_local std::vector<dimension_type> merge_scratch;
+
+    template<bool Horizontal>
+    inline dimension_type tagged_key(dimension_type k, dimension_type tag) noexcept {
+        return (Horizontal ? -2 * k : 2 * k) + tag;
+    }
+
+    // Copies tagged keys of a curve, padded with key_max to a multiple of w.
+    template<bool Horizontal>
+    inline dimension_type *copy_keys(const dimension_type *k, std::size_t n,
+        dimension_type tag, std::size_t w, dimension_type *dst) noexcept {
+        for (std::size_t i = 0; i != n; ++i)
+            *dst++ = tagged_key<Horizontal>(k[i], tag);
+        for (std::size_t i = n; i % w; ++i)
+            *dst++ = key_max;
+        return dst;
+    }
+
+    // Writes the point at merged position t, given the number nl of keys
+    // of lc at or before t.
+    template<bool Horizontal, bool Sources>
+    inline std::size_t emit_point(const dimension_type *merged, std::size_t t,
+        std::size_t nl, const dimension_type *lv, std::size_t ln,
+        const dimension_type *rv, std::size_t rn, dimension_type *ok,
+        dimension_type *ov, source_type *ls, source_type *rs,
+        std::size_t n) noexcept {
+        dimension_type m = merged[t];
+        std::size_t nr = t + 1 - nl, tag = m & 1;
+        std::size_t li = Horizontal ? nl - (1 - tag) : nl - 1;
+        std::size_t ri = Horizontal ? nr - tag : nr - 1;
+        bool valid = Horizontal ?
+            li < ln && ri < rn && (m >> 1) != (merged[static_cast<std::ptrdiff_t>(t) - 1] >> 1) :
+            nl && nr && (m >> 1) != (merged[t + 1] >> 1);
+        if (valid) {
+            ok[n] = Horizontal ? -(m >> 1) : m >> 1;
+            ov[n] = lv[li] + rv[ri];
+            if (Sources) {
+                ls[n] = static_cast<source_type>(li);
+                rs[n] = static_cast<source_type>(ri);
+            }
+            ++n;
+        }
+        return n;
+    }
+
+    // Lane indices kept by each mask of 8 (AVX2) or 4 (SSE4.1) lanes.
+    struct compress_table {
+        std::uint8_t index8[256][8];
+        std::uint8_t count8[256];
+        std::uint8_t shuffle4[16][16];
+        std::uint8_t count4[16];
+
+        compress_table() {
+            for (unsigned mask = 0; mask != 256; ++mask) {
+                unsigned c = 0;
+                for (unsigned t = 0; t != 8; ++t)
+                    if (mask >> t & 1)
+                        index8[mask][c++] = t;
+                count8[mask] = c;
+                while (c != 8)
+                    index8[mask][c++] = 0;
+            }
+            for (unsigned mask = 0; mask != 16; ++mask) {
+                unsigned c = 0;
+                for (unsigned t = 0; t != 4; ++t)
+                    if (mask >> t & 1) {
+                        for (unsigned b = 0; b != 4; ++b)
+                            shuffle4[mask][4 * c + b] = 4 * t + b;
+                        ++c;
+                    }
+                count4[mask] = c;
+                for (unsigned b = 4 * c; b != 16; ++b)
+                    shuffle4[mask][b] = 0x80;
+            }
+        }
+    };
+
+    const compress_table compress_lut;
+
+    // AVX2 kernels.
+
+    // Sorts a bitonic vector.
+    __attribute__((target("avx2")))
+    inline __m256i bitonic_sort_avx2(__m256i v) {
+        __m256i p = _mm256_permute2x128_si256(v, v, 1);
+        v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xf0);
+        p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xcc);
+        p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+        return _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xaa);
+    }
+
+    // Merges sorted a and b into the lower half a and the upper half b.
+    __attribute__((target("avx2")))
+    inline void bitonic_merge_avx2(__m256i &a, __m256i &b) {
+        b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+        __m256i lo = _mm256_min_epi32(a, b), hi = _mm256_max_epi32(a, b);
+        a = bitonic_sort_avx2(lo);
+        b = bitonic_sort_avx2(hi);
+    }
+
+    // Merges sorted [pa, ea) and [pb, eb), both of whole vectors, into dst.
+    __attribute__((target("avx2")))
+    void merge_keys_avx2(const dimension_type *pa, const dimension_type *ea,
+        const dimension_type *pb, const dimension_type *eb, dimension_type *dst) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pa));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pb));
+        pa += 8;
+        pb += 8;
+        for (;;) {
+            bitonic_merge_avx2(a, b);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), a);
+            dst += 8;
+            const dimension_type *&next = pa != ea && (pb == eb || *pa <= *pb) ? pa : pb;
+            if (next == eb)
+                break;
+            a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(next));
+            next += 8;
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), b);
+    }
+
+    template<bool Horizontal, bool Sources>
+    __attribute__((target("avx2")))
+    size_t merge_avx2(const dimension_type *lk, const dimension_type *lv,
+        size_t ln, const dimension_type *rk, const dimension_type *rv,
+        size_t rn, dimension_type *ok, dimension_type *ov,
+        source_type *ls, source_type *rs) {
+        const size_t total = ln + rn;
+        auto &scratch = merge_scratch;
+        scratch.resize(2 * total + 48);
+        dimension_type *a = scratch.data(), *b = copy_keys<Horizontal>(lk, ln, 0, 8, a);
+        dimension_type *merged = copy_keys<Horizontal>(rk, rn, 1, 8, b) + 1;
+        merged[-1] = key_min;
+        const size_t padded = (b - a) + (merged - 1 - b);
+        std::fill(merged + padded, merged + padded + 8, key_max);
+        merge_keys_avx2(a, b, b, merged - 1, merged);
+
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i lmax = _mm256_set1_epi32(static_cast<int>(ln - 1));
+        const __m256i rmax = _mm256_set1_epi32(static_cast<int>(rn - 1));
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i idx = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 8);  // t + 1
+        __m256i base = zero;    // Keys of lc before the block
+        size_t t = 0, n = 0;
+        for (; t + 8 <= total; t += 8) {
+            __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(merged + t));
+            __m256i adj = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(
+                (Horizontal ? merged - 1 : merged + 1) + t));
+            __m256i rtag = _mm256_and_si256(m, one), ltag = _mm256_xor_si256(rtag, one);
+            __m256i nl = _mm256_add_epi32(ltag, _mm256_slli_si256(ltag, 4));
+            nl = _mm256_add_epi32(nl, _mm256_slli_si256(nl, 8));
+            nl = _mm256_add_epi32(nl, _mm256_permute2x128_si256(
+                _mm256_shuffle_epi32(nl, _MM_SHUFFLE(3, 3, 3, 3)), nl, 0x08));
+            nl = _mm256_add_epi32(nl, base);
+            base = _mm256_permutevar8x32_epi32(nl, _mm256_set1_epi32(7));
+            __m256i nr = _mm256_sub_epi32(idx, nl);
+            idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8));
+
+            __m256i li, ri, valid;
+            if (Horizontal) {
+                li = _mm256_sub_epi32(nl, ltag);
+                ri = _mm256_sub_epi32(nr, rtag);
+                valid = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(lmax, one), li),
+                    _mm256_cmpgt_epi32(_mm256_add_epi32(rmax, one), ri));
+            } else {
+                li = _mm256_sub_epi32(nl, one);
+                ri = _mm256_sub_epi32(nr, one);
+                valid = _mm256_and_si256(_mm256_cmpgt_epi32(nl, zero),
+                    _mm256_cmpgt_epi32(nr, zero));
+            }
+            __m256i key = _mm256_srai_epi32(m, 1);
+            valid = _mm256_andnot_si256(
+                _mm256_cmpeq_epi32(key, _mm256_srai_epi32(adj, 1)), valid);
+            li = _mm256_min_epi32(_mm256_max_epi32(li, zero), lmax);
+            ri = _mm256_min_epi32(_mm256_max_epi32(ri, zero), rmax);
+            __m256i val = _mm256_add_epi32(
+                _mm256_i32gather_epi32(reinterpret_cast<const int *>(lv), li, 4),
+                _mm256_i32gather_epi32(reinterpret_cast<const int *>(rv), ri, 4));
+            if (Horizontal)
+                key = _mm256_sub_epi32(zero, key);
+
+            unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(valid));
+            __m256i perm = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+                reinterpret_cast<const __m128i *>(compress_lut.index8[mask])));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(ok + n),
+                _mm256_permutevar8x32_epi32(key, perm));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(ov + n),
+                _mm256_permutevar8x32_epi32(val, perm));
+            if (Sources) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(ls + n),
+                    _mm256_permutevar8x32_epi32(li, perm));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(rs + n),
+                    _mm256_permutevar8x32_epi32(ri, perm));
+            }
+            n += compress_lut.count8[mask];
+        }
+        for (size_t nl = _mm256_extract_epi32(base, 0); t != total; ++t) {
+            nl += 1 - (merged[t] & 1);
+            n = emit_point<Horizontal, Sources>(merged, t, nl,
+                lv, ln, rv, rn, ok, ov, ls, rs, n);
+        }
+        return n;
+    }
+
+    template<bool Sources>
+    __attribute__((target("avx2")))
+    size_t merge_vertical_avx2(const dimension_type *lw,
+        const dimension_type *lh, size_t ln, const dimension_type *rw,
+        const dimension_type *rh, size_t rn, dimension_type *ow,
+        dimension_type *oh, source_type *ls, source_type *rs) {
+        return ln + rn < min_simd_points ?
+            merge_vertical_portable<Sources>(lw, lh, ln, rw, rh, rn, ow, oh, ls, rs) :
+            merge_avx2<false, Sources>(lw, lh, ln, rw, rh, rn, ow, oh, ls, rs);
+    }
+
+    template<bool Sources>
+    __attribute__((target("avx2")))
+    size_t merge_horizontal_avx2(const dimension_type *lw,
+        const dimension_type *lh, size_t ln, const dimension_type *rw,
+        const dimension_type *rh, size_t rn, dimension_type *ow,
+        dimension_type *oh, source_type *ls, source_type *rs) {
+        return ln + rn < min_simd_points ?
+            merge_horizontal_portable<Sources>(lw, lh, ln, rw, rh, rn, ow, oh, ls, rs) :
+            merge_avx2<true, Sources>(lh, lw, ln, rh, rw, rn, oh, ow, ls, rs);
+    }
+
+    // SSE4.1 kernels, the same on 4 lanes with scalar loads for gathers.
+
+    __attribute__((target("sse4.1")))
+    inline __m128i bitonic_sort_sse41(__m128i v) {
+        __m128i p = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm_blend_epi16(_mm_min_epi32(v, p), _mm_max_epi32(v, p), 0xf0);
+        p = _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+        return _mm_blend_epi16(_mm_min_epi32(v, p), _mm_max_epi32(v, p), 0xcc);
+    }
+
+    __attribute__((target("sse4.1")))
+    inline void bitonic_merge_sse41(__m128i &a, __m128i &b) {
+        b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3));
+        __m128i lo = _mm_min_epi32(a, b), hi = _mm_max_epi32(a, b);
+        a = bitonic_sort_sse41(lo);
+        b = bitonic_sort_sse41(hi);
+    }
+
+    __attribute__((target("sse4.1")))
+    void merge_keys_sse41(const dimension_type *pa, const dimension_type *ea,
+        const dimension_type *pb, const dimension_type *eb, dimension_type *dst) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pa));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pb));
+        pa += 4;
+        pb += 4;
+        for (;;) {
+            bitonic_merge_sse41(a, b);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), a);
+            dst += 4;
+            const dimension_type *&next = pa != ea && (pb == eb || *pa <= *pb) ? pa : pb;
+            if (next == eb)
+                break;
+            a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(next));
+            next += 4;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), b);
+    }
+
+    template<bool Horizontal, bool Sources>
+    __attribute__((target("sse4.1")))
+    size_t merge_sse41(const dimension_type *lk, const dimension_type *lv,
+        size_t ln, const dimension_type *rk, const dimension_type *rv,
+        size_t rn, dimension_type *ok, dimension_type *ov,
+        source_type *ls, source_type *rs) {
+        const size_t total = ln + rn;
+        auto &scratch = merge_scratch;
+        scratch.resize(2 * total + 24);
+        dimension_type *a = scratch.data(), *b = copy_keys<Horizontal>(lk, ln, 0, 4, a);
+        dimension_type *merged = copy_keys<Horizontal>(rk, rn, 1, 4, b) + 1;
+        merged[-1] = key_min;
+        const size_t padded = (b - a) + (merged - 1 - b);
+        std::fill(merged + padded, merged + padded + 4, key_max);
+        merge_keys_sse41(a, b, b, merged - 1, merged);
+
+        alignas(16) dimension_type lidx[4], ridx[4];
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128i lmax = _mm_set1_epi32(static_cast<int>(ln - 1));
+        const __m128i rmax = _mm_set1_epi32(static_cast<int>(rn - 1));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i idx = _mm_setr_epi32(1, 2, 3, 4);   // t + 1
+        __m128i base = zero;    // Keys of lc before the block
+        size_t t = 0, n = 0;
+        for (; t + 4 <= total; t += 4) {
+            __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i *>(merged + t));
+            __m128i adj = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                (Horizontal ? merged - 1 : merged + 1) + t));
+            __m128i rtag = _mm_and_si128(m, one), ltag = _mm_xor_si128(rtag, one);
+            __m128i nl = _mm_add_epi32(ltag, _mm_slli_si128(ltag, 4));
+            nl = _mm_add_epi32(nl, _mm_slli_si128(nl, 8));
+            nl = _mm_add_epi32(nl, base);
+            base = _mm_shuffle_epi32(nl, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i nr = _mm_sub_epi32(idx, nl);
+            idx = _mm_add_epi32(idx, _mm_set1_epi32(4));
+
+            __m128i li, ri, valid;
+            if (Horizontal) {
+                li = _mm_sub_epi32(nl, ltag);
+                ri = _mm_sub_epi32(nr, rtag);
+                valid = _mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(lmax, one), li),
+                    _mm_cmpgt_epi32(_mm_add_epi32(rmax, one), ri));
+            } else {
+                li = _mm_sub_epi32(nl, one);
+                ri = _mm_sub_epi32(nr, one);
+                valid = _mm_and_si128(_mm_cmpgt_epi32(nl, zero), _mm_cmpgt_epi32(nr, zero));
+            }
+            __m128i key = _mm_srai_epi32(m, 1);
+            valid = _mm_andnot_si128(_mm_cmpeq_epi32(key, _mm_srai_epi32(adj, 1)), valid);
+            _mm_store_si128(reinterpret_cast<__m128i *>(lidx),
+                _mm_min_epi32(_mm_max_epi32(li, zero), lmax));
+            _mm_store_si128(reinterpret_cast<__m128i *>(ridx),
+                _mm_min_epi32(_mm_max_epi32(ri, zero), rmax));
+            __m128i val = _mm_setr_epi32(lv[lidx[0]] + rv[ridx[0]],
+                lv[lidx[1]] + rv[ridx[1]], lv[lidx[2]] + rv[ridx[2]],
+                lv[lidx[3]] + rv[ridx[3]]);
+            if (Horizontal)
+                key = _mm_sub_epi32(zero, key);
+
+            unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(valid));
+            __m128i shuffle = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(compress_lut.shuffle4[mask]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(ok + n),
+                _mm_shuffle_epi8(key, shuffle));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(ov + n),
+                _mm_shuffle_epi8(val, shuffle));
+            if (Sources) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(ls + n), _mm_shuffle_epi8(
+                    _mm_load_si128(reinterpret_cast<const __m128i *>(lidx)), shuffle));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(rs + n), _mm_shuffle_epi8(
+                    _mm_load_si128(reinterpret_cast<const __m128i *>(ridx)), shuffle));
+            }
+            n += compress_lut.count4[mask];
+        }
+        for (size_t nl = _mm_cvtsi128_si32(base); t != total; ++t) {
+            nl += 1 - (merged[t] & 1);
+            n = emit_point<Horizontal, Sources>(merged, t, nl,
+                lv, ln, rv, rn, ok, ov, ls, rs, n);
+        }
+        return n;
+    }
+
+    template<bool Sources>
+    __attribute__((target("sse4.1")))
+    size_t merge_vertical_sse41(const dimension_type *lw,
+        const dimension_type *lh, size_t ln, const dimension_type *rw,
+        const dimension_type *rh, size_t rn, dimension_type *ow,
+        dimension_type *oh, source_type *ls, source_type *rs) {
+        return ln + rn < min_simd_points ?
+            merge_vertical_portable<Sources>(lw, lh, ln, rw, rh, rn, ow, oh, ls, rs) :
+            merge_sse41<false, Sources>(lw, lh, ln, rw, rh, rn, ow, oh, ls, rs);
+    }
+
+    template<bool Sources>
+    __attribute__((target("sse4.1")))
+    size_t merge_horizontal_sse41(const dimension_type *lw,
+        const dimension_type *lh, size_t ln, const dimension_type *rw,
+        const dimension_type *rh, size_t rn, dimension_type *ow,
+        dimension_type *oh, source_type *ls, source_type *rs) {
+        return ln + rn < min_simd_points ?
+            merge_horizontal_portable<Sources>(lw, lh, ln, rw, rh, rn, ow, oh, ls, rs) :
+            merge_sse41<true, Sources>(lh, lw, ln, rh, rw, rn, oh, ow, ls, rs);
+    }
+
+#endif  // POLISH_CURVE_KERNELS_X86
+
+    // Kernels of curve_merge_function, without sources.
+    template<size_t (*Merge)(const dimension_type *, const dimension_type *,
+        size_t, const dimension_type *, const dimension_type *, size_t,
+        dimension_type *, dimension_type *, source_type *, source_type *)>
+    size_t without_sources(const dimension_type *lw, const dimension_type *lh,
+        size_t ln, const dimension_type *rw, const dimension_type *rh,
+        size_t rn, dimension_type *ow, dimension_type *oh) {
+        return Merge(lw, lh, ln, rw, rh, rn, ow, oh, nullptr, nullptr);
+    }
+
+    const curve_kernels kernel_table[] = {
+        { curve_isa::PORTABLE,
+            without_sources<merge_vertical_portable<false>>,
+            without_sources<merge_horizontal_portable<false>>,
+            merge_vertical_portable<true>, merge_horizontal_portable<true> },
+#if POLISH_CURVE_KERNELS_X86
+        { curve_isa::SSE41,
+            without_sources<merge_vertical_sse41<false>>,
+            without_sources<merge_horizontal_sse41<false>>,
+            merge_vertical_sse41<true>, merge_horizontal_sse41<true> },
+        { curve_isa::AVX2,
+            without_sources<merge_vertical_avx2<false>>,
+            without_sources<merge_horizontal_avx2<false>>,
+            merge_vertical_avx2<true>, merge_horizontal_avx2<true> },
+#endif
+    };
+
+}
+
+const char *polish::to_string(curve_isa isa) noexcept {
+    switch (isa) {
+    case curve_isa::PORTABLE:
+        return "portable";
+    case curve_isa::SSE41:
+        return "sse4.1";
+    case curve_isa::AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+bool polish::is_curve_isa_supported(curve_isa isa) noexcept {
+#if POLISH_CURVE_KERNELS_X86
+    __builtin_cpu_init();
+    switch (isa) {
+    case curve_isa::PORTABLE:
+        return true;
+    case curve_isa::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case curve_isa::AVX2:
+        return __builtin_cpu_supports("avx2");
+    }
+    return false;
+#else
+    return isa == curve_isa::PORTABLE;
+#endif
+}
+
+const curve_kernels &polish::get_curve_kernels(curve_isa isa) noexcept {
+    assert(is_curve_isa_supported(isa));
+    return is_curve_isa_supported(isa) ?
+        kernel_table[static_cast<size_t>(isa)] : kernel_table[0];
+}
+
+const curve_kernels &polish::get_curve_kernels() noexcept {
+    static const curve_kernels &kernels = [] () -> const curve_kernels & {
+        for (auto isa : { curve_isa::AVX2, curve_isa::SSE41 })
+            if (is_curve_isa_supported(isa))
+                return get_curve_kernels(isa);
+        return get_curve_kernels(curve_isa::PORTABLE);
+    }();
+    return kernels;
+}
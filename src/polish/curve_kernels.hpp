@@ -0,0 +1,62 @@
+//  curve_kernels.hpp
+
+#ifndef curve_kernels_hpp
+#define curve_kernels_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POLISH_CURVE_KERNELS_X86 1
+#else
+#define POLISH_CURVE_KERNELS_X86 0
+#endif
+
+namespace polish {
+
+    // Instruction sets of curve merge kernels.
+    enum class curve_isa {
+        PORTABLE, SSE41, AVX2
+    };
+
+    // Merges the curves of two children into the curve of their parent.
+    // Curves are structures of arrays: widths ascending and heights
+    // descending (see basic_vectorized_polish_node). Both inputs are
+    // non-empty, with dimensions in (INT32_MIN / 2, INT32_MAX / 2), and the
+    // output arrays have room for ln + rn points.
+    // @return number of points written
+    using curve_merge_function = std::size_t (*)(
+        const std::int32_t *lw, const std::int32_t *lh, std::size_t ln,
+        const std::int32_t *rw, const std::int32_t *rh, std::size_t rn,
+        std::int32_t *ow, std::int32_t *oh);
+
+    // As curve_merge_function, also writing the sources of each output
+    // point: indices of the points of lc (ls) and rc (rs) it is made of.
+    // The source arrays have room for ln + rn indices too.
+    using curve_merge_sources_function = std::size_t (*)(
+        const std::int32_t *lw, const std::int32_t *lh, std::size_t ln,
+        const std::int32_t *rw, const std::int32_t *rh, std::size_t rn,
+        std::int32_t *ow, std::int32_t *oh, std::uint32_t *ls, std::uint32_t *rs);
+
+    struct curve_kernels {
+        curve_isa isa;
+        curve_merge_function merge_vertical;
+        curve_merge_function merge_horizontal;
+        curve_merge_sources_function merge_vertical_sources;
+        curve_merge_sources_function merge_horizontal_sources;
+    };
+
+    const char *to_string(curve_isa isa) noexcept;
+
+    // Checks whether the CPU runs kernels of isa.
+    bool is_curve_isa_supported(curve_isa isa) noexcept;
+
+    // Kernels of isa, which must be supported.
+    const curve_kernels &get_curve_kernels(curve_isa isa) noexcept;
+
+    // Kernels of the best supported isa, detected at the first call.
+    const curve_kernels &get_curve_kernels() noexcept;
+
+}   // polish
+
+#endif /* curve_kernels_hpp */
@@ -0,0 +1,1189 @@
+// flat_polish_tree.hpp: slicing trees stored in one contiguous node array.
+// Author: LYL
+
+#ifndef flat_polish_tree_hpp
+#define flat_polish_tree_hpp
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "module.h"
+#include "polish_node.hpp"
+#include "polish_tree.hpp"
+#include "toolbox.h"
+
+namespace polish {
+
+    namespace detail {
+
+        // Nodes of a flat tree link each other by indices into the array.
+        using flat_index_type = std::uint32_t;
+        constexpr flat_index_type flat_nil =
+            std::numeric_limits<flat_index_type>::max();
+
+        // Actual node stored in flat tree.
+        // NOTE: the header is always at index 0, and its lc_ is the root.
+        template<typename BaseNode>
+        class flat_tree_node : public BaseNode {
+            using base = BaseNode;
+
+        public:
+            using base_type = base;
+
+            template<typename... Types>
+            explicit flat_tree_node(Types &&...args) :
+                base(std::forward<Types>(args)...) {}
+
+            bool is_leaf() const noexcept { return lc_ == flat_nil; }
+            bool is_header() const noexcept { return parent_ == flat_nil; }
+
+            flat_index_type lc_ = flat_nil;         // left child
+            flat_index_type rc_ = flat_nil;         // right child
+            flat_index_type parent_ = flat_nil;     // parent node
+            bool dirty_ = false;    // to be recounted (see begin_update)
+        };
+
+        // Post-order successor of t in nodes.
+        template<typename Node>
+        flat_index_type flat_next(const Node *nodes, flat_index_type t) noexcept {
+            flat_index_type p = nodes[t].parent_;
+            if (t == nodes[p].rc_ || nodes[p].is_header())
+                return p;   // possibly header
+            p = nodes[p].rc_;
+            while (nodes[p].lc_ != flat_nil)
+                p = nodes[p].lc_;
+            return p;
+        }
+
+        // Post-order predecessor of t in nodes.
+        template<typename Node>
+        flat_index_type flat_prev(const Node *nodes, flat_index_type t) noexcept {
+            if (nodes[t].rc_ != flat_nil)
+                return nodes[t].rc_;
+            if (nodes[t].lc_ != flat_nil)
+                return nodes[t].lc_;  // iff header
+            flat_index_type p = nodes[t].parent_;
+            while (t == nodes[p].lc_) {
+                t = p;
+                p = nodes[p].parent_;
+            }
+            return nodes[p].lc_;
+        }
+
+        // Per-tree storage of flat trees whose nodes keep all their values.
+        struct flat_empty_store {
+            flat_empty_store() = default;
+
+            template<typename Alloc>
+            explicit flat_empty_store(const Alloc &) noexcept {}
+
+            void swap(flat_empty_store &) noexcept {}
+            void clear() noexcept {}
+        };
+
+    }   // detail
+
+    // Post-order bidirectional iterator of flat trees.
+    // Iterators follow nodes (not positions) across swap_nodes, as those
+    // of slicing_tree do.
+    template<typename Node>
+    class flat_slicing_tree_const_iterator :
+        public std::iterator<std::bidirectional_iterator_tag,
+        typename Node::base_type, std::ptrdiff_t,
+        const typename Node::base_type *, const typename Node::base_type &> {
+
+        using base = std::iterator<std::bidirectional_iterator_tag,
+            typename Node::base_type, std::ptrdiff_t,
+            const typename Node::base_type *, const typename Node::base_type &>;
+        using self = flat_slicing_tree_const_iterator;
+
+    public:
+        template<typename BasicNode, typename Alloc>
+        friend class flat_slicing_tree;
+
+        using typename base::difference_type;
+        using typename base::iterator_category;
+        using typename base::pointer;
+        using typename base::reference;
+        using typename base::value_type;
+
+        flat_slicing_tree_const_iterator() = default;
+
+        reference operator*() const noexcept {
+            return nodes_[idx_];
+        }
+
+        pointer operator->() const noexcept {
+            return &nodes_[idx_];
+        }
+
+        self &operator++() noexcept {
+            idx_ = detail::flat_next(nodes_, idx_);
+            return *this;
+        }
+
+        self operator++(int) noexcept {
+            self ret = *this;
+            ++(*this);
+            return ret;
+        }
+
+        self &operator--() noexcept {
+            idx_ = detail::flat_prev(nodes_, idx_);
+            return *this;
+        }
+
+        self operator--(int) noexcept {
+            self ret = *this;
+            --(*this);
+            return ret;
+        }
+
+        bool operator==(const self &other) const noexcept {
+            return idx_ == other.idx_ && nodes_ == other.nodes_;
+        }
+
+        bool operator!=(const self &other) const noexcept {
+            return !(*this == other);
+        }
+
+    protected:
+        flat_slicing_tree_const_iterator(const Node *nodes,
+            const detail::flat_empty_store *, detail::flat_index_type idx) noexcept :
+            nodes_(nodes), idx_(idx) {}
+
+        const Node *nodes_ = nullptr;
+        detail::flat_index_type idx_ = detail::flat_nil;
+    };
+
+    // Post-order bidirectional iterator of flat trees of
+    // basic_arena_polish_node, reading nodes with their curves in Arena as
+    // arena_polish_node_view values. See flat_slicing_tree_const_iterator.
+    // NOTE: take (*it).points rather than it->points to keep a curve across
+    // statements, as the former extends the lifetime of the view.
+    template<typename Node, typename Arena>
+    class flat_arena_tree_const_iterator {
+        using self = flat_arena_tree_const_iterator;
+
+    public:
+        template<typename BasicNode, typename Alloc>
+        friend class flat_slicing_tree;
+
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = arena_polish_node_view;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+
+        class pointer {
+        public:
+            explicit pointer(const value_type &v) : v_(v) {}
+            const value_type *operator->() const noexcept { return &v_; }
+
+        private:
+            value_type v_;
+        };
+
+        flat_arena_tree_const_iterator() = default;
+
+        reference operator*() const noexcept {
+            const Node &n = nodes_[idx_];
+            return value_type(n, arena_->view(n.offset, n.size));
+        }
+
+        pointer operator->() const noexcept {
+            return pointer(**this);
+        }
+
+        self &operator++() noexcept {
+            idx_ = detail::flat_next(nodes_, idx_);
+            return *this;
+        }
+
+        self operator++(int) noexcept {
+            self ret = *this;
+            ++(*this);
+            return ret;
+        }
+
+        self &operator--() noexcept {
+            idx_ = detail::flat_prev(nodes_, idx_);
+            return *this;
+        }
+
+        self operator--(int) noexcept {
+            self ret = *this;
+            --(*this);
+            return ret;
+        }
+
+        bool operator==(const self &other) const noexcept {
+            return idx_ == other.idx_ && nodes_ == other.nodes_;
+        }
+
+        bool operator!=(const self &other) const noexcept {
+            return !(*this == other);
+        }
+
+    protected:
+        flat_arena_tree_const_iterator(const Node *nodes, const Arena *arena,
+            detail::flat_index_type idx) noexcept :
+            nodes_(nodes), arena_(arena), idx_(idx) {}
+
+        const Node *nodes_ = nullptr;
+        const Arena *arena_ = nullptr;
+        detail::flat_index_type idx_ = detail::flat_nil;
+    };
+
+    namespace detail {
+
+        // How flat trees make, merge and read nodes of BasicNode, with
+        // store_type<Alloc> kept by each tree besides its node array.
+        template<typename BasicNode>
+        struct flat_node_traits;
+
+        template<>
+        struct flat_node_traits<basic_polish_node> {
+            using value_type = basic_polish_node;
+            using coord_type = typename value_type::coord_type;
+            using combine_type = typename value_type::combine_type;
+            using dimension_type = typename value_type::dimension_type;
+
+            template<typename Alloc>
+            using store_type = flat_empty_store;
+
+            template<typename Node, typename Store>
+            using const_iterator = flat_slicing_tree_const_iterator<Node>;
+
+            template<typename Store, typename Alloc>
+            static value_type make_leaf(Store &, const yal::Module &m, const Alloc &) {
+                return value_type(combine_type::LEAF, m.yspan(), m.xspan());
+            }
+
+            template<typename Store, typename Alloc>
+            static value_type make_operator(Store &, combine_type type, const Alloc &) {
+                return value_type(type);
+            }
+
+            template<typename Store, typename Alloc>
+            static value_type make_copy(Store &, const value_type &src, const Alloc &) {
+                return src;
+            }
+
+            template<typename Node, typename Store>
+            static void count_area(Node *nodes, std::size_t, Store &,
+                flat_index_type t) noexcept {
+                nodes[t].count_area(nodes[nodes[t].lc_], nodes[nodes[t].rc_]);
+            }
+
+            template<typename Node, typename Store>
+            static bool check_area(const Node *nodes, const Store &,
+                flat_index_type t) noexcept {
+                return nodes[t].check_area(nodes[nodes[t].lc_], nodes[nodes[t].rc_]);
+            }
+        };
+
+        template<typename Al>
+        struct flat_node_traits<basic_vectorized_polish_node<Al>> {
+            using value_type = basic_vectorized_polish_node<Al>;
+            using coord_type = typename value_type::coord_type;
+            using combine_type = typename value_type::combine_type;
+            using dimension_type = typename value_type::dimension_type;
+
+            template<typename Alloc>
+            using store_type = flat_empty_store;
+
+            template<typename Node, typename Store>
+            using const_iterator = flat_slicing_tree_const_iterator<Node>;
+
+            template<typename Store, typename Alloc>
+            static value_type make_leaf(Store &, const yal::Module &m, const Alloc &alloc) {
+                value_type v(combine_type::LEAF, Al(alloc));
+                auto xspan = m.xspan(), yspan = m.yspan();
+                if (xspan > yspan)
+                    std::swap(xspan, yspan);
+                v.points.emplace_back(xspan, yspan);
+                if (xspan != yspan)
+                    v.points.emplace_back(yspan, xspan);
+                return v;
+            }
+
+            template<typename Store, typename Alloc>
+            static value_type make_operator(Store &, combine_type type, const Alloc &alloc) {
+                return value_type(type, Al(alloc));
+            }
+
+            template<typename Store, typename Alloc>
+            static value_type make_copy(Store &, const value_type &src, const Alloc &) {
+                return src;
+            }
+
+            template<typename Node, typename Store>
+            static void count_area(Node *nodes, std::size_t, Store &, flat_index_type t) {
+                nodes[t].count_area(nodes[nodes[t].lc_], nodes[nodes[t].rc_]);
+            }
+
+            template<typename Node, typename Store>
+            static bool check_area(const Node *nodes, const Store &, flat_index_type t) {
+                return nodes[t].check_area(nodes[nodes[t].lc_], nodes[nodes[t].rc_]);
+            }
+
+            template<typename Node, typename Store>
+            static void record_sources(Node *nodes, std::size_t num_nodes,
+                Store &, bool on) {
+                for (std::size_t t = 0; t != num_nodes; ++t)
+                    nodes[t].points.record_sources(on);
+            }
+
+            template<typename Store>
+            static const typename value_type::curve_type &curve(
+                const value_type &n, const Store &) noexcept {
+                return n.points;
+            }
+        };
+
+        // Curves live in a curve_arena of the tree. A merge is written over
+        // the old curve of the node if its slot holds both children, and
+        // otherwise into a new slot bumped at the top of the arena. So slots
+        // grow like the buffers of shape_curve, and repeated updates of a
+        // path rewrite the same points.
+        template<>
+        struct flat_node_traits<basic_arena_polish_node> {
+            using value_type = arena_polish_node_view;
+            using coord_type = typename value_type::coord_type;
+            using combine_type = typename value_type::combine_type;
+            using dimension_type = typename value_type::dimension_type;
+
+            template<typename Alloc>
+            using store_type = curve_arena<typename std::allocator_traits<Alloc>::
+                template rebind_alloc<dimension_type>>;
+
+            template<typename Node, typename Store>
+            using const_iterator = flat_arena_tree_const_iterator<Node, Store>;
+
+            template<typename Store, typename Alloc>
+            static basic_arena_polish_node make_leaf(Store &arena,
+                const yal::Module &m, const Alloc &) {
+                auto xspan = m.xspan(), yspan = m.yspan();
+                if (xspan > yspan)
+                    std::swap(xspan, yspan);
+                const dimension_type w[2] = { xspan, yspan }, h[2] = { yspan, xspan };
+                return make_node(arena, combine_type::LEAF, 0,
+                    shape_curve_view(w, h, xspan != yspan ? 2 : 1));
+            }
+
+            template<typename Store, typename Alloc>
+            static basic_arena_polish_node make_operator(Store &,
+                combine_type type, const Alloc &) {
+                return basic_arena_polish_node(type);
+            }
+
+            // src must not be in arena.
+            template<typename Store, typename Alloc>
+            static basic_arena_polish_node make_copy(Store &arena,
+                const value_type &src, const Alloc &) {
+                return make_node(arena, src.type, src.max_points, src.points);
+            }
+
+            template<typename Node, typename Store>
+            static void count_area(Node *nodes, std::size_t num_nodes,
+                Store &arena, flat_index_type t) {
+                Node &n = nodes[t];
+                const Node &lc = nodes[n.lc_], &rc = nodes[n.rc_];
+                assert(lc.size && rc.size);
+                std::uint32_t cap = lc.size + rc.size;
+                if (n.capacity < cap) {
+                    arena.deallocate(n.offset, n.capacity);
+                    n.size = n.capacity = 0;
+                    arena.reserve(nodes, nodes + num_nodes, cap);
+                    n.offset = static_cast<std::uint32_t>(arena.allocate(cap));
+                    n.capacity = cap;
+                }
+
+                const curve_kernels &kernels = get_curve_kernels();
+                dimension_type *w = arena.widths() + n.offset;
+                dimension_type *h = arena.heights() + n.offset;
+                std::uint32_t *ls = nullptr, *rs = nullptr;
+                std::size_t k;
+                if (arena.has_sources()) {
+                    ls = arena.left_sources() + n.offset;
+                    rs = arena.right_sources() + n.offset;
+                    auto merge = n.type == combine_type::VERTICAL ?
+                        kernels.merge_vertical_sources : kernels.merge_horizontal_sources;
+                    k = merge(arena.widths() + lc.offset,
+                        arena.heights() + lc.offset, lc.size,
+                        arena.widths() + rc.offset, arena.heights() + rc.offset,
+                        rc.size, w, h, ls, rs);
+                } else {
+                    auto merge = n.type == combine_type::VERTICAL ?
+                        kernels.merge_vertical : kernels.merge_horizontal;
+                    k = merge(arena.widths() + lc.offset,
+                        arena.heights() + lc.offset, lc.size,
+                        arena.widths() + rc.offset, arena.heights() + rc.offset,
+                        rc.size, w, h);
+                }
+                if (n.max_points && k > n.max_points)
+                    k = prune_curve(w, h, k, n.max_points, ls, rs);
+                n.size = static_cast<std::uint32_t>(k);
+            }
+
+            // Checks against basic_vectorized_polish_node::check_area.
+            template<typename Node, typename Store>
+            static bool check_area(const Node *nodes, const Store &arena,
+                flat_index_type t) {
+                using node_value = basic_vectorized_polish_node<>;
+                auto load = [&arena](const Node &n) {
+                    node_value v(n.type, typename node_value::allocator_type());
+                    v.max_points = n.max_points;
+                    v.points.record_sources(arena.has_sources());
+                    auto points = arena.view(n.offset, n.size);
+                    for (std::size_t k = 0; k != points.size(); ++k)
+                        v.points.emplace_back(points.widths()[k], points.heights()[k],
+                            points.has_sources() ? points.left_sources()[k] : 0,
+                            points.has_sources() ? points.right_sources()[k] : 0);
+                    return v;
+                };
+                const Node &n = nodes[t];
+                return n.size <= n.capacity && n.offset + n.capacity <= arena.size() &&
+                    load(n).check_area(load(nodes[n.lc_]), load(nodes[n.rc_]));
+            }
+
+            template<typename Node, typename Store>
+            static void record_sources(Node *, std::size_t, Store &arena, bool on) {
+                arena.record_sources(on);
+            }
+
+            template<typename Store>
+            static shape_curve_view curve(const basic_arena_polish_node &n,
+                const Store &arena) noexcept {
+                return arena.view(n.offset, n.size);
+            }
+
+        private:
+            template<typename Store>
+            static basic_arena_polish_node make_node(Store &arena,
+                combine_type type, std::uint32_t max_points,
+                shape_curve_view points) {
+                basic_arena_polish_node n(type);
+                n.max_points = max_points;
+                n.size = n.capacity = static_cast<std::uint32_t>(points.size());
+                n.offset = static_cast<std::uint32_t>(arena.allocate(n.size));
+                std::copy_n(points.widths(), n.size, arena.widths() + n.offset);
+                std::copy_n(points.heights(), n.size, arena.heights() + n.offset);
+                if (arena.has_sources() && points.has_sources()) {
+                    std::copy_n(points.left_sources(), n.size,
+                        arena.left_sources() + n.offset);
+                    std::copy_n(points.right_sources(), n.size,
+                        arena.right_sources() + n.offset);
+                }
+                return n;
+            }
+        };
+
+    }   // detail
+
+    // Slicing tree keeping all nodes in one array, linked by 32-bit indices.
+    // Copying is a copy of the array (a memcpy for polish_tree nodes), and
+    // clearing, shuffling and checking are linear scans of it. The interface
+    // follows slicing_tree, so SA<Tree> works on either. Values that nodes
+    // do not keep themselves (see detail::flat_node_traits) are in a store
+    // beside the array, copied with it.
+    // Alloc should be of type BasicNode.
+    template<typename BasicNode, typename Alloc = std::allocator<BasicNode>>
+    class flat_slicing_tree {
+        using self = flat_slicing_tree;
+
+    protected:
+        using traits = detail::flat_node_traits<BasicNode>;
+        using alloc_traits = std::allocator_traits<Alloc>;
+        using node_type = detail::flat_tree_node<BasicNode>;
+        using index_type = detail::flat_index_type;
+        using actual_allocator_type =
+            typename alloc_traits::template rebind_alloc<node_type>;
+        using store_type = typename traits::template store_type<Alloc>;
+        static constexpr index_type nil = detail::flat_nil;
+        static constexpr index_type header_index = 0;
+
+    public:
+        using combine_type = typename traits::combine_type;
+        using coord_type = typename traits::coord_type;
+        using dimension_type = typename traits::dimension_type;
+        using value_type = typename traits::value_type;
+
+        using allocator_type = Alloc;
+        using const_iterator =
+            typename traits::template const_iterator<node_type, store_type>;
+        using iterator = const_iterator;
+
+        using const_reference = const value_type &;
+        using reference = value_type &;
+        using size_type = typename alloc_traits::size_type;
+        using difference_type = typename alloc_traits::difference_type;
+        using const_pointer = typename alloc_traits::const_pointer;
+        using pointer = typename alloc_traits::pointer;
+
+        flat_slicing_tree() : flat_slicing_tree(allocator_type()) {}
+
+        explicit flat_slicing_tree(const allocator_type &alloc) :
+            nodes_(actual_allocator_type(alloc)), store_(alloc) {
+            nodes_.emplace_back(BasicNode::make_header());
+        }
+
+        // Construct tree with a list of modules and a polish expression.
+        // e.g., size(modules) == 3, expr == {0, 1, *, 1, +, 2, *}.
+        bool construct(const std::vector<yal::Module> &modules,
+            const std::vector<expression::polish_expression_type> &expr) {
+            return construct(modules.begin(), expr.begin(), expr.end());
+        }
+
+        // Construct tree with a list of modules and a polish expression.
+        template<typename RanIt, typename InIt>
+        std::enable_if_t<aureliano::IsIterator<RanIt>::value
+            && aureliano::IsIterator<InIt>::value, bool>
+            construct(RanIt first_module, InIt first_expr, InIt last_expr) {
+            node_vector nodes(nodes_.get_allocator());
+            store_type store(nodes_.get_allocator());
+            nodes.emplace_back(BasicNode::make_header());
+            std::vector<index_type> stack;
+            bool pass = true;
+
+            for (; first_expr != last_expr; ++first_expr) {
+                expression::polish_expression_type e = *first_expr;
+                if (e != expression::COMBINE_HORIZONTAL
+                    && e != expression::COMBINE_VERTICAL) {
+                    stack.push_back(new_leaf(nodes, store, first_module[e]));
+                } else {
+                    if (stack.size() < 2) {
+                        pass = false;
+                        break;
+                    }
+                    index_type t2 = stack.back();
+                    stack.pop_back();
+                    index_type t1 = stack.back();
+                    combine_type combine = e == expression::COMBINE_HORIZONTAL ?
+                        combine_type::HORIZONTAL : combine_type::VERTICAL;
+                    index_type t = new_operator(nodes, store, combine);
+                    attach_left(nodes, t, t1);
+                    attach_right(nodes, t, t2);
+                    count_area(nodes, store, t);
+                    stack.back() = t;
+                }
+            }
+
+            pass = pass && stack.size() == 1;
+            if (pass) {
+                attach_left(nodes, header_index, stack.back());
+                nodes_.swap(nodes);
+                store_.swap(store);
+            }
+            return pass;
+        }
+
+        // Construct a random tree.
+        // @param first_module: begin of a yal::Module range
+        // @param first_idx, last_idx: a range of yal::Module indices
+        // @param eng: a random engine (e.g., std::default_random_engine>
+        // @return true (always)
+        template<typename RanIt, typename InIt, typename Eng>
+        std::enable_if_t<aureliano::IsIterator<RanIt>::value
+            && aureliano::IsIterator<InIt>::value
+            && !aureliano::IsIterator<Eng>::value, bool>
+            construct(RanIt first_module, InIt first_idx, InIt last_idx, Eng &&eng) {
+            if (first_idx == last_idx) {
+                clear();
+                return true;
+            }
+
+            node_vector nodes(nodes_.get_allocator());
+            store_type store(nodes_.get_allocator());
+            nodes.emplace_back(BasicNode::make_header());
+            std::vector<index_type> trees, oprs;
+            for (auto i = first_idx; i != last_idx; ++i)
+                trees.push_back(new_leaf(nodes, store, first_module[*i]));
+            oprs.resize(trees.size() - 1);
+            for (auto &p : oprs)
+                p = new_operator(nodes, store, combine_type::HORIZONTAL);
+            index_type new_root = make_random_tree(nodes, store,
+                trees, oprs, std::forward<Eng>(eng));
+            attach_left(nodes, header_index, new_root);
+            nodes_.swap(nodes);
+            store_.swap(store);
+            return true;
+        }
+
+        // Shuffle the tree using specified random engine.
+        template<typename Eng>
+        void shuffle(Eng &&eng) {
+            if (empty())
+                return;
+            std::vector<index_type> trees, oprs;
+            for (index_type i = 1; i != nodes_.size(); ++i) {
+                nodes_[i].dirty_ = false;   // all recounted
+                (nodes_[i].is_leaf() ? trees : oprs).push_back(i);
+            }
+            index_type new_root = make_random_tree(nodes_, store_,
+                trees, oprs, std::forward<Eng>(eng));
+            attach_left(nodes_, header_index, new_root);
+        }
+
+        // Construct tree with the values of a post-order range of nodes.
+        template<typename InIt>
+        bool assign(InIt first_iter, InIt last_iter) {
+            node_vector nodes(nodes_.get_allocator());
+            store_type store(nodes_.get_allocator());
+            nodes.emplace_back(BasicNode::make_header());
+            std::vector<index_type> stack;
+            bool pass = true;
+
+            for (; first_iter != last_iter; ++first_iter) {
+                const value_type &src = **first_iter;
+                nodes.emplace_back(traits::make_copy(store, src, nodes.get_allocator()));
+                index_type dst = static_cast<index_type>(nodes.size() - 1);
+                if (src.type != combine_type::LEAF) {
+                    if (stack.size() < 2) {
+                        pass = false;
+                        break;
+                    }
+                    attach_right(nodes, dst, stack.back());
+                    stack.pop_back();
+                    attach_left(nodes, dst, stack.back());
+                    stack.back() = dst;
+                } else {
+                    stack.push_back(dst);
+                }
+            }
+
+            pass = pass && stack.size() == 1;
+            if (pass) {
+                attach_left(nodes, header_index, stack.back());
+                nodes_.swap(nodes);
+                store_.swap(store);
+            }
+            return pass;
+        }
+
+        void clear() {
+            nodes_.erase(std::next(nodes_.begin()), nodes_.end());
+            nodes_.front().lc_ = nil;
+            store_.clear();
+        }
+
+        bool empty() const noexcept {
+            return nodes_.front().lc_ == nil;
+        }
+
+        // STL-like begin.
+        const_iterator begin() const noexcept {
+            index_type t = header_index;
+            while (nodes_[t].lc_ != nil)
+                t = nodes_[t].lc_;
+            return make_iter(t);
+        }
+
+        // STL-like end.
+        const_iterator end() const noexcept {
+            return make_iter(header_index);
+        }
+
+        // Iterator pointing to the root, end() if empty.
+        const_iterator root() const noexcept {
+            return empty() ? end() : make_iter(nodes_.front().lc_);
+        }
+
+        // Conduct M1 / M3 change.
+        // NOTE: if we want to do leaf-operator swap,
+        // then pos1 == std::prev(pos2) (in O(1)).
+        // @require pos1 <= pos2; if M3, pos1 == std::prev(pos2)
+        // @return true iff operation valid
+        bool swap_nodes(const_iterator pos1, const_iterator pos2) {
+            if (pos1 == pos2 || pos1 == end() || pos2 == end())
+                return false;
+
+            bool ret = true;
+            index_type t1 = get_index(pos1), t2 = get_index(pos2);
+            switch ((is_leaf(t1) << 1) | is_leaf(t2)) {
+            case 0:
+                // Neither is leaf, error.
+                ret = false;
+                break;
+            case 1:
+                // t2 is leaf, conduct M3 change.
+                ret = swap_operator_leaf(t1, t2);
+                break;
+            case 2:
+                // t1 is leaf, try conducting M3 change.
+                ret = swap_leaf_operator(t1, t2);
+                break;
+            case 3:
+                // Both are leaves, conduct M1 change.
+                swap_leaves(t1, t2);
+                break;
+            default:
+                assert(false);
+            }
+            return ret;
+        }
+
+        // Conduct M2 change.
+        // @return false iff pos points to header() or the node is not an operator
+        //         (i.e., is a leaf)
+        bool invert_chain(const_iterator pos) {
+            index_type t = get_index(pos);
+            if (t == header_index || is_leaf(t))
+                return false;
+            for (index_type p = t; p != header_index; p = nodes_[p].parent_)
+                nodes_[p].invert_combine_type();
+            update_downtop(t);
+            return true;
+        }
+
+        // See slicing_tree::begin_update.
+        void begin_update() noexcept {
+            updating_ = true;
+        }
+
+        // See slicing_tree::end_update.
+        void end_update() {
+            updating_ = false;
+            flush_update();
+        }
+
+        // See slicing_tree::end_update_unless.
+        template<typename Pred>
+        bool end_update_unless(Pred &&pred) {
+            if (!flush_update(pred))
+                return false;
+            updating_ = false;
+            return true;
+        }
+
+        // Whether updates are deferred.
+        bool is_updating() const noexcept {
+            return updating_;
+        }
+
+        // For debug.
+        std::ostream &print_tree(std::ostream &os, int ident = 4,
+            char fill = ' ') const {
+            if (!empty())
+                print_tree_impl(os, nodes_.front().lc_, 0, ident, fill);
+            return os;
+        }
+
+        // For debug.
+        bool check_integrity() const {
+            if (empty())
+                return nodes_.size() == 1;
+            for (index_type i = 1; i != nodes_.size(); ++i) {
+                const node_type &t = nodes_[i];
+                if (t.is_header() || (t.lc_ == nil) != (t.rc_ == nil))
+                    return false;
+                if (!t.is_leaf() && (nodes_[t.lc_].parent_ != i
+                    || nodes_[t.rc_].parent_ != i
+                    || !traits::check_area(nodes_.data(), store_, i)))
+                    return false;
+            }
+            return static_cast<std::size_t>(std::distance(begin(), end()))
+                == nodes_.size() - 1;
+        }
+
+    protected:
+        using node_vector = std::vector<node_type, actual_allocator_type>;
+
+        const_iterator make_iter(index_type t) const noexcept {
+            return const_iterator(nodes_.data(), &store_, t);
+        }
+
+        static index_type get_index(const_iterator pos) noexcept {
+            return pos.idx_;
+        }
+
+        bool is_leaf(index_type t) const noexcept {
+            return nodes_[t].is_leaf();
+        }
+
+        static index_type new_leaf(node_vector &nodes, store_type &store,
+            const yal::Module &m) {
+            nodes.emplace_back(traits::make_leaf(store, m, nodes.get_allocator()));
+            return static_cast<index_type>(nodes.size() - 1);
+        }
+
+        static index_type new_operator(node_vector &nodes, store_type &store,
+            combine_type type) {
+            nodes.emplace_back(traits::make_operator(store, type,
+                nodes.get_allocator()));
+            return static_cast<index_type>(nodes.size() - 1);
+        }
+
+        static void attach_left(node_vector &nodes,
+            index_type father, index_type left) noexcept {
+            nodes[father].lc_ = left;
+            nodes[left].parent_ = father;
+        }
+
+        static void attach_right(node_vector &nodes,
+            index_type father, index_type right) noexcept {
+            nodes[father].rc_ = right;
+            nodes[right].parent_ = father;
+        }
+
+        static void count_area(node_vector &nodes, store_type &store,
+            index_type t) {
+            if (!nodes[t].is_leaf())
+                traits::count_area(nodes.data(), nodes.size(), store, t);
+        }
+
+        // Update down-top from non-leaf node t (or header), unless updates
+        // are deferred.
+        void update_downtop(index_type t) {
+            assert(!is_leaf(t));
+            mark_dirty(t);
+            if (!updating_)
+                flush_update();
+        }
+
+        // Update down-top from non-leaf nodes t1 and t2, unless updates are
+        // deferred. Common ancestors are updated once.
+        void update_downtop(index_type t1, index_type t2) {
+            assert(!is_leaf(t1) && !is_leaf(t2));
+            mark_dirty(t1);
+            mark_dirty(t2);
+            if (!updating_)
+                flush_update();
+        }
+
+        // See slicing_tree::mark_dirty.
+        void mark_dirty(index_type t) noexcept {
+            for (; t != header_index && !nodes_[t].dirty_; t = nodes_[t].parent_)
+                nodes_[t].dirty_ = true;
+        }
+
+        // See slicing_tree::flush_update.
+        void flush_update() {
+            flush_update([](const_iterator) { return false; });
+        }
+
+        // See slicing_tree::flush_update.
+        template<typename Pred>
+        bool flush_update(Pred &&pred) {
+            index_type t = nodes_.front().lc_;
+            if (t == nil || !nodes_[t].dirty_)
+                return true;
+            for (;;) {
+                node_type &n = nodes_[t];
+                if (nodes_[n.lc_].dirty_) {
+                    t = n.lc_;
+                } else if (nodes_[n.rc_].dirty_) {
+                    t = n.rc_;
+                } else {
+                    count_area(nodes_, store_, t);
+                    nodes_[t].dirty_ = false;
+                    if (pred(make_iter(t)))
+                        return nodes_[t].parent_ == header_index;
+                    if (nodes_[t].parent_ == header_index)
+                        return true;
+                    t = nodes_[t].parent_;
+                }
+            }
+        }
+
+        void swap_leaves(index_type t1, index_type t2) {
+            index_type p1 = nodes_[t1].parent_, p2 = nodes_[t2].parent_;
+            (t2 == nodes_[p2].lc_ ? nodes_[p2].lc_ : nodes_[p2].rc_) = t1;
+            (t1 == nodes_[p1].lc_ ? nodes_[p1].lc_ : nodes_[p1].rc_) = t2;
+            nodes_[t1].parent_ = p2;
+            nodes_[t2].parent_ = p1;
+            update_downtop(p1, p2);
+        }
+
+        // Conduct M3 change, given post-order index(t2) - index(t1) == 1.
+        // See slicing_tree::swap_operator_leaf.
+        // @param t1 operator
+        // @param t2 leaf
+        // @return true (always)
+        bool swap_operator_leaf(index_type t1, index_type t2) {
+            assert(!is_leaf(t1) && is_leaf(t2));
+            index_type p1 = nodes_[t1].parent_, p2 = nodes_[t2].parent_;
+            assert(t1 == nodes_[p1].lc_);
+            assert(t2 == nodes_[p2].lc_ || p1 == p2);
+            attach_left(nodes_, p1, nodes_[t1].lc_);
+            nodes_[t1].lc_ = nodes_[t1].rc_;
+            attach_right(nodes_, t1, t2);
+            if (p1 != p2)
+                attach_left(nodes_, p2, t1);    // case a
+            else
+                attach_right(nodes_, p2, t1);   // case b
+            update_downtop(t1); // one-way update should suffice
+            return true;
+        }
+
+        // Conduct M3 change, given post-order index(t2) - index(t1) == 1.
+        // See slicing_tree::swap_leaf_operator.
+        // @param t1 leaf
+        // @param t2 operator
+        // @return true iff operation valid
+        bool swap_leaf_operator(index_type t1, index_type t2) {
+            if (t1 != nodes_[t2].rc_)
+                return false;
+
+            index_type pre = t2, ca = nodes_[t2].parent_;
+            while (pre == nodes_[ca].lc_) {
+                pre = ca;
+                ca = nodes_[ca].parent_;
+                if (ca == nil)
+                    return false;
+            }
+            pre = nodes_[ca].lc_;
+            index_type p2 = nodes_[t2].parent_;
+            if (p2 != ca)
+                attach_left(nodes_, p2, t1);     // case a
+            else
+                attach_right(nodes_, p2, t1);    // case b
+            nodes_[t2].rc_ = nodes_[t2].lc_;
+            attach_left(nodes_, t2, pre);
+            attach_left(nodes_, ca, t2);
+            // NOTE: sometimes one-way update suffices
+            update_downtop(t2, nodes_[t1].parent_);
+            return true;
+        }
+
+        void print_tree_impl(std::ostream &os, index_type t, int offset,
+            int ident, char fill) const {
+            const node_type &n = nodes_[t];
+            if (n.rc_ != nil)
+                print_tree_impl(os, n.rc_, offset + ident, ident, fill);
+            for (int i = 0; i < offset; ++i)
+                os << fill;
+            os << *make_iter(t) << "\n";
+            if (n.lc_ != nil)
+                print_tree_impl(os, n.lc_, offset + ident, ident, fill);
+        }
+
+        template<typename Eng>
+        static index_type make_random_tree(node_vector &nodes, store_type &store,
+            std::vector<index_type> &trees, std::vector<index_type> &oprs,
+            Eng &&eng) {
+            using namespace std;
+            assert(oprs.size() + 1 == trees.size());
+            std::shuffle(trees.begin(), trees.end(), eng);
+            bernoulli_distribution rand_bool;
+            while (trees.size() > 1) {
+                uniform_int_distribution<size_t> rand(0, trees.size() - 2);
+                size_t idx = rand(eng);
+                swap(trees[idx], trees[trees.size() - 2]);
+                swap(trees[idx + 1], trees.back());
+                index_type opr = oprs.back();
+                oprs.pop_back();
+                attach_left(nodes, opr, trees[trees.size() - 2]);
+                attach_right(nodes, opr, trees.back());
+                const node_type &rc = nodes[trees.back()];
+                if (rc.type != combine_type::LEAF) {
+                    nodes[opr].type = meta_polish_node::invert_combine_type(rc.type);
+                } else {
+                    nodes[opr].type = rand_bool(eng) ?
+                        combine_type::HORIZONTAL : combine_type::VERTICAL;
+                }
+                count_area(nodes, store, opr);
+                trees.pop_back();
+                trees.back() = opr;
+            }
+            return trees.front();
+        }
+
+        node_vector nodes_;
+        store_type store_;
+        bool updating_ = false;     // see begin_update
+    };
+
+    // A flat_polish_tree is a flat tree of basic_polish_node,
+    // with the interface of polish_tree.
+    template<typename Alloc = std::allocator<basic_polish_node>>
+    class flat_polish_tree : public flat_slicing_tree<basic_polish_node, Alloc> {
+        using self = flat_polish_tree;
+        using base = flat_slicing_tree<basic_polish_node, Alloc>;
+
+    protected:
+        using typename base::node_type;
+        using typename base::index_type;
+        using base::header_index;
+
+    public:
+        using typename base::combine_type;
+        using typename base::coord_type;
+        using typename base::dimension_type;
+        using typename base::value_type;
+        using typename base::allocator_type;
+        using typename base::iterator;
+        using typename base::const_iterator;
+        using typename base::const_reference;
+        using typename base::reference;
+        using typename base::size_type;
+        using typename base::difference_type;
+        using typename base::const_pointer;
+        using typename base::pointer;
+
+        using floorplan_entry = coord_type;
+
+        using flat_slicing_tree<basic_polish_node, Alloc>::flat_slicing_tree;
+
+        // Rotate leaf and update down-top.
+        bool rotate_leaf(const_iterator pos) noexcept {
+            index_type t = this->get_index(pos);
+            if (t == header_index || !this->is_leaf(t))
+                return false;
+            this->nodes_[t].invert_combine_type();
+            this->update_downtop(this->nodes_[t].parent_);
+            return true;
+        }
+
+        // Settle lower-left positions of all modules.
+        // Each output is a (x, y) pair (floorplan_entry).
+        template<typename OutIt>
+        OutIt floorplan(OutIt dst, dimension_type xoff = 0,
+            dimension_type yoff = 0) const {
+            return this->empty() ? dst : floorplan_impl(
+                this->nodes_.front().lc_, xoff, yoff, dst);
+        }
+
+    protected:
+        template<typename OutIt>
+        OutIt floorplan_impl(index_type t, dimension_type xoff,
+            dimension_type yoff, OutIt dst) const {
+            const node_type &n = this->nodes_[t];
+            if (n.type == combine_type::VERTICAL) {
+                dst = floorplan_impl(n.lc_, xoff, yoff, dst);
+                dst = floorplan_impl(n.rc_, xoff,
+                    yoff + this->nodes_[n.lc_].height, dst);
+            } else if (n.type == combine_type::HORIZONTAL) {
+                dst = floorplan_impl(n.lc_, xoff, yoff, dst);
+                dst = floorplan_impl(n.rc_,
+                    xoff + this->nodes_[n.lc_].width, yoff, dst);
+            } else {
+                *dst++ = std::make_pair(xoff, yoff);
+            }
+            return dst;
+        }
+    };
+
+    // A flat_vectorized_polish_tree is a flat tree of
+    // basic_vectorized_polish_node<some allocator>,
+    // with the interface of vectorized_polish_tree.
+    // With basic_arena_polish_node instead (see arena_vectorized_polish_tree),
+    // all curves live in one curve_arena, and nodes read as
+    // arena_polish_node_view values.
+    template<typename Alloc = std::allocator<
+        basic_vectorized_polish_node<
+        std::allocator<meta_polish_node::coord_type>>>>
+    class flat_vectorized_polish_tree : public flat_slicing_tree<
+        typename std::allocator_traits<Alloc>::value_type, Alloc> {
+        using self = flat_vectorized_polish_tree;
+        using base = flat_slicing_tree<
+            typename std::allocator_traits<Alloc>::value_type, Alloc>;
+
+    protected:
+        using typename base::traits;
+        using typename base::node_type;
+        using typename base::index_type;
+
+    public:
+        using typename base::combine_type;
+        using typename base::coord_type;
+        using typename base::dimension_type;
+        using typename base::value_type;
+        using typename base::allocator_type;
+        using typename base::iterator;
+        using typename base::const_iterator;
+        using typename base::const_reference;
+        using typename base::reference;
+        using typename base::size_type;
+        using typename base::difference_type;
+        using typename base::const_pointer;
+        using typename base::pointer;
+
+        using floorplan_entry = std::tuple<dimension_type,
+            dimension_type, dimension_type, dimension_type>;
+
+        using flat_slicing_tree<
+            typename std::allocator_traits<Alloc>::value_type,
+            Alloc>::flat_slicing_tree;
+
+        // Limits the points of every curve to limit (0 for unlimited, and
+        // at least 3 otherwise), and recounts curves down-top. The limit
+        // applies to current nodes; construct() creates unlimited ones.
+        void set_curve_limit(std::size_t limit) {
+            auto max_points = static_cast<std::uint32_t>(
+                limit ? std::max<std::size_t>(limit, 3) : 0);
+            for (auto it = this->begin(); it != this->end(); ++it) {
+                index_type t = base::get_index(it);
+                this->nodes_[t].max_points = max_points;
+                base::count_area(this->nodes_, this->store_, t);
+            }
+        }
+
+        // See vectorized_polish_tree::set_record_sources.
+        void set_record_sources(bool on) {
+            traits::record_sources(this->nodes_.data(), this->nodes_.size(),
+                this->store_, on);
+            for (auto it = this->begin(); it != this->end(); ++it)
+                base::count_area(this->nodes_, this->store_, base::get_index(it));
+        }
+
+        // See vectorized_polish_tree::floorplan.
+        template<typename OutIt>
+        OutIt floorplan(std::size_t k, OutIt dst,
+            dimension_type xoff = 0, dimension_type yoff = 0) const {
+            if (this->empty())
+                return dst;
+            struct frame {
+                index_type t;
+                std::size_t k;
+                dimension_type x, y;
+            };
+            std::vector<frame> stack;
+            stack.push_back({ this->nodes_.front().lc_, k, xoff, yoff });
+            while (!stack.empty()) {
+                const frame f = stack.back();
+                stack.pop_back();
+                const node_type &n = this->nodes_[f.t];
+                auto &&pts = curve(f.t);
+                if (n.type == combine_type::LEAF) {
+                    const coord_type shape = pts[f.k];
+                    *dst++ = std::make_tuple(f.x, f.y, shape.first, shape.second);
+                    continue;
+                }
+
+                auto &&lpts = curve(n.lc_);
+                auto ks = detail::child_points(n.type, pts, f.k, lpts, curve(n.rc_));
+                const coord_type lshape = lpts[ks.first];
+                if (n.type == combine_type::VERTICAL)
+                    stack.push_back({ n.rc_, ks.second, f.x, f.y + lshape.second });
+                else
+                    stack.push_back({ n.rc_, ks.second, f.x + lshape.first, f.y });
+                stack.push_back({ n.lc_, ks.first, f.x, f.y });
+            }
+            return dst;
+        }
+
+    protected:
+        decltype(auto) curve(index_type t) const noexcept {
+            return traits::curve(this->nodes_[t], this->store_);
+        }
+    };
+
+    // A flat tree of soft modules keeping the curves of all nodes in one
+    // curve_arena, each node holding an offset and a length into it. Copying
+    // it copies two blocks (nodes and curves) rather than a curve per node,
+    // and merges along an updated path are bumped at the top of the arena,
+    // which is compacted when full.
+    template<typename Alloc = std::allocator<basic_arena_polish_node>>
+    using arena_vectorized_polish_tree = flat_vectorized_polish_tree<Alloc>;
+
+}   // polish
+
+#endif /* flat_polish_tree_hpp */
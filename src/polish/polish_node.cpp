@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 
 #include "polish_node.hpp"
@@ -34,6 +36,59 @@ std::ostream & polish::operator<<(std::ostream &os, const basic_polish_node &n)
     return os;
 }
 
+std::ostream & polish::operator<<(std::ostream &os, const arena_polish_node_view &n) {
+    if (n.type != meta_polish_node::combine_type::LEAF)
+        return os << static_cast<const meta_polish_node &>(n);
+    for (auto &&e : n.points)
+        os << "(" << e.first << "," << e.second << ") ";
+    return os;
+}
+
+std::size_t polish::detail::prune_curve(meta_polish_node::dimension_type *w,
+    meta_polish_node::dimension_type *h, std::size_t n,
+    std::uint32_t max_points, std::uint32_t *ls, std::uint32_t *rs) {
+    assert(max_points >= 3);
+    auto area = [w, h](std::size_t i) {
+        return static_cast<std::int64_t>(w[i]) * h[i];
+    };
+    auto ratio = [w, h](std::size_t i) {
+        return static_cast<double>(h[i]) / w[i];
+    };
+    std::size_t min_idx = 0;
+    for (std::size_t i = 1; i != n; ++i)
+        if (area(i) < area(min_idx))
+            min_idx = i;
+
+    // Targets from ratio(0) down to ratio(n - 1), geometrically;
+    // each takes the first point at or below it.
+    const std::size_t num_targets = max_points - 2;
+    const double q = num_targets > 1 ?
+        std::pow(ratio(n - 1) / ratio(0), 1.0 / (num_targets - 1)) : 0;
+    double target = ratio(0);
+    std::size_t taken = 0, k = 0;
+    for (std::size_t i = 0; i != n; ++i) {
+        bool keep = i == min_idx || i + 1 == n;
+        double r = ratio(i);
+        if (taken != num_targets && r <= target) {
+            keep = true;
+            while (taken != num_targets && r <= target) {
+                target *= q;
+                ++taken;
+            }
+        }
+        if (keep) {
+            w[k] = w[i];
+            h[k] = h[i];
+            if (ls) {
+                ls[k] = ls[i];
+                rs[k] = rs[i];
+            }
+            ++k;
+        }
+    }
+    return k;
+}
+
 const typename tree_node_base::self * tree_node_base::prev() const noexcept {
     if (rc_)
         return rc_;
@@ -6,9 +6,18 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <ostream>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "curve_kernels.hpp"
+
 namespace polish {
 
     // Common base for node value interfaces.
@@ -23,6 +32,9 @@ namespace polish {
         using coord_type = std::pair<dimension_type, dimension_type>;
 
         combine_type type;	//*(左右结合) or +(上下结合)
+        // Module of a leaf, numbered by slicing_tree::construct; 0 for
+        // operators.
+        std::uint32_t id = 0;
 
         explicit meta_polish_node(combine_type type_in) noexcept :
             type(type_in) {}
@@ -82,6 +94,318 @@ namespace polish {
 
     std::ostream & operator<<(std::ostream &os, const basic_polish_node &n);
 
+    namespace detail {
+
+        // Prunes a curve of n points to max_points (>= 3) points in place.
+        // Both ends and the minimum-area point are kept, and the others are
+        // sampled uniformly along log(height / width), so the curve keeps
+        // its range of aspect ratios. Sources ls and rs (see
+        // curve_merge_sources_function), if not null, are pruned alike.
+        // @return number of points kept
+        std::size_t prune_curve(meta_polish_node::dimension_type *w,
+            meta_polish_node::dimension_type *h, std::size_t n,
+            std::uint32_t max_points, std::uint32_t *ls = nullptr,
+            std::uint32_t *rs = nullptr);
+
+    }   // detail
+
+    // Curve function of a soft module, stored as a structure of arrays
+    // (widths ascending and heights descending), for the merge kernels.
+    // Points read as coord_type values. Optionally, it also stores the
+    // sources of each point (see curve_merge_sources_function).
+    // Alloc allocates coord_type.
+    template<typename Alloc = std::allocator<typename meta_polish_node::coord_type>>
+    class shape_curve {
+        using self = shape_curve;
+        using dimension_allocator = typename std::allocator_traits<Alloc>::
+            template rebind_alloc<meta_polish_node::dimension_type>;
+        using dimension_alloc_traits = std::allocator_traits<dimension_allocator>;
+        using source_allocator = typename std::allocator_traits<Alloc>::
+            template rebind_alloc<std::uint32_t>;
+        using source_alloc_traits = std::allocator_traits<source_allocator>;
+
+    public:
+        using allocator_type = Alloc;
+        using dimension_type = meta_polish_node::dimension_type;
+        using coord_type = meta_polish_node::coord_type;
+        using value_type = coord_type;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using source_type = std::uint32_t;
+
+        class const_iterator {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = coord_type;
+            using difference_type = std::ptrdiff_t;
+            using reference = coord_type;
+
+            class pointer {
+            public:
+                explicit pointer(const coord_type &v) : v_(v) {}
+                const coord_type *operator->() const noexcept { return &v_; }
+
+            private:
+                coord_type v_;
+            };
+
+            const_iterator() noexcept = default;
+            const_iterator(const dimension_type *w, const dimension_type *h,
+                difference_type k) noexcept : w_(w), h_(h), k_(k) {}
+
+            reference operator*() const { return coord_type(w_[k_], h_[k_]); }
+            pointer operator->() const { return pointer(**this); }
+            reference operator[](difference_type d) const { return *(*this + d); }
+
+            const_iterator &operator++() noexcept { ++k_; return *this; }
+            const_iterator &operator--() noexcept { --k_; return *this; }
+            const_iterator operator++(int) noexcept { auto t = *this; ++k_; return t; }
+            const_iterator operator--(int) noexcept { auto t = *this; --k_; return t; }
+            const_iterator &operator+=(difference_type d) noexcept { k_ += d; return *this; }
+            const_iterator &operator-=(difference_type d) noexcept { k_ -= d; return *this; }
+
+            friend const_iterator operator+(const_iterator i, difference_type d) noexcept {
+                return i += d;
+            }
+            friend const_iterator operator+(difference_type d, const_iterator i) noexcept {
+                return i += d;
+            }
+            friend const_iterator operator-(const_iterator i, difference_type d) noexcept {
+                return i -= d;
+            }
+            friend difference_type operator-(const const_iterator &a,
+                const const_iterator &b) noexcept {
+                return a.k_ - b.k_;
+            }
+            friend bool operator==(const const_iterator &a, const const_iterator &b) noexcept {
+                return a.k_ == b.k_;
+            }
+            friend bool operator!=(const const_iterator &a, const const_iterator &b) noexcept {
+                return a.k_ != b.k_;
+            }
+            friend bool operator<(const const_iterator &a, const const_iterator &b) noexcept {
+                return a.k_ < b.k_;
+            }
+            friend bool operator>(const const_iterator &a, const const_iterator &b) noexcept {
+                return a.k_ > b.k_;
+            }
+            friend bool operator<=(const const_iterator &a, const const_iterator &b) noexcept {
+                return a.k_ <= b.k_;
+            }
+            friend bool operator>=(const const_iterator &a, const const_iterator &b) noexcept {
+                return a.k_ >= b.k_;
+            }
+
+        private:
+            const dimension_type *w_ = nullptr, *h_ = nullptr;
+            difference_type k_ = 0;
+        };
+
+        using iterator = const_iterator;
+
+        shape_curve() = default;
+
+        explicit shape_curve(const allocator_type &alloc) :
+            widths_(dimension_allocator(alloc)), heights_(dimension_allocator(alloc)),
+            lsources_(source_allocator(alloc)), rsources_(source_allocator(alloc)) {}
+
+        shape_curve(std::initializer_list<coord_type> il,
+            const allocator_type &alloc = allocator_type()) : shape_curve(alloc) {
+            *this = il;
+        }
+
+        shape_curve(const self &other) :
+            widths_(other.widths_.begin(), other.widths_.begin() + other.size_,
+                dimension_alloc_traits::select_on_container_copy_construction(
+                    other.widths_.get_allocator())),
+            heights_(other.heights_.begin(), other.heights_.begin() + other.size_,
+                dimension_alloc_traits::select_on_container_copy_construction(
+                    other.heights_.get_allocator())),
+            lsources_(other.lsources_.begin(),
+                other.lsources_.begin() + other.source_size(),
+                source_alloc_traits::select_on_container_copy_construction(
+                    other.lsources_.get_allocator())),
+            rsources_(other.rsources_.begin(),
+                other.rsources_.begin() + other.source_size(),
+                source_alloc_traits::select_on_container_copy_construction(
+                    other.rsources_.get_allocator())),
+            size_(other.size_), sources_(other.sources_) {}
+
+        shape_curve(self &&other) noexcept : widths_(std::move(other.widths_)),
+            heights_(std::move(other.heights_)),
+            lsources_(std::move(other.lsources_)),
+            rsources_(std::move(other.rsources_)),
+            size_(other.size_), sources_(other.sources_) {
+            other.size_ = 0;
+            other.sources_ = false;
+        }
+
+        self &operator=(const self &other) {
+            if (this != &other) {
+                widths_.assign(other.widths_.begin(), other.widths_.begin() + other.size_);
+                heights_.assign(other.heights_.begin(), other.heights_.begin() + other.size_);
+                lsources_.assign(other.lsources_.begin(),
+                    other.lsources_.begin() + other.source_size());
+                rsources_.assign(other.rsources_.begin(),
+                    other.rsources_.begin() + other.source_size());
+                size_ = other.size_;
+                sources_ = other.sources_;
+            }
+            return *this;
+        }
+
+        self &operator=(self &&other) noexcept {
+            widths_ = std::move(other.widths_);
+            heights_ = std::move(other.heights_);
+            lsources_ = std::move(other.lsources_);
+            rsources_ = std::move(other.rsources_);
+            size_ = other.size_;
+            sources_ = other.sources_;
+            other.size_ = 0;
+            other.sources_ = false;
+            return *this;
+        }
+
+        self &operator=(std::initializer_list<coord_type> il) {
+            clear();
+            reserve(il.size());
+            for (const coord_type &e : il)
+                push_back(e);
+            return *this;
+        }
+
+        size_type size() const noexcept { return size_; }
+        bool empty() const noexcept { return !size_; }
+        void clear() noexcept { size_ = 0; }
+
+        void reserve(size_type n) {
+            if (n > widths_.size()) {
+                widths_.resize(n);
+                heights_.resize(n);
+            }
+            if (sources_ && n > lsources_.size()) {
+                lsources_.resize(n);
+                rsources_.resize(n);
+            }
+        }
+
+        // Resizes to n points, where new points are unspecified.
+        void resize(size_type n) {
+            reserve(n);
+            size_ = n;
+        }
+
+        coord_type operator[](size_type k) const {
+            return coord_type(widths_[k], heights_[k]);
+        }
+
+        coord_type front() const { return (*this)[0]; }
+        coord_type back() const { return (*this)[size() - 1]; }
+
+        // Sources l and r are ignored unless has_sources().
+        void emplace_back(dimension_type w, dimension_type h,
+            source_type l = 0, source_type r = 0) {
+            if (size_ == widths_.size()) {
+                widths_.push_back(w);
+                heights_.push_back(h);
+            } else {
+                widths_[size_] = w;
+                heights_[size_] = h;
+            }
+            if (sources_) {
+                reserve(size_ + 1);
+                lsources_[size_] = l;
+                rsources_[size_] = r;
+            }
+            ++size_;
+        }
+
+        void push_back(const coord_type &e) {
+            emplace_back(e.first, e.second);
+        }
+
+        const dimension_type *widths() const noexcept { return widths_.data(); }
+        dimension_type *widths() noexcept { return widths_.data(); }
+        const dimension_type *heights() const noexcept { return heights_.data(); }
+        dimension_type *heights() noexcept { return heights_.data(); }
+
+        // Starts or stops storing sources, which are unspecified until
+        // points are written again.
+        void record_sources(bool on) {
+            sources_ = on;
+            if (on) {
+                lsources_.resize(widths_.size());
+                rsources_.resize(widths_.size());
+            } else {
+                lsources_.clear();
+                rsources_.clear();
+            }
+        }
+
+        bool has_sources() const noexcept { return sources_; }
+
+        // Sources of points, or null unless has_sources().
+        const source_type *left_sources() const noexcept {
+            return sources_ ? lsources_.data() : nullptr;
+        }
+        source_type *left_sources() noexcept {
+            return sources_ ? lsources_.data() : nullptr;
+        }
+        const source_type *right_sources() const noexcept {
+            return sources_ ? rsources_.data() : nullptr;
+        }
+        source_type *right_sources() noexcept {
+            return sources_ ? rsources_.data() : nullptr;
+        }
+
+        const_iterator begin() const noexcept { return cbegin(); }
+        const_iterator end() const noexcept { return cend(); }
+        const_iterator cbegin() const noexcept {
+            return const_iterator(widths(), heights(), 0);
+        }
+        const_iterator cend() const noexcept {
+            return const_iterator(widths(), heights(), size());
+        }
+
+        // Swaps widths and heights of all points, and reverses them to keep
+        // the curve sorted. Sources are dropped.
+        void mirror() {
+            record_sources(false);
+            widths_.swap(heights_);
+            std::reverse(widths_.begin(), widths_.begin() + size_);
+            std::reverse(heights_.begin(), heights_.begin() + size_);
+        }
+
+        friend bool operator==(const self &a, const self &b) {
+            return a.size_ == b.size_ &&
+                std::equal(a.widths(), a.widths() + a.size_, b.widths()) &&
+                std::equal(a.heights(), a.heights() + a.size_, b.heights());
+        }
+
+        friend bool operator!=(const self &a, const self &b) {
+            return !(a == b);
+        }
+
+        template<typename Al>
+        friend bool operator==(const self &a, const std::vector<coord_type, Al> &b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+        }
+
+        template<typename Al>
+        friend bool operator!=(const self &a, const std::vector<coord_type, Al> &b) {
+            return !(a == b);
+        }
+
+    private:
+        size_type source_size() const noexcept { return sources_ ? size_ : 0; }
+
+        // Buffers of at least size_ points, with sources if sources_.
+        std::vector<dimension_type, dimension_allocator> widths_, heights_;
+        std::vector<source_type, source_allocator> lsources_, rsources_;
+        size_type size_ = 0;
+        bool sources_ = false;
+    };
+
     // Public interface for tree of soft modules.
     // Alloc allocates coord_type.
     // Its points field (i.e., curve function) is as follows:
@@ -97,10 +421,14 @@ namespace polish {
         using self = basic_vectorized_polish_node;
         using base = meta_polish_node;
 
+        static_assert(std::is_same<dimension_type, std::int32_t>::value,
+            "curve kernels work on 32-bit dimensions");
+
     public:
         using allocator_type = Alloc;
         using typename base::coord_type;
         using typename base::dimension_type;
+        using curve_type = shape_curve<Alloc>;
 
         basic_vectorized_polish_node(combine_type type,
             const allocator_type &alloc) :
@@ -110,7 +438,36 @@ namespace polish {
             return self();
         }
 
+        // Merges curves of lc and rc with kernels of the best instruction
+        // set, into points presized for all their points. Sources are
+        // recorded if points.has_sources().
         void count_area(const self &lc, const self &rc) {
+            assert(this->type != combine_type::LEAF);
+            assert(!lc.points.empty() && !rc.points.empty());
+            const curve_kernels &kernels = get_curve_kernels();
+            points.resize(lc.points.size() + rc.points.size());
+            std::size_t n;
+            if (points.has_sources()) {
+                auto merge = this->type == combine_type::VERTICAL ?
+                    kernels.merge_vertical_sources : kernels.merge_horizontal_sources;
+                n = merge(lc.points.widths(), lc.points.heights(),
+                    lc.points.size(), rc.points.widths(), rc.points.heights(),
+                    rc.points.size(), points.widths(), points.heights(),
+                    points.left_sources(), points.right_sources());
+            } else {
+                auto merge = this->type == combine_type::VERTICAL ?
+                    kernels.merge_vertical : kernels.merge_horizontal;
+                n = merge(lc.points.widths(), lc.points.heights(),
+                    lc.points.size(), rc.points.widths(), rc.points.heights(),
+                    rc.points.size(), points.widths(), points.heights());
+            }
+            points.resize(n);
+            if (max_points && points.size() > max_points)
+                prune_curve();
+        }
+
+        // Reference implementation of count_area.
+        void count_area_reference(const self &lc, const self &rc) {
             assert(this->type != combine_type::LEAF);
             assert(!lc.points.empty() && !rc.points.empty());
             points.clear();
@@ -119,56 +476,74 @@ namespace polish {
                 constexpr dimension_type inf
                     = std::numeric_limits<dimension_type>::max();
                 dimension_type yi = inf, yj = inf;
+                auto li = [&] { return source(i - lc.points.begin()); };
+                auto lj = [&] { return source(j - rc.points.begin()); };
                 while (i != lc.points.end() && j != rc.points.end()) {
                     if (i->first < j->first) {
                         if (yj != inf)
-                            points.emplace_back(i->first, i->second + yj);
+                            points.emplace_back(i->first, i->second + yj,
+                                li(), lj() - 1);
                         yi = i->second;
                         ++i;
                     } else if (i->first > j->first) {
                         if (yi != inf)
-                            points.emplace_back(j->first, j->second + yi);
+                            points.emplace_back(j->first, j->second + yi,
+                                li() - 1, lj());
                         yj = j->second;
                         ++j;
                     } else {
-                        points.emplace_back(i->first, i->second + j->second);
+                        points.emplace_back(i->first, i->second + j->second,
+                            li(), lj());
                         yi = i->second;
                         yj = j->second;
                         ++i; ++j;
                     }
                 }
                 while (i != lc.points.end()) {
-                    points.emplace_back(i->first, i->second + yj);
+                    points.emplace_back(i->first, i->second + yj,
+                        li(), lj() - 1);
                     ++i;
                 }
                 while (j != rc.points.end()) {
-                    points.emplace_back(j->first, j->second + yi);
+                    points.emplace_back(j->first, j->second + yi,
+                        li() - 1, lj());
                     ++j;
                 }
             } else {
                 auto i = lc.points.begin(), j = rc.points.begin();
                 while (i != lc.points.end() && j != rc.points.end()) {
+                    auto l = source(i - lc.points.begin());
+                    auto r = source(j - rc.points.begin());
                     if (i->second > j->second) {
-                        points.emplace_back(i->first + j->first, i->second);
+                        points.emplace_back(i->first + j->first, i->second, l, r);
                         ++i;
                     } else if (i->second < j->second) {
-                        points.emplace_back(i->first + j->first, j->second);
+                        points.emplace_back(i->first + j->first, j->second, l, r);
                         ++j;
                     } else {
-                        points.emplace_back(i->first + j->first, i->second);
+                        points.emplace_back(i->first + j->first, i->second, l, r);
                         ++i; ++j;
                     }
                 }
             }
+            if (max_points && points.size() > max_points)
+                prune_curve();
         }
 
         bool check_area(const self &lc, const self &rc) const {
             if (!check_curve())
                 return false;
             auto tmp = *this;
-            tmp.count_area(lc, rc);
+            tmp.count_area_reference(lc, rc);
             if (points != tmp.points)
                 return false;
+            if (points.has_sources() && !(std::equal(points.left_sources(),
+                points.left_sources() + points.size(), tmp.points.left_sources()) &&
+                std::equal(points.right_sources(), points.right_sources() +
+                points.size(), tmp.points.right_sources())))
+                return false;
+            if (max_points)
+                return true;    // Pruning is not symmetric under mirroring
             self lst[2] = { lc, rc };
             for (self &t : lst)
                 t.mirror_curve();
@@ -178,15 +553,26 @@ namespace polish {
             return points == tmp.points;
         }
 
-        std::vector<coord_type, allocator_type> points;
+        // Maximum number of points kept by count_area (0 for unlimited,
+        // otherwise at least 3).
+        std::uint32_t max_points = 0;
+        curve_type points;
 
     private:
         basic_vectorized_polish_node() : base(combine_type::LEAF) {}
 
+        void prune_curve() {
+            points.resize(detail::prune_curve(points.widths(), points.heights(),
+                points.size(), max_points, points.left_sources(),
+                points.right_sources()));
+        }
+
+        static typename curve_type::source_type source(std::ptrdiff_t k) noexcept {
+            return static_cast<typename curve_type::source_type>(k);
+        }
+
         void mirror_curve() {
-            for (coord_type &e : points)
-                std::swap(e.first, e.second);
-            std::reverse(points.begin(), points.end());
+            points.mirror();
         }
 
         bool check_curve() const noexcept {
@@ -210,6 +596,391 @@ namespace polish {
         return os;
     }
 
+    // Read-only view of a curve stored elsewhere (e.g., in a curve_arena),
+    // with the reading interface of shape_curve.
+    class shape_curve_view {
+        using self = shape_curve_view;
+
+    public:
+        using dimension_type = meta_polish_node::dimension_type;
+        using coord_type = meta_polish_node::coord_type;
+        using value_type = coord_type;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using source_type = std::uint32_t;
+        using const_iterator = typename shape_curve<>::const_iterator;
+        using iterator = const_iterator;
+
+        shape_curve_view() noexcept = default;
+
+        // Sources ls and rs are null if there are none.
+        shape_curve_view(const dimension_type *w, const dimension_type *h,
+            size_type n, const source_type *ls = nullptr,
+            const source_type *rs = nullptr) noexcept :
+            widths_(w), heights_(h), lsources_(ls), rsources_(rs), size_(n) {}
+
+        template<typename Alloc>
+        shape_curve_view(const shape_curve<Alloc> &c) noexcept :
+            shape_curve_view(c.widths(), c.heights(), c.size(),
+                c.left_sources(), c.right_sources()) {}
+
+        size_type size() const noexcept { return size_; }
+        bool empty() const noexcept { return !size_; }
+
+        coord_type operator[](size_type k) const {
+            return coord_type(widths_[k], heights_[k]);
+        }
+
+        coord_type front() const { return (*this)[0]; }
+        coord_type back() const { return (*this)[size() - 1]; }
+
+        const dimension_type *widths() const noexcept { return widths_; }
+        const dimension_type *heights() const noexcept { return heights_; }
+
+        bool has_sources() const noexcept { return lsources_; }
+        const source_type *left_sources() const noexcept { return lsources_; }
+        const source_type *right_sources() const noexcept { return rsources_; }
+
+        const_iterator begin() const noexcept { return cbegin(); }
+        const_iterator end() const noexcept { return cend(); }
+        const_iterator cbegin() const noexcept {
+            return const_iterator(widths_, heights_, 0);
+        }
+        const_iterator cend() const noexcept {
+            return const_iterator(widths_, heights_, size_);
+        }
+
+        // Also compares with shape_curve, through conversion.
+        friend bool operator==(const self &a, const self &b) {
+            return a.size_ == b.size_ &&
+                std::equal(a.widths_, a.widths_ + a.size_, b.widths_) &&
+                std::equal(a.heights_, a.heights_ + a.size_, b.heights_);
+        }
+
+        friend bool operator!=(const self &a, const self &b) {
+            return !(a == b);
+        }
+
+        template<typename Al>
+        friend bool operator==(const self &a, const std::vector<coord_type, Al> &b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+        }
+
+        template<typename Al>
+        friend bool operator!=(const self &a, const std::vector<coord_type, Al> &b) {
+            return !(a == b);
+        }
+
+    private:
+        const dimension_type *widths_ = nullptr, *heights_ = nullptr;
+        const source_type *lsources_ = nullptr, *rsources_ = nullptr;
+        size_type size_ = 0;
+    };
+
+    // Points of all curves of a tree, in one structure of arrays. Each node
+    // owns a slot of capacity points at offset, and its curve is the first
+    // size of them (see basic_arena_polish_node). New slots are bumped at the
+    // top, and replaced ones are left dead until the arena fills up and the
+    // live slots are compacted. Copying copies the used block only.
+    // Optionally, sources of points are kept alike (see shape_curve).
+    // Alloc allocates dimension_type.
+    template<typename Alloc = std::allocator<meta_polish_node::dimension_type>>
+    class curve_arena {
+        using self = curve_arena;
+        using buffer_type = std::vector<meta_polish_node::dimension_type, Alloc>;
+        using source_allocator = typename std::allocator_traits<Alloc>::
+            template rebind_alloc<std::uint32_t>;
+        using source_buffer_type = std::vector<std::uint32_t, source_allocator>;
+
+    public:
+        using allocator_type = Alloc;
+        using dimension_type = meta_polish_node::dimension_type;
+        using source_type = std::uint32_t;
+        using size_type = std::size_t;
+
+        curve_arena() = default;
+
+        explicit curve_arena(const allocator_type &alloc) :
+            widths_(alloc), heights_(alloc),
+            spare_widths_(alloc), spare_heights_(alloc),
+            lsources_(source_allocator(alloc)), rsources_(source_allocator(alloc)),
+            spare_lsources_(source_allocator(alloc)),
+            spare_rsources_(source_allocator(alloc)) {}
+
+        curve_arena(const self &other) :
+            widths_(other.widths_.begin(), other.widths_.begin() + other.top_,
+                std::allocator_traits<Alloc>::select_on_container_copy_construction(
+                    other.widths_.get_allocator())),
+            heights_(other.heights_.begin(), other.heights_.begin() + other.top_,
+                std::allocator_traits<Alloc>::select_on_container_copy_construction(
+                    other.heights_.get_allocator())),
+            spare_widths_(widths_.get_allocator()),
+            spare_heights_(heights_.get_allocator()),
+            lsources_(other.lsources_.begin(),
+                other.lsources_.begin() + other.source_size(),
+                source_allocator(widths_.get_allocator())),
+            rsources_(other.rsources_.begin(),
+                other.rsources_.begin() + other.source_size(),
+                source_allocator(widths_.get_allocator())),
+            spare_lsources_(source_allocator(widths_.get_allocator())),
+            spare_rsources_(source_allocator(widths_.get_allocator())),
+            top_(other.top_), live_(other.live_), sources_(other.sources_) {}
+
+        curve_arena(self &&other) noexcept :
+            widths_(std::move(other.widths_)), heights_(std::move(other.heights_)),
+            spare_widths_(std::move(other.spare_widths_)),
+            spare_heights_(std::move(other.spare_heights_)),
+            lsources_(std::move(other.lsources_)),
+            rsources_(std::move(other.rsources_)),
+            spare_lsources_(std::move(other.spare_lsources_)),
+            spare_rsources_(std::move(other.spare_rsources_)),
+            top_(other.top_), live_(other.live_), sources_(other.sources_) {
+            other.top_ = other.live_ = 0;
+            other.sources_ = false;
+        }
+
+        // Reuses the buffers if they are large enough.
+        self &operator=(const self &other) {
+            if (this == &other)
+                return *this;
+            if (capacity() >= other.top_) {
+                std::copy_n(other.widths(), other.top_, widths());
+                std::copy_n(other.heights(), other.top_, heights());
+            } else {
+                widths_.assign(other.widths_.begin(), other.widths_.begin() + other.top_);
+                heights_.assign(other.heights_.begin(), other.heights_.begin() + other.top_);
+            }
+            sources_ = other.sources_;
+            if (sources_) {
+                // Kept as large as the point buffers
+                lsources_.resize(capacity());
+                rsources_.resize(capacity());
+                std::copy_n(other.lsources_.data(), other.top_, lsources_.data());
+                std::copy_n(other.rsources_.data(), other.top_, rsources_.data());
+            }
+            top_ = other.top_;
+            live_ = other.live_;
+            return *this;
+        }
+
+        self &operator=(self &&other) noexcept {
+            swap(other);
+            other.clear();
+            return *this;
+        }
+
+        void swap(self &other) noexcept {
+            using std::swap;
+            widths_.swap(other.widths_);
+            heights_.swap(other.heights_);
+            spare_widths_.swap(other.spare_widths_);
+            spare_heights_.swap(other.spare_heights_);
+            lsources_.swap(other.lsources_);
+            rsources_.swap(other.rsources_);
+            spare_lsources_.swap(other.spare_lsources_);
+            spare_rsources_.swap(other.spare_rsources_);
+            swap(top_, other.top_);
+            swap(live_, other.live_);
+            swap(sources_, other.sources_);
+        }
+
+        // Points in slots, dead or alive.
+        size_type size() const noexcept { return top_; }
+        size_type capacity() const noexcept { return widths_.size(); }
+        size_type live() const noexcept { return live_; }
+        void clear() noexcept { top_ = live_ = 0; }
+
+        const dimension_type *widths() const noexcept { return widths_.data(); }
+        dimension_type *widths() noexcept { return widths_.data(); }
+        const dimension_type *heights() const noexcept { return heights_.data(); }
+        dimension_type *heights() noexcept { return heights_.data(); }
+
+        // Starts or stops storing sources, which are unspecified until
+        // points are written again.
+        void record_sources(bool on) {
+            sources_ = on;
+            lsources_.resize(on ? capacity() : 0);
+            rsources_.resize(on ? capacity() : 0);
+            spare_lsources_.clear();
+            spare_rsources_.clear();
+        }
+
+        bool has_sources() const noexcept { return sources_; }
+
+        // Sources of points, or null unless has_sources().
+        const source_type *left_sources() const noexcept {
+            return sources_ ? lsources_.data() : nullptr;
+        }
+        source_type *left_sources() noexcept {
+            return sources_ ? lsources_.data() : nullptr;
+        }
+        const source_type *right_sources() const noexcept {
+            return sources_ ? rsources_.data() : nullptr;
+        }
+        source_type *right_sources() noexcept {
+            return sources_ ? rsources_.data() : nullptr;
+        }
+
+        shape_curve_view view(size_type offset, size_type n) const noexcept {
+            return sources_ ? shape_curve_view(widths() + offset,
+                heights() + offset, n, left_sources() + offset,
+                right_sources() + offset) :
+                shape_curve_view(widths() + offset, heights() + offset, n);
+        }
+
+        // Takes a slot of n points at the top, growing the arena if needed.
+        // @return offset of the slot
+        size_type allocate(size_type n) {
+            if (top_ + n > capacity()) {
+                size_type cap = std::max(2 * capacity(), top_ + n);
+                widths_.resize(cap);
+                heights_.resize(cap);
+                if (sources_) {
+                    lsources_.resize(cap);
+                    rsources_.resize(cap);
+                }
+            }
+            size_type offset = top_;
+            top_ += n;
+            live_ += n;
+            return offset;
+        }
+
+        // Kills the slot of n points at offset. It is reused at once if on
+        // the top.
+        void deallocate(size_type offset, size_type n) noexcept {
+            assert(live_ >= n && offset + n <= top_);
+            live_ -= n;
+            if (offset + n == top_)
+                top_ = offset;
+        }
+
+        // Makes room for a slot of n points at the top. If the arena is full,
+        // live slots of [first, last) (nodes with fields offset, size and
+        // capacity) are compacted in order, into buffers at most half filled.
+        template<typename FwdIt>
+        void reserve(FwdIt first, FwdIt last, size_type n) {
+            if (top_ + n <= capacity())
+                return;
+            size_type cap = std::max(capacity(), 2 * (live_ + n));
+            if (spare_widths_.size() < cap) {
+                spare_widths_.resize(cap);
+                spare_heights_.resize(cap);
+            }
+            if (sources_ && spare_lsources_.size() < spare_widths_.size()) {
+                spare_lsources_.resize(spare_widths_.size());
+                spare_rsources_.resize(spare_widths_.size());
+            }
+            size_type top = 0;
+            for (; first != last; ++first) {
+                auto &node = *first;
+                std::copy_n(widths() + node.offset, node.size,
+                    spare_widths_.data() + top);
+                std::copy_n(heights() + node.offset, node.size,
+                    spare_heights_.data() + top);
+                if (sources_) {
+                    std::copy_n(lsources_.data() + node.offset, node.size,
+                        spare_lsources_.data() + top);
+                    std::copy_n(rsources_.data() + node.offset, node.size,
+                        spare_rsources_.data() + top);
+                }
+                node.offset = static_cast<decltype(node.offset)>(top);
+                top += node.capacity;
+            }
+            assert(top == live_);
+            widths_.swap(spare_widths_);
+            heights_.swap(spare_heights_);
+            if (sources_) {
+                lsources_.swap(spare_lsources_);
+                rsources_.swap(spare_rsources_);
+            }
+            top_ = top;
+        }
+
+    private:
+        size_type source_size() const noexcept { return sources_ ? top_ : 0; }
+
+        // Source buffers are as large as the point buffers if sources_.
+        buffer_type widths_, heights_;
+        buffer_type spare_widths_, spare_heights_;   // compaction target
+        source_buffer_type lsources_, rsources_;
+        source_buffer_type spare_lsources_, spare_rsources_;
+        size_type top_ = 0;
+        size_type live_ = 0;
+        bool sources_ = false;
+    };
+
+    // Node of soft modules whose curve is kept by its tree in a curve_arena,
+    // as points [offset, offset + size) of it, in a slot of capacity points.
+    // Trees of it read as trees of arena_polish_node_view.
+    class basic_arena_polish_node : public meta_polish_node {
+        using self = basic_arena_polish_node;
+        using base = meta_polish_node;
+
+    public:
+        explicit basic_arena_polish_node(combine_type type) noexcept :
+            base(type) {}
+
+        static self make_header() noexcept {
+            return self(combine_type::LEAF);
+        }
+
+        // See basic_vectorized_polish_node::max_points.
+        std::uint32_t max_points = 0;
+        std::uint32_t offset = 0;
+        std::uint32_t size = 0;
+        std::uint32_t capacity = 0;
+    };
+
+    // A basic_arena_polish_node with its curve, read through its tree,
+    // with the interface of basic_vectorized_polish_node.
+    class arena_polish_node_view : public meta_polish_node {
+        using base = meta_polish_node;
+
+    public:
+        using curve_type = shape_curve_view;
+
+        arena_polish_node_view(const basic_arena_polish_node &n,
+            curve_type points_in) noexcept :
+            base(n.type), max_points(n.max_points), points(points_in) {}
+
+        std::uint32_t max_points;
+        curve_type points;
+    };
+
+    std::ostream & operator<<(std::ostream &os, const arena_polish_node_view &n);
+
+    namespace detail {
+
+        // Indices of the points of lpts and rpts (curves of the children)
+        // that make point k of pts (curve of their parent, combined by
+        // type): its recorded sources if any, otherwise found by binary
+        // search in the children.
+        template<typename Curve, typename ChildCurve>
+        std::pair<std::size_t, std::size_t> child_points(
+            meta_polish_node::combine_type type, const Curve &pts,
+            std::size_t k, const ChildCurve &lpts, const ChildCurve &rpts) {
+            assert(type != meta_polish_node::combine_type::LEAF && k < pts.size());
+            if (pts.has_sources())
+                return { pts.left_sources()[k], pts.right_sources()[k] };
+
+            // Last widths not above, or first heights not above the point
+            if (type == meta_polish_node::combine_type::VERTICAL) {
+                auto w = pts.widths()[k];
+                auto lw = lpts.widths(), rw = rpts.widths();
+                return { std::upper_bound(lw, lw + lpts.size(), w) - lw - 1,
+                    std::upper_bound(rw, rw + rpts.size(), w) - rw - 1 };
+            } else {
+                auto h = pts.heights()[k];
+                auto lh = lpts.heights(), rh = rpts.heights();
+                return {
+                    std::lower_bound(lh, lh + lpts.size(), h, std::greater<>()) - lh,
+                    std::lower_bound(rh, rh + rpts.size(), h, std::greater<>()) - rh };
+            }
+        }
+
+    }   // detail
+
     namespace detail {
 
         // Node base storing structural information.
@@ -217,7 +988,8 @@ namespace polish {
             using self = tree_node_base;
 
         public:
-            tree_node_base() noexcept : lc_(nullptr), rc_(nullptr), parent_(nullptr) {}
+            tree_node_base() noexcept : lc_(nullptr), rc_(nullptr),
+                parent_(nullptr), dirty_(false), stale_(false), placed_(false) {}
             bool is_leaf() const noexcept { return !lc_; }
             bool is_header() const noexcept { return !parent_; }
             const self *prev() const noexcept;
@@ -226,6 +998,31 @@ namespace polish {
             self *lc_;	        //left child
             self *rc_;	        //right child
             self *parent_;	    //parent node
+            // Area to be recounted (see slicing_tree::begin_update); on the
+            // header, whether updates are deferred.
+            bool dirty_;
+            // Changed since the last snapshot (see slicing_tree::snapshot).
+            bool stale_;
+            // Unchanged since placed at (xoff_, yoff_), by point point_ of
+            // its curve if any (see polish_tree::update_floorplan).
+            bool placed_;
+            std::int32_t xoff_, yoff_;
+            std::uint32_t point_;
+        };
+
+        // Immutable node of a slicing_tree_snapshot, shared by the
+        // snapshots (and trees) where its subtree is unchanged.
+        template<typename BaseNode>
+        class snapshot_node {
+            using self = snapshot_node;
+
+        public:
+            snapshot_node(const BaseNode &value_in, std::shared_ptr<const self> lc_in,
+                std::shared_ptr<const self> rc_in) :
+                value(value_in), lc(std::move(lc_in)), rc(std::move(rc_in)) {}
+
+            BaseNode value;
+            std::shared_ptr<const self> lc, rc;
         };
 
         // Actual node stored in tree.
@@ -246,32 +1043,64 @@ namespace polish {
             explicit tree_node(Types &&...args) : tree_node_base(),
                 base(std::forward<Types>(args)...) {}
 
+            // Copy of this subtree in the last snapshot, unless null or stale_.
+            std::shared_ptr<const snapshot_node<BaseNode>> snapshot_;
+
             static self make_header() {
                 return self();
             }
 
+            // Assignable view of a link as self *.
+            // NOTE: links are stored as tree_node_base *, and accessing them
+            // through self *& breaks strict aliasing (miscompiled with -O2).
+            class link_reference {
+            public:
+                explicit link_reference(tree_node_base *&link) noexcept :
+                    link_(link) {}
+
+                link_reference &operator=(self *t) noexcept {
+                    link_ = t;
+                    return *this;
+                }
+
+                link_reference &operator=(const link_reference &other) noexcept {
+                    return *this = static_cast<self *>(other);
+                }
+
+                operator self *() const noexcept {
+                    return static_cast<self *>(link_);
+                }
+
+                self *operator->() const noexcept {
+                    return *this;
+                }
+
+            private:
+                tree_node_base *&link_;
+            };
+
             const self *lc() const noexcept {
                 return static_cast<const self *>(this->lc_);
             }
 
-            self *&lc() noexcept {
-                return reinterpret_cast<self *&>(this->lc_);
+            link_reference lc() noexcept {
+                return link_reference(this->lc_);
             }
 
             const self *rc() const noexcept {
                 return static_cast<const self *>(this->rc_);
             }
 
-            self *&rc() noexcept {
-                return reinterpret_cast<self *&>(this->rc_);
+            link_reference rc() noexcept {
+                return link_reference(this->rc_);
             }
 
             const self *parent() const noexcept {
                 return static_cast<const self *>(this->parent_);
             }
 
-            self *&parent() noexcept {
-                return reinterpret_cast<self *&>(this->parent_);
+            link_reference parent() noexcept {
+                return link_reference(this->parent_);
             }
 
             void count_area() {
@@ -6,6 +6,8 @@
 #include <boost/compressed_pair.hpp>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <random>
 #include <vector>
 
@@ -153,6 +155,23 @@ namespace polish {
         const node_type *ptr_;
     };
 
+    // Immutable copy of a slicing_tree (see slicing_tree::snapshot).
+    template<typename BasicNode>
+    class slicing_tree_snapshot {
+        using node_type = detail::snapshot_node<BasicNode>;
+
+    public:
+        bool empty() const noexcept {
+            return !root_;
+        }
+
+    private:
+        template<typename, typename>
+        friend class slicing_tree;
+
+        std::shared_ptr<const node_type> root_;
+    };
+
     // Slicing tree with post-order bidirectional iterator.
     // Alloc should be of type basic_polish_node.
     template<typename BasicNode, typename Alloc = std::allocator<BasicNode>>
@@ -174,6 +193,7 @@ namespace polish {
         using allocator_type = Alloc;
         using const_iterator = slicing_tree_const_iterator<traits, alloc_traits>;
         using iterator = const_iterator;
+        using snapshot_type = slicing_tree_snapshot<BasicNode>;
 
         using const_reference = const value_type &;
         using reference = value_type & ;
@@ -218,6 +238,7 @@ namespace polish {
 
         // Construct tree with a list of modules and a polish expression.
         // e.g., size(modules) == 3, expr == {0, 1, *, 1, +, 2, *}.
+        // Leaves are numbered by their module indices.
         bool construct(const std::vector<yal::Module> &modules,
             const std::vector<expression::polish_expression_type> &expr) {
             return construct(modules.begin(), expr.begin(), expr.end());
@@ -240,7 +261,7 @@ namespace polish {
                 if (e != expression::COMBINE_HORIZONTAL
                     && e != expression::COMBINE_VERTICAL) {
                     const yal::Module &m = first_module[e];
-                    stack.push_back(new_leaf(m));
+                    stack.push_back(new_leaf(m, static_cast<std::uint32_t>(e)));
                 } else {
                     if (stack.size() < 2) {
                         pass = false;
@@ -271,7 +292,8 @@ namespace polish {
             return pass;
         }
 
-        // Construct a random tree.
+        // Construct a random tree, whose leaves are numbered by their
+        // positions in [first_idx, last_idx).
         // @param first_module: begin of a yal::Module range
         // @param first_idx, last_idx: a range of yal::Module indices
         // @param eng: a random engine (e.g., std::default_random_engine>
@@ -292,8 +314,9 @@ namespace polish {
                 std::forward_iterator_tag>::value) {
                 trees.reserve(std::distance(first_idx, last_idx));
             }
+            std::uint32_t id = 0;
             for (auto i = first_idx; i != last_idx; ++i) {
-                trees.push_back(new_leaf(first_module[*i]));
+                trees.push_back(new_leaf(first_module[*i], id++));
             }
             oprs.resize(trees.size() - 1);
             for (auto &p : oprs) {
@@ -313,6 +336,9 @@ namespace polish {
             std::vector<node_type *> trees, oprs;
             for (auto i = begin(); i != end(); ++i) {
                 node_type *t = get_iter_pointer(i);
+                t->dirty_ = false;  // all recounted
+                t->stale_ = true;
+                t->placed_ = false;
                 if (t->type == meta_polish_node::combine_type::LEAF)
                     trees.push_back(t);
                 else
@@ -336,6 +362,8 @@ namespace polish {
                 if (src->type == meta_polish_node::combine_type::LEAF) {
                     node_type *dst = copy_node(src);
                     dst->lc() = dst->rc() = nullptr;
+                    dst->snapshot_.reset();
+                    dst->placed_ = false;
                     stack.push_back(dst);
                 } else {
                     if (stack.size() < 2) {
@@ -343,6 +371,8 @@ namespace polish {
                         break;
                     }
                     node_type *dst = copy_node(src);
+                    dst->snapshot_.reset();     // children may differ
+                    dst->placed_ = false;
                     attach_right(dst, stack.back());
                     stack.pop_back();
                     attach_left(dst, stack.back());
@@ -429,14 +459,68 @@ namespace polish {
             node_type *t = get_iter_pointer(pos);
             if (t == header() || is_leaf(t))
                 return false;
-            while (t != header()) {
-                t->invert_combine_type();
-                t->count_area();
-                t = t->parent();
-            }
+            for (node_type *p = t; p != header(); p = p->parent())
+                p->invert_combine_type();
+            update_downtop(t, std::false_type());
             return true;
         }
 
+        // Defers the updates of changes (swap_nodes, invert_chain and
+        // rotate_leaf) until end_update(), so that a compound move recounts
+        // each affected node once. Until then, changes only mark the nodes
+        // to recount, and areas of the tree are stale.
+        void begin_update() noexcept {
+            header()->dirty_ = true;
+        }
+
+        // Recounts all nodes marked since begin_update(), each once and
+        // down-top, and stops deferring updates.
+        void end_update() {
+            header()->dirty_ = false;
+            flush_update();
+        }
+
+        // As end_update(), but gives up once pred(it) holds for a node it
+        // just recounted, e.g., once the area of the root is known to be
+        // too large, as areas only grow towards the root. Updates are then
+        // still deferred, so that the changes can be undone before
+        // end_update(), which recounts the nodes left marked.
+        // @return whether all marked nodes are recounted
+        template<typename Pred>
+        bool end_update_unless(Pred &&pred) {
+            if (!flush_update(pred))
+                return false;
+            header()->dirty_ = false;
+            return true;
+        }
+
+        // Whether updates are deferred.
+        bool is_updating() const noexcept {
+            return header()->dirty_;
+        }
+
+        // Takes an immutable copy of the tree. Snapshots share the nodes of
+        // subtrees that did not change between them, and the tree keeps
+        // its last one, so a snapshot copies only the nodes recounted since
+        // the previous one (the paths changed by moves), not the tree.
+        // @require !is_updating()
+        snapshot_type snapshot() {
+            assert(!is_updating());
+            snapshot_type s;
+            if (!empty())
+                s.root_ = take_snapshot(header()->lc());
+            return s;
+        }
+
+        // Makes the tree a copy of snapshot s (in O(n)), sharing its nodes
+        // for later snapshots.
+        void restore(const snapshot_type &s) {
+            node_type *new_root = s.empty() ? nullptr : restore_tree(s.root_);
+            clear();
+            if (new_root)
+                attach_left(header(), new_root);
+        }
+
         // For debug.
         std::ostream &print_tree(std::ostream &os, int ident = 4,
             char fill = ' ') const {
@@ -474,9 +558,10 @@ namespace polish {
             return t;
         }
 
-        node_type *new_leaf(const yal::Module &m) {
+        node_type *new_leaf(const yal::Module &m, std::uint32_t id) {
             node_type *t = get_alloc().allocate(1);
             traits::placement_new_leaf(t, m, get_alloc());
+            t->id = id;
             return t;
         }
 
@@ -528,6 +613,36 @@ namespace polish {
             }
         }
 
+        using snapshot_pointer = std::shared_ptr<const detail::snapshot_node<BasicNode>>;
+
+        // Snapshot of subtree t, reusing the nodes of unchanged subtrees.
+        // Since a change recounts all ancestors, stale nodes are a union of
+        // paths from the root.
+        snapshot_pointer take_snapshot(node_type *t) {
+            if (t->snapshot_ && !t->stale_)
+                return t->snapshot_;
+            snapshot_pointer lc, rc;
+            if (!is_leaf(t)) {
+                lc = take_snapshot(t->lc());
+                rc = take_snapshot(t->rc());
+            }
+            t->snapshot_ = std::allocate_shared<detail::snapshot_node<BasicNode>>(
+                get_alloc(), static_cast<const BasicNode &>(*t),
+                std::move(lc), std::move(rc));
+            t->stale_ = false;
+            return t->snapshot_;
+        }
+
+        node_type *restore_tree(const snapshot_pointer &s) {
+            node_type *t = new_node(s->value);
+            t->snapshot_ = s;
+            if (s->lc) {
+                attach_left(t, restore_tree(s->lc));
+                attach_right(t, restore_tree(s->rc));
+            }
+            return t;
+        }
+
         static bool is_leaf(const node_type *t) noexcept {
             return t->is_leaf();
         }
@@ -536,31 +651,70 @@ namespace polish {
             return const_cast<node_type *>(pos.ptr_);
         }
 
-        // Update down-top from non-leaf node t.
+        // Update down-top from non-leaf node t (or header()), unless
+        // updates are deferred.
         template<bool B>
         void update_downtop(node_type *t,
             std::integral_constant<bool, B> update_size) {
             assert(!is_leaf(t));
-            while (t != header()) {
-                t->count_area();
-                t = t->parent();
-            }
+            mark_dirty(t);
+            if (!is_updating())
+                flush_update();
         }
 
-        // Update down-top simultaneously from non-leaf nodes t1 and t2.
-        // Some nodes along the path may be updated twice.
+        // Update down-top from non-leaf nodes t1 and t2, unless updates are
+        // deferred. Common ancestors are updated once.
         template<bool B>
         void update_downtop(node_type *t1, node_type *t2,
             std::integral_constant<bool, B> update_size) {
             assert(!is_leaf(t1) && !is_leaf(t2));
-            while (t1 != header() && t2 != header()) {
-                t1->count_area();
-                t2->count_area();
-                t1 = t1->parent();
-                t2 = t2->parent();
+            mark_dirty(t1);
+            mark_dirty(t2);
+            if (!is_updating())
+                flush_update();
+        }
+
+        // Marks t and its ancestors to be recounted. Ancestors of a marked
+        // node are marked, as changes move nodes within the subtree of a
+        // marked node only, so marking stops at the first marked one.
+        void mark_dirty(node_type *t) noexcept {
+            for (; t != header() && !t->dirty_; t = t->parent())
+                t->dirty_ = true;
+        }
+
+        // Recounts marked nodes in post-order, walking the marked subtree
+        // (a union of paths from the root) without a stack: a node is done
+        // when it has no marked child left.
+        void flush_update() {
+            flush_update([](const_iterator) { return false; });
+        }
+
+        // As flush_update(), but stops after recounting a node it for which
+        // pred(it) holds. Marks are kept valid: a recounted node has no
+        // marked descendant.
+        // @return whether all marked nodes are recounted
+        template<typename Pred>
+        bool flush_update(Pred &&pred) {
+            node_type *t = header()->lc();
+            if (!t || !t->dirty_)
+                return true;
+            for (;;) {
+                if (t->lc()->dirty_) {
+                    t = t->lc();
+                } else if (t->rc()->dirty_) {
+                    t = t->rc();
+                } else {
+                    t->count_area();
+                    t->dirty_ = false;
+                    t->stale_ = true;
+                    t->placed_ = false;
+                    if (pred(const_iterator(t)))
+                        return t->parent() == header();
+                    if (t->parent() == header())
+                        return true;
+                    t = t->parent();
+                }
             }
-            update_downtop(t1, update_size);
-            update_downtop(t2, update_size);
         }
 
         void swap_leaves(node_type *t1, node_type *t2) {
@@ -735,10 +889,9 @@ namespace polish {
             if (t == this->header() || !base::is_leaf(t))
                 return false;
             t->invert_combine_type();
-            while (t != this->header()) {
-                t->count_area();
-                t = t->parent();
-            }
+            t->stale_ = true;
+            t->placed_ = false;
+            this->update_downtop(t->parent(), std::false_type());
             return true;
         }
 
@@ -751,6 +904,19 @@ namespace polish {
                 floorplan_impl(this->header()->lc(), xoff, yoff, dst);
         }
 
+        // Settles positions as floorplan(), but only of the modules moved or
+        // changed since the last call, calling f(id, x, y, w, h) for each
+        // such leaf. Subtrees unchanged since then and at the same offsets
+        // are skipped, so that a move costs the paths it changed and the
+        // subtrees they shift, rather than the whole tree. If all, every
+        // leaf is reported, e.g., to a new f (copies of a tree keep its
+        // last placement).
+        template<typename F>
+        void update_floorplan(F &&f, bool all = false) {
+            if (!this->empty())
+                update_floorplan_impl(this->header()->lc(), 0, 0, f, all);
+        }
+
     protected:
         template<typename OutIt>
         static OutIt floorplan_impl(const node_type *t,
@@ -767,6 +933,25 @@ namespace polish {
             }
             return dst;
         }
+
+        template<typename F>
+        static void update_floorplan_impl(node_type *t,
+            dimension_type xoff, dimension_type yoff, F &f, bool all) {
+            if (!all && t->placed_ && t->xoff_ == xoff && t->yoff_ == yoff)
+                return;
+            t->placed_ = true;
+            t->xoff_ = xoff;
+            t->yoff_ = yoff;
+            if (t->type == combine_type::VERTICAL) {
+                update_floorplan_impl(t->lc(), xoff, yoff, f, all);
+                update_floorplan_impl(t->rc(), xoff, yoff + t->lc()->height, f, all);
+            } else if (t->type == combine_type::HORIZONTAL) {
+                update_floorplan_impl(t->lc(), xoff, yoff, f, all);
+                update_floorplan_impl(t->rc(), xoff + t->lc()->width, yoff, f, all);
+            } else {
+                f(t->id, xoff, yoff, t->width, t->height);
+            }
+        }
     };
 
     // A vectorized_polish_tree is a tree of
@@ -809,59 +994,110 @@ namespace polish {
             typename std::allocator_traits<Alloc>::value_type,
             Alloc>::slicing_tree;
 
+        // Limits the points of every curve to limit (0 for unlimited, and
+        // at least 3 otherwise), and recounts curves down-top. The limit
+        // applies to current nodes; construct() creates unlimited ones.
+        void set_curve_limit(std::size_t limit) {
+            auto max_points = static_cast<std::uint32_t>(
+                limit ? std::max<std::size_t>(limit, 3) : 0);
+            for (auto it = this->begin(); it != this->end(); ++it) {
+                node_type *t = this->get_iter_pointer(it);
+                t->max_points = max_points;
+                t->count_area();
+                t->stale_ = true;
+                t->placed_ = false;
+            }
+        }
+
+        // Records, or stops recording, the sources of every curve point
+        // (see shape_curve), and recounts curves down-top. Recording applies
+        // to current nodes, as in set_curve_limit.
+        void set_record_sources(bool on) {
+            for (auto it = this->begin(); it != this->end(); ++it) {
+                node_type *t = this->get_iter_pointer(it);
+                t->points.record_sources(on);
+                t->count_area();
+                t->stale_ = true;
+                t->placed_ = false;
+            }
+        }
+
         // Settle lower-left positions of all modules,
         // using the kth point of root's curve function.
         // Each output is a (x, y, w, h) tuple (floorplan_entry).
+        // Points of children are the recorded sources if any, so that
+        // each node takes O(1) time.
         template<typename OutIt>
         OutIt floorplan(std::size_t k, OutIt dst,
             dimension_type xoff = 0, dimension_type yoff = 0) const {
-            return this->empty() ? dst :
-                floorplan_impl(this->header()->lc(), k, xoff, yoff, dst);
+            if (this->empty())
+                return dst;
+            struct frame {
+                const node_type *t;
+                std::size_t k;
+                dimension_type x, y;
+            };
+            std::vector<frame> stack;
+            stack.push_back({ this->header()->lc(), k, xoff, yoff });
+            while (!stack.empty()) {
+                const frame f = stack.back();
+                stack.pop_back();
+                const node_type *t = f.t;
+                if (t->type == combine_type::LEAF) {
+                    const auto &shape = t->points[f.k];
+                    *dst++ = std::make_tuple(f.x, f.y, shape.first, shape.second);
+                    continue;
+                }
+
+                auto ks = detail::child_points(t->type, t->points, f.k,
+                    t->lc()->points, t->rc()->points);
+                const auto &lshape = t->lc()->points[ks.first];
+                // rc goes first to be popped after the leaves of lc
+                if (t->type == combine_type::VERTICAL)
+                    stack.push_back({ t->rc(), ks.second, f.x, f.y + lshape.second });
+                else
+                    stack.push_back({ t->rc(), ks.second, f.x + lshape.first, f.y });
+                stack.push_back({ t->lc(), ks.first, f.x, f.y });
+            }
+            return dst;
+        }
+
+        // Settles positions as floorplan(k), but only of the modules moved
+        // or changed since the last call, as polish_tree::update_floorplan.
+        // Subtrees are also placed again when their points change.
+        template<typename F>
+        void update_floorplan(std::size_t k, F &&f, bool all = false) {
+            if (!this->empty())
+                update_floorplan_impl(this->header()->lc(), k, 0, 0, f, all);
         }
 
     protected:
-        template<typename OutIt>
-        static OutIt floorplan_impl(const node_type *t, std::size_t k,
-            dimension_type xoff, dimension_type yoff, OutIt dst) {
-            assert(t && k < t->points.size());
-            const auto &shape = t->points[k];
+        template<typename F>
+        static void update_floorplan_impl(node_type *t, std::size_t k,
+            dimension_type xoff, dimension_type yoff, F &f, bool all) {
+            if (!all && t->placed_ && t->point_ == k
+                && t->xoff_ == xoff && t->yoff_ == yoff)
+                return;
+            t->placed_ = true;
+            t->point_ = static_cast<std::uint32_t>(k);
+            t->xoff_ = xoff;
+            t->yoff_ = yoff;
             if (t->type == combine_type::LEAF) {
-                *dst++ = std::make_tuple(xoff, yoff, shape.first, shape.second);
-                return dst;
+                const auto &shape = t->points[k];
+                f(t->id, xoff, yoff, shape.first, shape.second);
+                return;
             }
 
-            if (t->type == combine_type::VERTICAL) {
-                auto lpos = std::prev(std::upper_bound(t->lc()->points.cbegin(),
-                    t->lc()->points.cend(), shape,
-                    [](const coord_type &a, const coord_type &b) {
-                    return a.first < b.first;
-                }));
-                auto rpos = std::prev(std::upper_bound(t->rc()->points.cbegin(),
-                    t->rc()->points.cend(), shape,
-                    [](const coord_type &a, const coord_type &b) {
-                    return a.first < b.first;
-                }));
-                dst = floorplan_impl(t->lc(), lpos - t->lc()->points.cbegin(),
-                    xoff, yoff, dst);
-                dst = floorplan_impl(t->rc(), rpos - t->rc()->points.cbegin(),
-                    xoff, yoff + lpos->second, dst);
-            } else {
-                auto lpos = std::lower_bound(t->lc()->points.cbegin(),
-                    t->lc()->points.cend(), shape,
-                    [](const coord_type &a, const coord_type &b) {
-                    return a.second > b.second;
-                });
-                auto rpos = std::lower_bound(t->rc()->points.cbegin(),
-                    t->rc()->points.cend(), shape,
-                    [](const coord_type &a, const coord_type &b) {
-                    return a.second > b.second;
-                });
-                dst = floorplan_impl(t->lc(), lpos - t->lc()->points.cbegin(),
-                    xoff, yoff, dst);
-                dst = floorplan_impl(t->rc(), rpos - t->rc()->points.cbegin(),
-                    xoff + lpos->first, yoff, dst);
-            }
-            return dst;
+            auto ks = detail::child_points(t->type, t->points, k,
+                t->lc()->points, t->rc()->points);
+            const auto &lshape = t->lc()->points[ks.first];
+            update_floorplan_impl(t->lc(), ks.first, xoff, yoff, f, all);
+            if (t->type == combine_type::VERTICAL)
+                update_floorplan_impl(t->rc(), ks.second, xoff,
+                    yoff + lshape.second, f, all);
+            else
+                update_floorplan_impl(t->rc(), ks.second,
+                    xoff + lshape.first, yoff, f, all);
         }
     };
 
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
@@ -11,7 +12,12 @@
 
 #include <boost/pool/pool_alloc.hpp>
 
+#include "adaptive_distribution.h"
+#include "deadline.h"
+
+#include "flat_polish_tree.hpp"
 #include "polish_tree.hpp"
+#include "wirelength.hpp"
 
 namespace polish {
     namespace v1 {
@@ -41,7 +47,7 @@ namespace polish {
                 srand((unsigned)time(NULL));
                 init_vbuf();
                 temperature = count_init_temprature(init_accept_rate);
-                std::cerr << "init temperature " << temperature << endl;
+                std::cerr << "init temperature " << temperature << std::endl;
                 cooldown_speed = cooldown_speed_in;
                 cooldown_ratio = cooldown_ratio_in;
                 accept_under_currentT = total_under_currentT = 0;
@@ -279,15 +285,20 @@ namespace polish {
             template<typename T>
             class SABase;
 
-            template<typename Alloc>
-            class SABase<polish::vectorized_polish_tree<Alloc>> {
+            // SABase of trees with curve functions (vectorized_polish_tree).
+            template<typename Tree>
+            class VectorizedSABase {
             protected:
                 using area_type = std::int64_t;
-                using tree_type = polish::vectorized_polish_tree<Alloc>;
+                using tree_type = Tree;
                 using combine_type = typename tree_type::combine_type;
                 using const_iterator = typename tree_type::const_iterator;
 
             public:
+                static constexpr std::size_t num_operation_types = 3;    // M1-M3
+                // Whether trees place modules incrementally (update_floorplan).
+                static constexpr bool has_floorplan_update = false;
+
                 static std::size_t get_best_point(const tree_type &tree) {
                     assert(!tree.empty());
                     return count_min_area_impl(tree.root()).second;
@@ -331,9 +342,12 @@ namespace polish {
                     count_min_area_impl(const_iterator root) noexcept {
                     area_type min_area = std::numeric_limits<area_type>::max();
                     std::size_t curve_index = 0, sub_best_curve = -1;
-                    for (auto &&e : root->points) {
-                        if (e.first * e.second < min_area) {
-                            min_area = e.first * e.second;
+                    // NOTE: (*root).points outlives the loop even if root
+                    // reads nodes by value (arena_vectorized_polish_tree).
+                    for (auto &&e : (*root).points) {
+                        area_type area = static_cast<area_type>(e.first) * e.second;
+                        if (area < min_area) {
+                            min_area = area;
                             sub_best_curve = curve_index;   // There was a bug in v1!!
                         }
                         curve_index++;
@@ -342,14 +356,20 @@ namespace polish {
                 }
             };
 
-            template<typename Alloc>
-            class SABase<polish::polish_tree<Alloc>> {
+            // SABase of trees with hard modules (polish_tree).
+            template<typename Tree>
+            class PolishSABase {
             protected:
                 using area_type = std::int64_t;
-                using tree_type = polish::polish_tree<Alloc>;
+                using tree_type = Tree;
                 using combine_type = typename tree_type::combine_type;
                 using const_iterator = typename tree_type::const_iterator;
 
+            public:
+                static constexpr std::size_t num_operation_types = 4;    // M1-M4
+                static constexpr bool has_floorplan_update = false;
+
+            protected:
                 template<typename Eng>
                 static OperationType random_operation(Eng &&eng, std::size_t sz) {
                     if (sz <= 1)
@@ -377,7 +397,7 @@ namespace polish {
                 }
 
                 static area_type count_min_area(const_iterator root) noexcept {
-                    return root->width * root->height;
+                    return static_cast<area_type>(root->width) * root->height;
                 }
 
                 static int compute_balance_minstep(std::size_t tree_size) noexcept {
@@ -385,6 +405,185 @@ namespace polish {
                 }
             };
 
+            template<typename Alloc>
+            class SABase<polish::vectorized_polish_tree<Alloc>> :
+                public VectorizedSABase<polish::vectorized_polish_tree<Alloc>> {
+                using base = VectorizedSABase<polish::vectorized_polish_tree<Alloc>>;
+
+            public:
+                static constexpr bool has_floorplan_update = true;
+
+            protected:
+                // Places by the minimum-area point of the root.
+                template<typename F>
+                static void update_floorplan(typename base::tree_type &t,
+                    F &&f, bool all) {
+                    t.update_floorplan(base::get_best_point(t), std::forward<F>(f), all);
+                }
+            };
+
+            template<typename Alloc>
+            class SABase<polish::flat_vectorized_polish_tree<Alloc>> :
+                public VectorizedSABase<polish::flat_vectorized_polish_tree<Alloc>> {};
+
+            template<typename Alloc>
+            class SABase<polish::polish_tree<Alloc>> :
+                public PolishSABase<polish::polish_tree<Alloc>> {
+            public:
+                static constexpr bool has_floorplan_update = true;
+
+            protected:
+                template<typename F>
+                static void update_floorplan(polish::polish_tree<Alloc> &t,
+                    F &&f, bool all) {
+                    t.update_floorplan(std::forward<F>(f), all);
+                }
+            };
+
+            template<typename Alloc>
+            class SABase<polish::flat_polish_tree<Alloc>> :
+                public PolishSABase<polish::flat_polish_tree<Alloc>> {};
+
+            // Positions of legal moves in a polish expression (the post-order
+            // of a tree): leaves, operators and valid M3 swaps, each kept as
+            // an indexable set, so that SA draws moves without retries.
+            // Only M3 moves nodes between leaf and operator positions, and
+            // a swap at (i, i + 1) changes the validity of positions i - 1
+            // to i + 1 only, so it is updated in O(1). Unlike the retries
+            // it replaces, M3 never swaps two adjacent leaves, as M1 does.
+            class MoveIndex {
+            public:
+                // Indexes the expression whose ith node is a leaf iff
+                // is_leaf(i), for i in [0, n).
+                template<typename Pred>
+                void assign(std::size_t n, Pred &&is_leaf) {
+                    leaf_.resize(n);
+                    rank_.resize(n);
+                    balance_.assign(n + 1, 0);
+                    for (auto &p : positions_)
+                        p.clear();
+                    for (std::size_t i = 0; i != n; ++i) {
+                        leaf_[i] = is_leaf(i);
+                        rank_[i] = positions_[leaf_[i]].size();
+                        positions_[leaf_[i]].push_back(i);
+                        balance_[i + 1] = balance_[i] + (leaf_[i] ? 1 : -1);
+                    }
+                    m3_.clear();
+                    m3_.reserve(n);
+                    m3_rank_.assign(n, std::size_t(npos));  // not odr-used
+                    for (std::size_t i = 0; i != n; ++i)
+                        update_m3(i);
+                }
+
+                std::size_t num_leaves() const noexcept { return positions_[1].size(); }
+                std::size_t num_operators() const noexcept { return positions_[0].size(); }
+                std::size_t num_m3() const noexcept { return m3_.size(); }
+
+                // Position of the rth leaf (or operator), in order.
+                std::size_t leaf(std::size_t r) const noexcept { return positions_[1][r]; }
+                std::size_t operator_at(std::size_t r) const noexcept { return positions_[0][r]; }
+
+                // kth valid M3 position i, i.e., swapping nodes i and i + 1
+                // is valid (in no particular order).
+                std::size_t m3(std::size_t k) const noexcept { return m3_[k]; }
+
+                // Updates after swapping nodes i and i + 1 (an M3 move).
+                void swap_adjacent(std::size_t i) noexcept {
+                    assert(i + 1 < leaf_.size() && leaf_[i] != leaf_[i + 1]);
+                    std::swap(leaf_[i], leaf_[i + 1]);
+                    std::swap(rank_[i], rank_[i + 1]);
+                    positions_[leaf_[i]][rank_[i]] = i;
+                    positions_[leaf_[i + 1]][rank_[i + 1]] = i + 1;
+                    balance_[i + 1] = balance_[i] + (leaf_[i] ? 1 : -1);
+                    for (std::size_t j = i ? i - 1 : 0; j != i + 2; ++j)
+                        update_m3(j);
+                }
+
+            private:
+                static constexpr std::size_t npos = -1;
+
+                // Swapping an operator and the next leaf is always valid.
+                // Swapping a leaf and the next operator keeps the balloting
+                // property iff the leaves before it outnumber operators by
+                // at least 2 (see slicing_tree::swap_leaf_operator).
+                bool is_m3_valid(std::size_t i) const noexcept {
+                    return i + 1 < leaf_.size() && leaf_[i] != leaf_[i + 1]
+                        && (leaf_[i + 1] || balance_[i] >= 2);
+                }
+
+                void update_m3(std::size_t i) noexcept {
+                    bool valid = is_m3_valid(i);
+                    if (valid == (m3_rank_[i] != npos))
+                        return;
+                    if (valid) {
+                        m3_rank_[i] = m3_.size();
+                        m3_.push_back(i);
+                    } else {
+                        std::size_t k = m3_rank_[i];
+                        m3_[k] = m3_.back();
+                        m3_rank_[m3_[k]] = k;
+                        m3_.pop_back();
+                        m3_rank_[i] = npos;
+                    }
+                }
+
+                std::vector<unsigned char> leaf_;
+                std::vector<std::size_t> rank_;             // in positions_
+                std::vector<std::size_t> positions_[2];     // operators, leaves
+                std::vector<std::ptrdiff_t> balance_;       // leaves - operators before i
+                std::vector<std::size_t> m3_, m3_rank_;
+            };
+
+            template<typename... Types>
+            struct make_void {
+                using type = void;
+            };
+
+            // Best tree found so far, kept as a copy.
+            template<typename Tree, typename = void>
+            class BestTree {
+            public:
+                explicit BestTree(const Tree &t) : tree_(t) {}
+
+                void keep(Tree &t) {
+                    tree_ = t;
+                }
+
+                const Tree &get() const noexcept {
+                    return tree_;
+                }
+
+            private:
+                Tree tree_;
+            };
+
+            // Best tree found so far, kept as a snapshot of trees with
+            // snapshots (slicing_tree), which copies only the paths changed
+            // since the last one. The tree is restored on demand.
+            template<typename Tree>
+            class BestTree<Tree, typename make_void<typename Tree::snapshot_type>::type> {
+            public:
+                explicit BestTree(const Tree &t) : tree_(t) {}
+
+                void keep(Tree &t) {
+                    snapshot_ = t.snapshot();
+                    restored_ = false;
+                }
+
+                const Tree &get() const {
+                    if (!restored_) {
+                        tree_.restore(snapshot_);
+                        restored_ = true;
+                    }
+                    return tree_;
+                }
+
+            private:
+                typename Tree::snapshot_type snapshot_;
+                mutable Tree tree_;
+                mutable bool restored_ = true;
+            };
+
         }
 
         template<typename Tree>
@@ -399,18 +598,30 @@ namespace polish {
         public:
             using tree_type = Tree;
 
+            // If alpha < 1, the cost minimised is alpha * area + (1 - alpha) *
+            // hpwl of the nets of hpwl, whose modules are numbered as the
+            // leaves, rather than the area. Only trees placing modules
+            // incrementally (polish_tree and vectorized_polish_tree) support
+            // it; others ignore alpha (see has_wirelength).
             template<typename Eng>
             SA(const tree_type &vtree_in, double init_accept_rate, 
                 double cooldown_ratio_in, double cooldown_speed_in,
                 double ending_temperature_in, Eng &&eng,
-                std::ostream &out = std::cerr) :
+                std::ostream &out = std::cerr, double alpha_in = 1,
+                incremental_hpwl hpwl_in = incremental_hpwl()) :
                 tree(vtree_in), best_tree(vtree_in), os(&out), 
                 cooldown_ratio(cooldown_ratio_in),
                 cooldown_speed(cooldown_speed_in), 
                 ending_temperature(ending_temperature_in),
                 accept_under_currentT(0), total_under_currentT(0),
-                best_solution(std::numeric_limits<area_type>::max()) {
+                best_solution(std::numeric_limits<area_type>::max()),
+                alpha(alpha_in), hpwl(std::move(hpwl_in)),
+                wirelength(base::has_floorplan_update && alpha_in < 1) {
                 init_expr();
+                if (wirelength) {
+                    count_wirelength(floorplan_update(), true);
+                    hpwl.commit();
+                }
                 temperature = count_init_temprature(init_accept_rate, eng);
                 (*os) << "init temperature " << temperature << std::endl;
                 balance_minstep = base::compute_balance_minstep(
@@ -420,41 +631,92 @@ namespace polish {
             SA(const SA &) = delete;
             SA &operator=(const SA &) = delete;
 
+            // The Metropolis test (accept iff rand <= exp((pre - post) / T))
+            // is drawn first, as the ceiling pre - T * log(rand) of post, so
+            // that recounting stops as soon as a node is larger than that:
+            // areas only grow towards the root, and most moves are
+            // rejected at low temperatures. With wirelength, the weighted
+            // area of a node bounds the cost likewise, and modules are
+            // placed only once the tree is recounted. The cost of the tree
+            // is kept from the last move accepted; a rejected move which was
+            // placed is rolled back on the hpwl too.
             template<typename Eng>
             void take_step(Eng &&eng) {
-                area_type pre_min_area, post_min_area;
-                pre_min_area = count_min_area();
+                double pre_cost = curr_cost;
+                std::uniform_real_distribution<> rand_double;
+                double ceiling = pre_cost - temperature * std::log(rand_double(eng));
+                double weight = wirelength ? alpha : 1;
                 operation_type op = random_operation(eng);
+                tree.begin_update();
                 operation op_final = check_valid_and_go(op, eng);
-                post_min_area = count_min_area();
-                std::uniform_real_distribution<> rand_double;
-                if (pre_min_area <= post_min_area) { //probably accept
-                    double acc_rate = exp((pre_min_area - post_min_area) / temperature);
-                    if (rand_double(eng) <= acc_rate) {
-                        accept_under_currentT++;
-                        total_under_currentT++;
-                    } else {
-                        goto_neighbor(op_final);   //recover previous state
-                        total_under_currentT++;
-                    }
-                } else { //accept
+                double post_cost = 0;
+                bool counted = tree.end_update_unless([&](const_iterator it) {
+                        return weight * base::count_min_area(it) > ceiling;
+                    });
+                bool accepted = counted && (post_cost = count_cost()) <= ceiling;
+                if (adaptive)   // The type done, as M1 may stand in for it
+                    op_dist.feedback(static_cast<std::size_t>(op_final.type),
+                        accepted, accepted ? pre_cost - post_cost : 0.0);
+                if (accepted) {
+                    curr_cost = post_cost;
+                    hpwl.commit();
                     accept_under_currentT++;
-                    total_under_currentT++;
+                } else {
+                    goto_neighbor(op_final);   //recover previous state
+                    if (tree.is_updating())
+                        tree.end_update();
+                    if (counted)
+                        rollback_wirelength(floorplan_update());
                 }
+                total_under_currentT++;
             }
 
-            //only if accept rate > constant1 and total step > constant2
-            bool reach_balance() const noexcept {
-                return accept_under_currentT > balance_minstep;
+            //only if accept rate > constant1 and total step > constant2,
+            //or out of time
+            bool reach_balance() noexcept {
+                return accept_under_currentT > balance_minstep || deadline.expired();
             }
 
-            void cool_down_by_both() noexcept {
-                temperature = temperature * (1 - cooldown_ratio) - cooldown_speed;
+            // If the temperatures left to ending_temperature would not fit in
+            // the remaining time, at the pace of the last one, the temperature
+            // is lowered geometrically to reach it in time instead.
+            void cool_down_by_both() {
+                auto now = deadline.elapsed();
+                auto steps = deadline.steps_left(now - temperature_start);
+                temperature_start = now;
+                if (!deadline.unlimited() && ending_temperature > 0 &&
+                    steps_to_end(steps) > steps)
+                    temperature *= std::pow(ending_temperature / temperature,
+                        1.0 / std::max(steps, std::size_t(1)));
+                else
+                    temperature = temperature * (1 - cooldown_ratio) - cooldown_speed;
                 accept_under_currentT = total_under_currentT = 0;
+                if (adaptive)
+                    op_dist.update();
+            }
+
+            // Whether move types are drawn from probabilities learned at each
+            // temperature from their acceptance and area gain (see 
+            // aureliano::adaptive_discrete_distribution), rather than uniformly.
+            void set_adaptive(bool on) {
+                adaptive = on;
+                if (on) {
+                    std::vector<double> weights(base::num_operation_types, 1.0);
+                    op_dist = aureliano::adaptive_discrete_distribution(
+                        weights.cbegin(), weights.cend());
+                }
             }
 
-            bool reach_end() const noexcept {
-                return temperature <= ending_temperature;
+            // Sets the wall-clock budget. When it runs out, the current
+            // temperature ends and reach_end() holds; the best tree so far
+            // is kept as usual.
+            void set_deadline(const aureliano::deadline &d) {
+                deadline = d;
+                temperature_start = deadline.elapsed();
+            }
+
+            bool reach_end() noexcept {
+                return temperature <= ending_temperature || deadline.expired_now();
             }
 
             void print() const {
@@ -468,14 +730,34 @@ namespace polish {
                 (*os) << "minimum area is " << best_solution << std::endl;
                 (*os) << "utility is " << static_cast<double>(count_tot_block_area())
                     / best_solution << std::endl;
+                if (wirelength)
+                    (*os) << "wirelength is " << best_wirelength << ", cost is "
+                        << best_cost << std::endl;
+                if (adaptive) {
+                    (*os) << "move weights are";
+                    for (std::size_t k = 0; k != op_dist.size(); ++k)
+                        (*os) << " M" << k + 1 << ": " << op_dist.probability(k);
+                    (*os) << std::endl;
+                }
             }
 
+            // Area of the best tree.
             area_type get_best_area() const noexcept {
                 return best_solution;
             }
 
-            const tree_type &get_best_tree() const noexcept {
-                return best_tree;
+            // Cost of the best tree: its area, unless has_wirelength().
+            double get_best_cost() const noexcept {
+                return best_cost;
+            }
+
+            // Whether the cost includes wirelength.
+            bool has_wirelength() const noexcept {
+                return wirelength;
+            }
+
+            const tree_type &get_best_tree() const {
+                return best_tree.get();
             }
 
         private:
@@ -495,33 +777,78 @@ namespace polish {
                     expr.push_back(it);
                     it++;
                 }
+                moves.assign(expr.size(), [this](std::size_t i) {
+                    return expr[i]->type == combine_type::LEAF;
+                });
             }
 
             template<typename Eng>
             double count_init_temprature(double init_accept_rate, Eng &&eng) {
                 using namespace std;
-                area_type init_min_area = count_min_area();
-                int64_t total_drop = 0;
+                double init_cost = curr_cost = count_cost();
+                double total_drop = 0;
                 int N = 100;
                 for (int i = 0; i < N; i++) {
                     operation_type op = random_operation(eng);
                     operation op_final = check_valid_and_go(op, eng);
-                    area_type post_min_area = count_min_area();
-                    total_drop += abs(init_min_area - post_min_area);
+                    double post_cost = count_cost();
+                    total_drop += abs(init_cost - post_cost);
                     goto_neighbor(op_final);   //recover previous state
+                    rollback_wirelength(floorplan_update());
                 }
                 return -total_drop / (100 * log(init_accept_rate));
             }
 
-            area_type count_min_area() {
+            // Cost of the tree (see SA()), keeping the best tree.
+            // @require !tree.is_updating()
+            double count_cost() {
                 area_type min_area = base::count_min_area(expr.back());
-                if (min_area < best_solution) {
+                double cost = min_area, wire = 0;
+                if (wirelength) {
+                    wire = count_wirelength(floorplan_update(), false);
+                    cost = alpha * min_area + (1 - alpha) * wire;
+                }
+                if (cost < best_cost) {
+                    best_cost = cost;
                     best_solution = min_area;
-                    best_tree = tree;
+                    best_wirelength = wire;
+                    best_tree.keep(tree);
                 }
-                return min_area;
+                return cost;
             }
 
+            using floorplan_update = std::integral_constant<bool,
+                base::has_floorplan_update>;
+
+            // hpwl of the tree, placing the modules moved since the last
+            // count (all of them if all, or after a rollback).
+            double count_wirelength(std::true_type, bool all) {
+                using dimension_type = meta_polish_node::dimension_type;
+                base::update_floorplan(tree, [this](std::uint32_t id,
+                    dimension_type x, dimension_type y, dimension_type w,
+                    dimension_type h) { hpwl.place(id, x, y, w, h); },
+                    all || replace_all);
+                replace_all = false;
+                return hpwl.update();
+            }
+
+            double count_wirelength(std::false_type, bool) const noexcept {
+                return 0;
+            }
+
+            // Places the modules of a rejected move back in the hpwl, once
+            // the move is undone on the tree. The positions cached in the
+            // tree may still be those of the move, so the next count places
+            // all the modules, which then match those of the hpwl.
+            void rollback_wirelength(std::true_type) {
+                if (!wirelength)
+                    return;
+                hpwl.rollback();
+                replace_all = true;
+            }
+
+            void rollback_wirelength(std::false_type) const noexcept { }
+
             void goto_neighbor(const operation &op) {
                 using std::swap;
                 if (op.type == operation_type::M2) {
@@ -531,54 +858,52 @@ namespace polish {
                 } else {
                     tree.swap_nodes(expr[op.target1], expr[op.target2]);
                     swap(expr[op.target1], expr[op.target2]);
+                    if (op.type == operation_type::M3)
+                        moves.swap_adjacent(op.target1);
                 }
             }
 
             //检查操作合法性，校正并执行操作
+            // Targets are drawn uniformly among legal ones (see MoveIndex):
+            // M1 swaps a leaf with the previous leaf, M2 inverts the chain
+            // from an operator other than the root, M3 swaps a valid
+            // adjacent pair, and M4 rotates a leaf. A type without legal
+            // targets falls back to M1.
             template<typename Eng>
             operation check_valid_and_go(operation_type tp, Eng &&eng) {
                 using std::swap;
+                using rand_type = std::uniform_int_distribution<std::size_t>;
                 operation op;
                 op.type = tp;
-                std::uniform_int_distribution<> rand_int(0, expr.size() - 2);
+                if ((op.type == operation_type::M2 && moves.num_operators() < 2)
+                    || (op.type == operation_type::M3 && !moves.num_m3()))
+                    op.type = operation_type::M1;
 
                 switch (op.type) {
                 case operation_type::M1: {
-                    op.target1 = -1;
-                    while (op.target1 < 0) {
-                        op.target2 = rand_int(eng);
-                        //如果是非叶节点，非法
-                        if (expr[op.target2]->type == combine_type::LEAF) {
-                            //找左边的相邻叶节点，找不到则非法
-                            for (op.target1 = op.target2 - 1; op.target1 >= 0; op.target1--) {
-                                if (expr[op.target1]->type == combine_type::LEAF)
-                                    break;
-                            }
-                        }
-                    }
+                    assert(moves.num_leaves() >= 2);
+                    std::size_t r = rand_type(1, moves.num_leaves() - 1)(eng);
+                    op.target1 = moves.leaf(r - 1);
+                    op.target2 = moves.leaf(r);
                     tree.swap_nodes(expr[op.target1], expr[op.target2]);
                     swap(expr[op.target1], expr[op.target2]);
                     break;
                 } case operation_type::M2: {
-                    //如果是叶节点，非法
-                    do {
-                        op.target1 = rand_int(eng);
-                    } while (expr[op.target1]->type == combine_type::LEAF);
+                    op.target1 = moves.operator_at(
+                        rand_type(0, moves.num_operators() - 2)(eng));
                     tree.invert_chain(expr[op.target1]);
                     break;
                 } case operation_type::M3: {
-                    bool valid = false;
-                    while (!valid) {
-                        op.target1 = rand_int(eng);
-                        op.target2 = op.target1 + 1;
-                        valid = tree.swap_nodes(expr[op.target1], expr[op.target2]);
-                    }
+                    op.target1 = moves.m3(rand_type(0, moves.num_m3() - 1)(eng));
+                    op.target2 = op.target1 + 1;
+                    bool valid = tree.swap_nodes(expr[op.target1], expr[op.target2]);
+                    assert(valid);
+                    (void)valid;
                     swap(expr[op.target1], expr[op.target2]);
+                    moves.swap_adjacent(op.target1);
                     break;
                 } case operation_type::M4: {
-                    do {
-                        op.target1 = rand_int(eng);
-                    } while (expr[op.target1]->type != combine_type::LEAF);
+                    op.target1 = moves.leaf(rand_type(0, moves.num_leaves() - 1)(eng));
                     base::conduct_m4(tree, expr[op.target1]);
                     break;
                 } default: {
@@ -588,17 +913,42 @@ namespace polish {
                 return op;
             }
 
+            // Number of cool-downs from the temperature to ending_temperature,
+            // counted up to limit + 1.
+            std::size_t steps_to_end(std::size_t limit) const noexcept {
+                std::size_t n = 0;
+                for (double t = temperature; t > ending_temperature && n <= limit; ++n)
+                    t = t * (1 - cooldown_ratio) - cooldown_speed;
+                return n;
+            }
+
             template<typename Eng>
             operation_type random_operation(Eng &&eng) const {
-                return base::random_operation(eng, (expr.size() + 1) >> 1);
+                std::size_t sz = (expr.size() + 1) >> 1;
+                if (adaptive && sz > 1)
+                    return static_cast<operation_type>(op_dist(eng));
+                return base::random_operation(eng, sz);
             }
 
             std::vector<const_iterator> expr;
-            tree_type tree, best_tree;
+            detail::MoveIndex moves;    // of expr
+            aureliano::adaptive_discrete_distribution op_dist;  // see set_adaptive
+            bool adaptive = false;
+            tree_type tree;
+            detail::BestTree<tree_type> best_tree;
             double temperature, cooldown_ratio, cooldown_speed, ending_temperature;
             int accept_under_currentT, total_under_currentT, balance_minstep;
-            area_type best_solution;
+            area_type best_solution;   // Area of the best tree
+            double best_cost = std::numeric_limits<double>::infinity();
+            double best_wirelength = 0;
+            double curr_cost = 0;       // Cost of the tree (see take_step)
+            double alpha;
+            incremental_hpwl hpwl;
+            bool replace_all = false;   // see rollback_wirelength
+            bool wirelength;            // Whether alpha applies (see SA())
             std::ostream *os;
+            aureliano::deadline deadline;       // see set_deadline
+            aureliano::deadline::duration temperature_start{};  // Elapsed
         };
 
     }   // namespace v2
@@ -8,17 +8,30 @@
 #include <boost/mpl/list.hpp>
 
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <numeric>
 #include <random>
 #include <sstream>
 #include <string>
 
+#include "curve_kernels.hpp"
+#include "fast_parser.h"
+#include "flat_polish_tree.hpp"
+#include "interpreter.h"
+#include "module.h"
 #include "polish_tree.hpp"
 
+// seqpair has no test binary, so its kernels are tested here.
+#include "../seqpair/bbox_kernels.h"
+
 using namespace std;
 using namespace polish;
 
@@ -26,12 +39,13 @@ using combine_type = typename meta_polish_node::combine_type;
 using dimension_type = typename meta_polish_node::dimension_type;
 using tree_type = polish::polish_tree<>;
 using vtree_type = polish::vectorized_polish_tree<>;
+using flat_tree_type = polish::flat_polish_tree<>;
+using flat_vtree_type = polish::flat_vectorized_polish_tree<>;
+using arena_vtree_type = polish::arena_vectorized_polish_tree<>;
 
 namespace {
 
     std::default_random_engine eng(std::random_device{}());
-    vector<typename tree_type::value_type> buf;
-    vector<typename vtree_type::value_type> vbuf;
 
     template<typename Tree>
     auto get_iter(Tree &&t, std::size_t k) {
@@ -53,23 +67,66 @@ namespace {
         return 2 * prefix_oprerators < i + 1;
     }
 
-    bool test_traversal(const tree_type &t) {
-        buf.assign(t.begin(), t.end());
+    bool same_node(const basic_polish_node &x, const basic_polish_node &y) {
+        return x.type == y.type && x.width == y.width
+            && x.height == y.height;
+    }
+
+    template<typename Alloc>
+    bool same_node(const basic_vectorized_polish_node<Alloc> &x,
+        const basic_vectorized_polish_node<Alloc> &y) {
+        return x.type == y.type && x.points == y.points;
+    }
+
+    bool same_node(const arena_polish_node_view &x,
+        const arena_polish_node_view &y) {
+        return x.type == y.type && x.points == y.points;
+    }
+
+    template<typename Alloc>
+    bool same_node(const basic_vectorized_polish_node<Alloc> &x,
+        const arena_polish_node_view &y) {
+        return x.type == y.type && y.points == x.points;
+    }
+
+    template<typename Alloc>
+    bool same_node(const arena_polish_node_view &x,
+        const basic_vectorized_polish_node<Alloc> &y) {
+        return same_node(y, x);
+    }
+
+    template<typename Tree>
+    bool test_traversal(const Tree &t) {
+        vector<typename Tree::value_type> buf(t.begin(), t.end());
         return std::equal(buf.rbegin(), buf.rend(),
             std::make_reverse_iterator(t.end()),
-            [](const auto &x, const auto &y) {
-            return x.type == y.type && x.width == y.width
-                && x.height == y.height;
-        });
+            [](const auto &x, const auto &y) { return same_node(x, y); });
     }
 
-    bool test_traversal(const vtree_type &t) {
-        vbuf.assign(t.begin(), t.end());
-        return std::equal(vbuf.rbegin(), vbuf.rend(),
-            std::make_reverse_iterator(t.end()),
-            [](const auto &x, const auto &y) {
-            return x.type == y.type && x.points == y.points;
-        });
+    template<typename Tree0, typename Tree1>
+    bool same_tree(const Tree0 &t0, const Tree1 &t1) {
+        return std::equal(t0.begin(), t0.end(), t1.begin(), t1.end(),
+            [](const auto &x, const auto &y) { return same_node(x, y); });
+    }
+
+    // Random expression of sz (odd) leaves and operators, all of module 0.
+    std::vector<expression::polish_expression_type> make_random_expr(size_t sz) {
+        std::vector<expression::polish_expression_type> expr;
+        size_t num_leaves = 0;
+        bernoulli_distribution rand_bool;
+        while (expr.size() != sz) {
+            size_t num_oprs = expr.size() - num_leaves;
+            bool leaf = num_leaves == (sz + 1) / 2 ? false :
+                num_leaves < num_oprs + 2 ? true : rand_bool(eng);
+            if (leaf) {
+                expr.push_back(0);
+                ++num_leaves;
+            } else {
+                expr.push_back(rand_bool(eng) ? expression::COMBINE_HORIZONTAL
+                    : expression::COMBINE_VERTICAL);
+            }
+        }
+        return expr;
     }
 
     template<typename Tree>
@@ -131,7 +188,8 @@ BOOST_AUTO_TEST_CASE(test_ebo) {
     BOOST_TEST(sizeof(tree_type) == sizeof(void *));
 }
 
-using tree_types = boost::mpl::list<tree_type, vtree_type>;
+using tree_types = boost::mpl::list<tree_type, vtree_type,
+    flat_tree_type, flat_vtree_type, arena_vtree_type>;
 
 BOOST_AUTO_TEST_CASE_TEMPLATE(m3_test, Tree, tree_types) {
     std::vector<yal::Module> modules(1);
@@ -197,6 +255,65 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(m3_test, Tree, tree_types) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_move_index) {
+    std::vector<yal::Module> modules(1);
+    std::vector<expression::polish_expression_type> expr(1, 0);
+    for (size_t i = 0; i != 128; ++i) {
+        expr.push_back(0);
+        expr.push_back((i & 1) ? expression::COMBINE_VERTICAL
+            : expression::COMBINE_HORIZONTAL);
+    }
+
+    tree_type t;
+    BOOST_TEST(t.construct(modules, expr));
+    std::vector<tree_type::const_iterator> nodes;
+    for (auto i = t.begin(); i != t.end(); ++i)
+        nodes.push_back(i);
+    polish::v2::detail::MoveIndex moves;
+    moves.assign(nodes.size(), [&](size_t i) {
+        return nodes[i]->type == combine_type::LEAF;
+    });
+
+    for (size_t times = 0; times != 1024; ++times) {
+        BOOST_TEST(moves.num_leaves() == 129);
+        BOOST_TEST(moves.num_operators() == 128);
+        for (size_t r = 0; r != moves.num_leaves(); ++r)
+            BOOST_TEST((nodes[moves.leaf(r)]->type == combine_type::LEAF));
+        size_t m3 = 0;
+        for (size_t i = 0; i + 1 != nodes.size(); ++i)
+            m3 += is_m3_valid(t, i);
+        BOOST_TEST(moves.num_m3() == m3);
+        for (size_t k = 0; k != moves.num_m3(); ++k)
+            BOOST_TEST(is_m3_valid(t, moves.m3(k)));
+
+        auto i = moves.m3(uniform_int_distribution<size_t>(0, moves.num_m3() - 1)(eng));
+        BOOST_TEST(t.swap_nodes(nodes[i], nodes[i + 1]));
+        std::swap(nodes[i], nodes[i + 1]);
+        moves.swap_adjacent(i);
+    }
+    BOOST_TEST(t.check_integrity());
+}
+
+BOOST_AUTO_TEST_CASE(test_adaptive_distribution) {
+    vector<double> weights = { 1, 0, 1, 2 };
+    aureliano::adaptive_discrete_distribution dist(weights.begin(), weights.end());
+    BOOST_TEST(dist.probability(3) == 0.5);
+
+    // Arm 2 is always accepted, arms 0 and 3 never.
+    for (size_t epoch = 0; epoch != 16; ++epoch) {
+        for (size_t i = 0; i != 256; ++i) {
+            auto k = dist(eng);
+            BOOST_TEST(k != 1);
+            dist.feedback(k, k == 2, 1.0);
+        }
+        dist.update();
+    }
+    BOOST_TEST(dist.probability(1) == 0);
+    BOOST_TEST(dist.probability(2) > 0.85);
+    BOOST_TEST(dist.probability(0) >= 0.1 / 3);
+    BOOST_TEST(dist.probability(3) >= 0.1 / 3);
+}
+
 BOOST_FIXTURE_TEST_CASE(test_tree_rotate_leaf, BasicFixture) {
     tree_type tree;
     tree.construct(modules, expr);
@@ -216,6 +333,315 @@ BOOST_FIXTURE_TEST_CASE(test_tree_rotate_leaf, BasicFixture) {
     BOOST_TEST((!tree.rotate_leaf(tree.end())));
 }
 
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_batched_update, Tree, tree_types) {
+    std::vector<yal::Module> modules(32);
+    uniform_int_distribution<dimension_type> rand_dim(1, 64);
+    for (auto &m : modules) {
+        m.xpos = { 0, rand_dim(eng) };
+        m.ypos = { 0, rand_dim(eng) };
+    }
+    vector<size_t> indices(modules.size());
+    iota(indices.begin(), indices.end(), 0);
+    auto dump = [](const Tree &t) {
+        ostringstream os;
+        t.print_tree(os);
+        return os.str();
+    };
+    uniform_int_distribution<size_t> rand_idx(0, 2 * modules.size() - 3),
+        rand_moves(1, 4);
+
+    Tree batched, eager;
+    for (size_t cnt = 0; cnt != 64; ++cnt) {
+        if (cnt % 16 == 0) {
+            BOOST_TEST((batched.construct(modules.begin(),
+                indices.begin(), indices.end(), eng)));
+            eager = batched;
+        }
+        batched.begin_update();
+        BOOST_TEST(batched.is_updating());
+        for (size_t k = rand_moves(eng); k; --k) {
+            size_t i = rand_idx(eng), j = rand_idx(eng) + 1;
+            if (get_iter(eager, i)->type != combine_type::LEAF) {
+                BOOST_TEST(eager.invert_chain(get_iter(eager, i)));
+                BOOST_TEST(batched.invert_chain(get_iter(batched, i)));
+            } else {
+                // M1 if j is a leaf, otherwise M3 if valid
+                if (get_iter(eager, j)->type != combine_type::LEAF)
+                    j = i + 1;
+                else if (j <= i)
+                    continue;
+                bool valid = eager.swap_nodes(get_iter(eager, i), get_iter(eager, j));
+                BOOST_TEST((batched.swap_nodes(get_iter(batched, i),
+                    get_iter(batched, j)) == valid));
+            }
+        }
+        batched.end_update();
+        BOOST_TEST(!batched.is_updating());
+        BOOST_TEST(batched.check_integrity());
+        BOOST_TEST((dump(batched) == dump(eager)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_aborted_update, Tree, tree_types) {
+    std::vector<yal::Module> modules(32);
+    uniform_int_distribution<dimension_type> rand_dim(1, 64);
+    for (auto &m : modules) {
+        m.xpos = { 0, rand_dim(eng) };
+        m.ypos = { 0, rand_dim(eng) };
+    }
+    vector<size_t> indices(modules.size());
+    iota(indices.begin(), indices.end(), 0);
+    auto dump = [](const Tree &t) {
+        ostringstream os;
+        t.print_tree(os);
+        return os.str();
+    };
+    uniform_int_distribution<size_t> rand_idx(0, 2 * modules.size() - 3);
+
+    Tree t;
+    BOOST_TEST((t.construct(modules.begin(), indices.begin(), indices.end(), eng)));
+    for (size_t cnt = 0; cnt != 64; ++cnt) {
+        auto before = dump(t);
+        size_t i = rand_idx(eng), j = i + 1;
+        bool m2 = get_iter(t, i)->type != combine_type::LEAF;
+        if (!m2 && (get_iter(t, j)->type == combine_type::LEAF
+            || !is_m3_valid(t, i)))
+            continue;
+
+        // Give up at the first node recounted, unless it is the root.
+        t.begin_update();
+        BOOST_TEST((m2 ? t.invert_chain(get_iter(t, i))
+            : t.swap_nodes(get_iter(t, i), get_iter(t, j))));
+        size_t recounted = 0;
+        bool done = t.end_update_unless([&](auto) { return ++recounted; });
+        BOOST_TEST(recounted == 1);
+        BOOST_TEST(done != t.is_updating());
+
+        BOOST_TEST((m2 ? t.invert_chain(get_iter(t, i))
+            : t.swap_nodes(get_iter(t, i), get_iter(t, j))));
+        if (t.is_updating())
+            t.end_update();
+        BOOST_TEST(t.check_integrity());
+        BOOST_TEST((dump(t) == before));
+    }
+}
+
+using snapshot_tree_types = boost::mpl::list<tree_type, vtree_type>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_snapshot, Tree, snapshot_tree_types) {
+    std::vector<yal::Module> modules(32);
+    uniform_int_distribution<dimension_type> rand_dim(1, 64);
+    for (auto &m : modules) {
+        m.xpos = { 0, rand_dim(eng) };
+        m.ypos = { 0, rand_dim(eng) };
+    }
+    vector<size_t> indices(modules.size());
+    iota(indices.begin(), indices.end(), 0);
+    auto dump = [](const Tree &t) {
+        ostringstream os;
+        t.print_tree(os);
+        return os.str();
+    };
+    uniform_int_distribution<size_t> rand_idx(0, 2 * modules.size() - 3);
+
+    Tree tree, restored;
+    BOOST_TEST((tree.construct(modules.begin(),
+        indices.begin(), indices.end(), eng)));
+    vector<typename Tree::snapshot_type> snapshots;
+    vector<string> expected;
+    for (size_t cnt = 0; cnt != 64; ++cnt) {
+        size_t i = rand_idx(eng);
+        if (get_iter(tree, i)->type != combine_type::LEAF)
+            tree.invert_chain(get_iter(tree, i));
+        else
+            tree.swap_nodes(get_iter(tree, i), get_iter(tree, i + 1));
+        if (cnt % 4 == 0)
+            tree.shuffle(eng);
+        snapshots.push_back(tree.snapshot());
+        expected.push_back(dump(tree));
+    }
+    for (size_t k = 0; k != snapshots.size(); ++k) {
+        restored.restore(snapshots[k]);
+        BOOST_TEST(restored.check_integrity());
+        BOOST_TEST((dump(restored) == expected[k]));
+    }
+
+    // Snapshots of a restored tree or its copies share its nodes
+    Tree copy(restored);
+    copy.invert_chain(copy.root());
+    copy.invert_chain(copy.root());
+    restored.restore(copy.snapshot());
+    BOOST_TEST((dump(restored) == expected.back()));
+    restored.restore(typename Tree::snapshot_type());
+    BOOST_TEST(restored.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_snapshot_recount) {
+    std::vector<yal::Module> modules(32);
+    uniform_int_distribution<dimension_type> rand_dim(1, 64);
+    for (auto &m : modules) {
+        m.xpos = { 0, rand_dim(eng) };
+        m.ypos = { 0, rand_dim(eng) };
+    }
+    vector<size_t> indices(modules.size());
+    iota(indices.begin(), indices.end(), 0);
+
+    // Recounting every curve makes the copies of the last snapshot stale.
+    vtree_type tree, restored;
+    auto root = [](const vtree_type &t) { return std::prev(t.end()); };
+    BOOST_TEST((tree.construct(modules.begin(),
+        indices.begin(), indices.end(), eng)));
+    while (root(tree)->points.size() <= 3)    // So that the limit cuts it
+        tree.shuffle(eng);
+    restored.restore(tree.snapshot());
+    auto num_points = root(tree)->points.size();
+    tree.set_curve_limit(3);
+    BOOST_TEST((root(tree)->points.size() < num_points));
+    restored.restore(tree.snapshot());
+    BOOST_TEST(restored.check_integrity());
+    BOOST_TEST((root(restored)->points == root(tree)->points));
+
+    tree.set_record_sources(true);
+    restored.restore(tree.snapshot());
+    BOOST_TEST(root(restored)->points.has_sources());
+    tree.set_curve_limit(0);
+    restored.restore(tree.snapshot());
+    BOOST_TEST((root(restored)->points.size() == num_points));
+    BOOST_TEST((root(restored)->points == root(tree)->points));
+}
+
+namespace {
+
+    using place_list = vector<array<dimension_type, 4>>;
+
+    // Places of modules by id, from floorplan().
+    place_list floorplan_by_id(const tree_type &t) {
+        vector<typename tree_type::floorplan_entry> result;
+        t.floorplan(back_inserter(result));
+        place_list places(result.size());
+        auto it = t.begin();
+        for (auto &&e : result) {
+            while (it->type != combine_type::LEAF)
+                ++it;
+            places.at(it->id) = { e.first, e.second, it->width, it->height };
+            ++it;
+        }
+        return places;
+    }
+
+    place_list floorplan_by_id(const vtree_type &t) {
+        vector<typename vtree_type::floorplan_entry> result;
+        t.floorplan(SA<vtree_type>::get_best_point(t), back_inserter(result));
+        place_list places(result.size());
+        auto it = t.begin();
+        for (auto &&e : result) {
+            while (it->type != combine_type::LEAF)
+                ++it;
+            places.at(it->id) = { get<0>(e), get<1>(e), get<2>(e), get<3>(e) };
+            ++it;
+        }
+        return places;
+    }
+
+    template<typename F>
+    void update_floorplan(tree_type &t, F &&f, bool all) {
+        t.update_floorplan(f, all);
+    }
+
+    template<typename F>
+    void update_floorplan(vtree_type &t, F &&f, bool all) {
+        t.update_floorplan(SA<vtree_type>::get_best_point(t), f, all);
+    }
+
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_update_floorplan, Tree, snapshot_tree_types) {
+    std::vector<yal::Module> modules(32);
+    uniform_int_distribution<dimension_type> rand_dim(1, 64);
+    for (auto &m : modules) {
+        m.xpos = { 0, rand_dim(eng) };
+        m.ypos = { 0, rand_dim(eng) };
+    }
+    vector<size_t> indices(modules.size());
+    iota(indices.begin(), indices.end(), 0);
+    uniform_int_distribution<size_t> rand_idx(0, 2 * modules.size() - 3);
+
+    // Random nets of 2 to 6 pins anywhere on their modules.
+    vector<size_t> net_offsets{ 0 }, pin_modules;
+    vector<int> pin_x, pin_y, widths, heights;
+    for (auto &m : modules) {
+        widths.push_back(m.xspan());
+        heights.push_back(m.yspan());
+    }
+    uniform_int_distribution<size_t> rand_module(0, modules.size() - 1),
+        rand_pins(2, 6);
+    for (size_t net = 0; net != 48; ++net) {
+        for (size_t k = rand_pins(eng); k; --k) {
+            size_t m = rand_module(eng);
+            pin_modules.push_back(m);
+            pin_x.push_back(uniform_int_distribution<>(0, widths[m])(eng));
+            pin_y.push_back(uniform_int_distribution<>(0, heights[m])(eng));
+        }
+        net_offsets.push_back(pin_modules.size());
+    }
+    incremental_hpwl hpwl(net_offsets, pin_modules, pin_x, pin_y, widths, heights);
+
+    Tree tree;
+    BOOST_TEST((tree.construct(modules.begin(), indices.begin(), indices.end(), eng)));
+    place_list places(modules.size());
+    size_t reported = 0;
+    auto place = [&](uint32_t id, dimension_type x, dimension_type y,
+        dimension_type w, dimension_type h) {
+        places.at(id) = { x, y, w, h };
+        hpwl.place(id, x, y, w, h);
+        ++reported;
+    };
+    update_floorplan(tree, place, true);
+    BOOST_TEST(reported == modules.size());
+
+    typename Tree::snapshot_type snapshot = tree.snapshot();
+    for (size_t cnt = 0; cnt != 256; ++cnt) {
+        size_t i = rand_idx(eng);
+        if (cnt % 32 == 31) {
+            tree.restore(snapshot);
+        } else if (cnt % 16 == 15) {
+            tree.shuffle(eng);
+        } else if (get_iter(tree, i)->type != combine_type::LEAF) {
+            tree.invert_chain(get_iter(tree, i));
+        } else {
+            tree.begin_update();
+            tree.swap_nodes(get_iter(tree, i), get_iter(tree, i + 1));
+            tree.end_update();
+        }
+        if (cnt % 8 == 0)
+            snapshot = tree.snapshot();
+        update_floorplan(tree, place, false);
+        BOOST_TEST((places == floorplan_by_id(tree)));
+        BOOST_TEST(hpwl.update() == hpwl.evaluate());
+
+        // Nothing moved since
+        reported = 0;
+        update_floorplan(tree, place, false);
+        BOOST_TEST(reported == 0);
+
+        // Placements rolled back, counted or not, leave no trace
+        hpwl.commit();
+        double wire = hpwl.value();
+        hpwl.place(0, 1, 2, widths[0], heights[0]);
+        hpwl.update();
+        hpwl.place(1, 3, 4, heights[1], widths[1]);
+        hpwl.rollback();
+        BOOST_TEST(hpwl.value() == wire);
+        BOOST_TEST(hpwl.evaluate() == wire);
+    }
+
+    // A fresh count of the last placement
+    incremental_hpwl fresh(net_offsets, pin_modules, pin_x, pin_y, widths, heights);
+    for (size_t m = 0; m != places.size(); ++m)
+        fresh.place(m, places[m][0], places[m][1], places[m][2], places[m][3]);
+    BOOST_TEST(fresh.update() == hpwl.value());
+}
+
 BOOST_AUTO_TEST_CASE(test_curve) {
     std::allocator<typename polish::meta_polish_node::coord_type> alloc;
     polish::basic_vectorized_polish_node<> p(combine_type::VERTICAL, alloc),
@@ -234,6 +660,209 @@ BOOST_AUTO_TEST_CASE(test_curve) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_curve_kernels) {
+    using node_type = polish::basic_vectorized_polish_node<>;
+    std::allocator<typename polish::meta_polish_node::coord_type> alloc;
+    node_type p(combine_type::VERTICAL, alloc), expected(combine_type::VERTICAL, alloc),
+        lc(combine_type::LEAF, alloc), rc(combine_type::LEAF, alloc);
+    expected.points.record_sources(true);
+    uniform_int_distribution<size_t> rand_size(1, 40);
+    uniform_int_distribution<dimension_type> rand_step(1, 3);
+    auto make_curve = [&](node_type &t) {
+        t.points.clear();
+        dimension_type w = rand_step(eng) - 1, h = 0;
+        auto n = rand_size(eng);
+        vector<dimension_type> heights;
+        for (size_t i = 0; i != n; ++i)
+            heights.push_back(h += rand_step(eng) - (i ? 0 : 1));
+        for (size_t i = 0; i != n; ++i) {
+            t.points.emplace_back(w, heights[n - 1 - i]);
+            w += rand_step(eng);
+        }
+    };
+    combine_type types[2] = { combine_type::VERTICAL, combine_type::HORIZONTAL };
+    vector<polish::curve_isa> isas;
+    for (auto isa : { polish::curve_isa::PORTABLE, polish::curve_isa::SSE41,
+        polish::curve_isa::AVX2 })
+        if (polish::is_curve_isa_supported(isa))
+            isas.push_back(isa);
+
+    for (size_t cnt = 0; cnt != 256; ++cnt) {
+        make_curve(lc);
+        make_curve(rc);
+        for (auto type : types) {
+            p.type = expected.type = type;
+            expected.count_area_reference(lc, rc);
+            p.points.record_sources(false);
+            p.count_area(lc, rc);
+            BOOST_TEST((p.check_area(lc, rc)));
+            p.points.record_sources(true);
+            p.count_area(lc, rc);
+            BOOST_TEST((p.check_area(lc, rc)));
+            for (auto isa : isas) {
+                auto &kernels = polish::get_curve_kernels(isa);
+                auto merge = type == combine_type::VERTICAL ?
+                    kernels.merge_vertical : kernels.merge_horizontal;
+                p.points.resize(lc.points.size() + rc.points.size());
+                p.points.resize(merge(lc.points.widths(), lc.points.heights(),
+                    lc.points.size(), rc.points.widths(), rc.points.heights(),
+                    rc.points.size(), p.points.widths(), p.points.heights()));
+                BOOST_TEST((p.points == expected.points), polish::to_string(isa));
+
+                auto merge_sources = type == combine_type::VERTICAL ?
+                    kernels.merge_vertical_sources : kernels.merge_horizontal_sources;
+                p.points.resize(lc.points.size() + rc.points.size());
+                p.points.resize(merge_sources(lc.points.widths(),
+                    lc.points.heights(), lc.points.size(), rc.points.widths(),
+                    rc.points.heights(), rc.points.size(), p.points.widths(),
+                    p.points.heights(), p.points.left_sources(),
+                    p.points.right_sources()));
+                auto n = expected.points.size();
+                BOOST_TEST((p.points == expected.points), polish::to_string(isa));
+                BOOST_TEST((std::equal(p.points.left_sources(),
+                    p.points.left_sources() + n, expected.points.left_sources())),
+                    polish::to_string(isa));
+                BOOST_TEST((std::equal(p.points.right_sources(),
+                    p.points.right_sources() + n, expected.points.right_sources())),
+                    polish::to_string(isa));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_bbox_kernels) {
+    // Lengths up to 5 vectors of the widest isa, from unaligned starts, so
+    // that the last loads overlap the previous ones by every amount.
+    vector<seqpair::bbox_isa> isas;
+    for (auto isa : { seqpair::bbox_isa::PORTABLE, seqpair::bbox_isa::SSE41,
+        seqpair::bbox_isa::AVX2 })
+        if (seqpair::is_bbox_isa_supported(isa))
+            isas.push_back(isa);
+    uniform_int_distribution<int32_t> rand_coord(-100, 100);
+    vector<int32_t> xs(48), ys(48);
+
+    for (size_t cnt = 0; cnt != 16; ++cnt) {
+        for (size_t n = 1; n <= 40; ++n) {
+            for (size_t first = 0; first != 4; ++first) {
+                auto x = xs.data() + first, y = ys.data() + first;
+                generate(x, x + n, [&]() { return rand_coord(eng); });
+                generate(y, y + n, [&]() { return rand_coord(eng); });
+                // Extremes at the end are only read by the last load.
+                auto k = cnt & 1 ? n - 1 : uniform_int_distribution<size_t>(0, n - 1)(eng);
+                x[k] = cnt & 2 ? numeric_limits<int32_t>::max() : 1000;
+                y[k] = cnt & 2 ? numeric_limits<int32_t>::min() : -1000;
+
+                auto xr = minmax_element(x, x + n), yr = minmax_element(y, y + n);
+                array<int32_t, 4> expected{ *xr.first, *xr.second, *yr.first, *yr.second };
+                for (auto isa : isas) {
+                    array<int32_t, 4> box{};
+                    seqpair::get_bbox_kernels(isa).bbox(x, y, n, box.data());
+                    BOOST_TEST((box == expected), seqpair::to_string(isa) << " n=" << n);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_curve_limit) {
+    using node_type = polish::basic_vectorized_polish_node<>;
+    std::allocator<typename polish::meta_polish_node::coord_type> alloc;
+    node_type p(combine_type::VERTICAL, alloc), p2(combine_type::VERTICAL, alloc),
+        lc(combine_type::LEAF, alloc), rc(combine_type::LEAF, alloc);
+    for (dimension_type i = 0; i != 32; ++i) {
+        lc.points.emplace_back(10 + 3 * i, 200 - 5 * i);
+        rc.points.emplace_back(20 + 2 * i, 150 - 4 * i);
+    }
+    p.max_points = 5;
+    combine_type types[2] = { combine_type::VERTICAL, combine_type::HORIZONTAL };
+    auto min_area = [](const node_type &t) {
+        int64_t area = std::numeric_limits<int64_t>::max();
+        for (auto &&e : t.points)
+            area = std::min(area, static_cast<int64_t>(e.first) * e.second);
+        return area;
+    };
+
+    for (size_t i = 0; i != 2; ++i) {
+        p.type = p2.type = types[i];
+        p.count_area(lc, rc);
+        p2.count_area(lc, rc);
+        BOOST_TEST((p2.points.size() > 5 && p.points.size() <= 5));
+        BOOST_TEST((p.points.front() == p2.points.front()));
+        BOOST_TEST((p.points.back() == p2.points.back()));
+        BOOST_TEST((min_area(p) == min_area(p2)));
+        BOOST_TEST((p.check_area(lc, rc)));
+    }
+}
+
+using vtree_types = boost::mpl::list<vtree_type, flat_vtree_type,
+    arena_vtree_type>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_tree_curve_limit, Tree, vtree_types) {
+    std::vector<yal::Module> modules(24);
+    uniform_int_distribution<dimension_type> rand_dim(1, 64);
+    for (auto &m : modules) {
+        m.xpos = { 0, rand_dim(eng) };
+        m.ypos = { 0, rand_dim(eng) };
+    }
+    vector<size_t> indices(modules.size());
+    iota(indices.begin(), indices.end(), 0);
+
+    Tree tree;
+    for (size_t cnt = 0; cnt != 8; ++cnt) {
+        BOOST_TEST((tree.construct(modules.begin(),
+            indices.begin(), indices.end(), eng)));
+        tree.set_curve_limit(4);
+        BOOST_TEST((tree.check_integrity()));
+        BOOST_TEST((std::all_of(tree.begin(), tree.end(),
+            [](const auto &n) { return n.points.size() <= 4; })));
+        auto root = std::prev(tree.end());
+        vector<typename Tree::floorplan_entry> result;
+        for (size_t i = 0; i != root->points.size(); ++i) {
+            result.clear();
+            tree.floorplan(i, std::back_inserter(result));
+            BOOST_TEST((result.size() == modules.size()));
+            BOOST_TEST(check_intersection(result.cbegin(), result.cend()));
+        }
+        tree.set_curve_limit(0);
+        BOOST_TEST((tree.check_integrity()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_tree_record_sources, Tree, vtree_types) {
+    std::vector<yal::Module> modules(24);
+    uniform_int_distribution<dimension_type> rand_dim(1, 64);
+    for (auto &m : modules) {
+        m.xpos = { 0, rand_dim(eng) };
+        m.ypos = { 0, rand_dim(eng) };
+    }
+    vector<size_t> indices(modules.size());
+    iota(indices.begin(), indices.end(), 0);
+    auto floorplans = [](const Tree &tree) {
+        vector<vector<typename Tree::floorplan_entry>> result;
+        auto root = std::prev(tree.end());
+        for (size_t i = 0; i != (*root).points.size(); ++i) {
+            result.emplace_back();
+            tree.floorplan(i, std::back_inserter(result.back()));
+        }
+        return result;
+    };
+
+    Tree tree;
+    for (size_t cnt = 0; cnt != 8; ++cnt) {
+        BOOST_TEST((tree.construct(modules.begin(),
+            indices.begin(), indices.end(), eng)));
+        tree.set_curve_limit(cnt % 2 ? 4 : 0);
+        auto expected = floorplans(tree);
+        tree.set_record_sources(true);
+        BOOST_TEST((tree.check_integrity()));
+        BOOST_TEST((floorplans(tree) == expected));
+        Tree copy(tree);
+        BOOST_TEST((floorplans(copy) == expected));
+        tree.set_record_sources(false);
+        BOOST_TEST((floorplans(tree) == expected));
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(test_tree_floorplan, BasicFixture) {
     tree_type tree;
     tree.construct(modules, expr);
@@ -311,4 +940,286 @@ BOOST_FIXTURE_TEST_CASE(test_tree_assign, BasicFixture) {
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(test_flat_tree_floorplan, BasicFixture) {
+    flat_tree_type tree;
+    tree.construct(modules, expr);
+    vector<typename flat_tree_type::floorplan_entry> result, expected;
+    expected = { {0, 0}, {30, 0}, {0, 20}, {0, 40}, {30, 20}, {30, 40} };
+    tree.floorplan(std::back_inserter(result));
+    BOOST_TEST((result == expected));
+
+    flat_vtree_type vtree;
+    vtree.construct(modules, expr);
+    auto root = std::prev(vtree.end());
+    decltype(root->points) expected_points = { {40, 90}, {60, 60} };
+    BOOST_TEST((root->points == expected_points));
+    vector<typename flat_vtree_type::floorplan_entry> vresult;
+    for (size_t i = 0; i != root->points.size(); ++i) {
+        vresult.clear();
+        vtree.floorplan(i, std::back_inserter(vresult));
+        BOOST_TEST(check_intersection(vresult.cbegin(), vresult.cend()));
+    }
+}
+
+using flat_tree_pairs = boost::mpl::list<
+    std::pair<tree_type, flat_tree_type>,
+    std::pair<vtree_type, flat_vtree_type>,
+    std::pair<vtree_type, arena_vtree_type>>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_flat_tree_equivalence, Pair, flat_tree_pairs) {
+    using tree_t = typename Pair::first_type;
+    using flat_tree_t = typename Pair::second_type;
+    std::vector<yal::Module> modules(3);
+    for (size_t i = 0; i != modules.size(); ++i) {
+        modules[i].xpos = { 0, static_cast<dimension_type>(10 + i) };
+        modules[i].ypos = { 0, static_cast<dimension_type>(20 - 3 * i) };
+    }
+    uniform_int_distribution<size_t> rand_size(1, 128);
+
+    for (size_t cnt = 0; cnt != 8; ++cnt) {
+        auto expr = make_random_expr(2 * rand_size(eng) + 1);
+        uniform_int_distribution<size_t> rand_module(0, modules.size() - 1);
+        for (auto &e : expr)
+            if (e >= 0)
+                e = rand_module(eng);
+
+        tree_t t;
+        flat_tree_t ft;
+        BOOST_TEST(t.construct(modules, expr));
+        BOOST_TEST(ft.construct(modules, expr));
+        BOOST_TEST(ft.check_integrity());
+        BOOST_TEST(same_tree(t, ft));
+
+        // Same operations at the same post-order positions.
+        uniform_int_distribution<size_t> rand(0, expr.size() - 2);
+        for (size_t step = 0; step != 512; ++step) {
+            auto idx = rand(eng);
+            bool r0, r1;
+            if (step & 1) {
+                r0 = t.invert_chain(get_iter(t, idx));
+                r1 = ft.invert_chain(get_iter(ft, idx));
+            } else {
+                r0 = t.swap_nodes(get_iter(t, idx), get_iter(t, idx + 1));
+                r1 = ft.swap_nodes(get_iter(ft, idx), get_iter(ft, idx + 1));
+            }
+            BOOST_TEST(r0 == r1);
+        }
+        BOOST_TEST(ft.check_integrity());
+        BOOST_TEST(test_traversal(ft));
+        BOOST_TEST(same_tree(t, ft));
+
+        // Copies are independent.
+        auto ft2 = ft;
+        BOOST_TEST(same_tree(ft, ft2));
+        ft2.shuffle(eng);
+        BOOST_TEST(ft2.check_integrity());
+        ft2 = ft;
+        BOOST_TEST(same_tree(ft2, t));
+        flat_tree_t ft3;
+        vector<typename flat_tree_t::const_iterator> iters;
+        for (auto i = ft.begin(); i != ft.end(); ++i)
+            iters.push_back(i);
+        BOOST_TEST(ft3.assign(iters.cbegin(), iters.cend()));
+        BOOST_TEST(same_tree(ft3, t));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_curve_arena) {
+    struct node {
+        uint32_t offset, size, capacity;
+    };
+    curve_arena<> arena;
+    vector<node> nodes;
+    for (uint32_t n = 1; n != 9; ++n) {
+        nodes.push_back({ static_cast<uint32_t>(arena.allocate(n + 1)), n, n + 1 });
+        for (uint32_t i = 0; i != n; ++i) {
+            arena.widths()[nodes.back().offset + i] = static_cast<dimension_type>(n);
+            arena.heights()[nodes.back().offset + i] = -static_cast<dimension_type>(i);
+        }
+    }
+    BOOST_TEST((arena.size() == 44 && arena.live() == 44));
+
+    // The top slot is reused at once, others stay dead.
+    arena.deallocate(nodes.back().offset, nodes.back().capacity);
+    BOOST_TEST((arena.size() == 35 && arena.live() == 35));
+    nodes.pop_back();
+    arena.deallocate(nodes[2].offset, nodes[2].capacity);
+    nodes.erase(nodes.begin() + 2);
+    BOOST_TEST((arena.size() == 35 && arena.live() == 31));
+
+    auto copy = arena;
+    auto capacity = arena.capacity();
+    arena.reserve(nodes.begin(), nodes.end(), capacity);
+    BOOST_TEST((arena.size() == 31 && arena.live() == 31));
+    BOOST_TEST((arena.capacity() >= 2 * (31 + capacity)));
+    uint32_t offset = 0;
+    for (auto &&e : nodes) {
+        BOOST_TEST((e.offset == offset));
+        offset += e.capacity;
+        for (uint32_t i = 0; i != e.size; ++i) {
+            BOOST_TEST((arena.widths()[e.offset + i] == static_cast<dimension_type>(e.size)));
+            BOOST_TEST((arena.heights()[e.offset + i] == -static_cast<dimension_type>(i)));
+        }
+    }
+    BOOST_TEST((copy.size() == 35 && copy.live() == 31));
+    BOOST_TEST((copy.widths()[35 - 8] == 7));
+}
+
+BOOST_FIXTURE_TEST_CASE(test_flat_tree_random_construct, BasicFixture) {
+    flat_tree_type tree;
+    vector<size_t> indices(modules.size());
+    iota(indices.begin(), indices.end(), 0);
+    for (size_t i = 0; i != 16; ++i) {
+        if (i & 1)
+            tree.shuffle(eng);
+        else
+            BOOST_TEST((tree.construct(modules.begin(),
+                indices.begin(), indices.end(), eng)));
+        BOOST_TEST((tree.check_integrity()));
+        BOOST_TEST((test_traversal(tree)));
+        BOOST_TEST((static_cast<std::size_t>(std::distance(tree.begin(),
+            tree.end())) == 2 * modules.size() - 1));
+        BOOST_TEST((test_normalized(tree)));
+    }
+    tree.clear();
+    BOOST_TEST((tree.empty() && tree.begin() == tree.end()));
+}
+
+BOOST_FIXTURE_TEST_CASE(test_flat_tree_rotate_leaf, BasicFixture) {
+    flat_tree_type tree;
+    tree.construct(modules, expr);
+
+    auto root = std::prev(tree.end());
+    auto w = root->width, h = root->height;
+    for (auto i = tree.begin(); i != tree.end(); ++i) {
+        if (i->type != combine_type::LEAF) {
+            BOOST_TEST((!tree.rotate_leaf(i)));
+            continue;
+        }
+        BOOST_TEST(tree.rotate_leaf(i));
+        BOOST_TEST(tree.rotate_leaf(i));
+        BOOST_TEST((w == root->width && h == root->height));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(test_yal)
+
+namespace {
+
+    // Keywords as names, comments, the forms of numbers the scanner tells
+    // apart, optional CURRENT and VOLTAGE, and integers as signals.
+    const std::string sample_yal = R"(/* BBL file
+ * sample */
+MODULE bk1; // comment
+ TYPE GENERAL;
+ DIMENSIONS 0 0 0 120 +80 120 80 -0;
+ IOLIST;
+  PAD B 0 60 1 METAL2 CURRENT 50.000;
+  P_1 PWR 40 120 1 METAL1 CURRENT 5 VOLTAGE -1.5e1;
+  GND GND 40 0 1 POLY VOLTAGE .5;
+  F F 80 60 2 PDIFF;
+ ENDIOLIST;
+ENDMODULE;
+MODULE pad;
+ TYPE PAD;
+ IOLIST;
+  P PI 0 0 1 NDIFF;
+ ENDIOLIST;
+ENDMODULE;
+MODULE top;
+ TYPE PARENT;
+ DIMENSIONS 0 0 0 500 500 500 500 0;
+ IOLIST;
+  IN PI 0 250 1 METAL1;
+ ENDIOLIST;
+ NETWORK;
+  C_0 bk1 n1 VDD 0 METAL1;
+  C_1 bk1 n1 VDD -7
+    n2;
+  C_2 pad IN;
+ ENDNETWORK;
+ENDMODULE;
+)";
+
+    bool same_value(double x, double y) {
+        return x == y || (std::isnan(x) && std::isnan(y));
+    }
+
+    bool same_signal(const yal::Signal &a, const yal::Signal &b) {
+        return a.name == b.name && a.terminal_type == b.terminal_type
+            && a.xpos == b.xpos && a.ypos == b.ypos && a.width == b.width
+            && a.layer_type == b.layer_type && same_value(a.current, b.current)
+            && same_value(a.voltage, b.voltage);
+    }
+
+    bool same_module(const yal::Module &a, const yal::Module &b) {
+        return a.name == b.name && a.type == b.type && a.xpos == b.xpos
+            && a.ypos == b.ypos && std::equal(a.iolist.begin(), a.iolist.end(),
+                b.iolist.begin(), b.iolist.end(), same_signal);
+    }
+
+    bool same_modules(const yal::Interpreter &a, const yal::Interpreter &b) {
+        return std::equal(a.modules().begin(), a.modules().end(),
+            b.modules().begin(), b.modules().end(), same_module)
+            && same_module(a.parent_module(), b.parent_module())
+            && a.parent_module().network == b.parent_module().network;
+    }
+
+    void fast_parse(yal::Interpreter &interpreter, const std::string &text) {
+        yal::FastParser(interpreter).parse(text.data(), text.data() + text.size());
+    }
+
+}
+
+BOOST_AUTO_TEST_CASE(test_fast_parser) {
+    yal::Interpreter expected, in_memory, mapped;
+    std::istringstream in(sample_yal);
+    expected.switch_input_stream(in);
+    BOOST_TEST(expected.parse());
+    BOOST_TEST((expected.modules().size() == 2));
+    BOOST_TEST((expected.parent_module().network.size() == 3));
+
+    fast_parse(in_memory, sample_yal);
+    BOOST_TEST((same_modules(expected, in_memory)));
+
+    const char *path = "test_fast_parser.yal";
+    std::ofstream(path, std::ios::binary) << sample_yal;
+    mapped.parse_file(path);
+    std::remove(path);
+    BOOST_TEST((same_modules(expected, mapped)));
+    BOOST_CHECK_THROW(mapped.parse_file(path), std::runtime_error);
+
+    const auto &signals = yal::ParentModule::get_signal_names(
+        mapped.parent_module().network[1]);
+    BOOST_TEST((signals == std::vector<std::string>{ "n1", "VDD", "-7", "n2" }));
+    BOOST_TEST((mapped.modules()[0].iolist[2].voltage == 0.5));
+}
+
+BOOST_AUTO_TEST_CASE(test_fast_parser_errors) {
+    // Text, and line, first and past the last column of the error.
+    const std::tuple<std::string, int, int, int> cases[] = {
+        std::make_tuple("MODULE a;\n TYPE GENERAL;\n DIMENSIONS 0 0 007 0;", 3, 17, 20),
+        std::make_tuple("MODULE a;\n TYPE GENERAL;\n/* open", 3, 1, 3),
+        std::make_tuple("MODULE a; TYPE GENERAL; $", 1, 25, 26),
+        std::make_tuple("MODULE a; TYPE BLOCK;", 1, 16, 21),
+        std::make_tuple("MODULE a; TYPE PAD; DIMENSIONS 1;", 1, 33, 34),
+        std::make_tuple("MODULE a; TYPE PAD;", 1, 20, 20),
+        std::make_tuple("MODULE a; TYPE PAD; DIMENSIONS 9999999999 0;", 1, 32, 42)
+    };
+    for (const auto &c : cases) {
+        yal::Interpreter interpreter;
+        try {
+            fast_parse(interpreter, std::get<0>(c));
+            BOOST_ERROR("No error in: " << std::get<0>(c));
+        } catch (const yal::Parser::syntax_error &e) {
+            BOOST_TEST((static_cast<int>(e.location.begin.line) == std::get<1>(c)
+                && static_cast<int>(e.location.begin.column) == std::get<2>(c)
+                && static_cast<int>(e.location.end.column) == std::get<3>(c)),
+                std::get<0>(c) << ": " << e.location << ": " << e.what());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,17 @@
+//  wirelength.hpp
+
+#ifndef wirelength_hpp
+#define wirelength_hpp
+
+#include "hpwl.h"
+
+namespace polish {
+
+    // Half-perimeter wirelength (hpwl) of nets over pins of modules, kept
+    // incrementally as modules are placed by update_floorplan(). The engine
+    // is shared with seqpair, so that both count pins and rotations alike.
+    using incremental_hpwl = aureliano::incremental_hpwl;
+
+}   // polish
+
+#endif /* wirelength_hpp */
@@ -0,0 +1,159 @@
+// bbox_kernels.cpp: bounding boxes of point sets, vectorised.
+// Author: LYL (Aureliano Lee)
+
+#include "bbox_kernels.h"
+#include <algorithm>
+#include <cassert>
+
+#if SEQPAIR_BBOX_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace seqpair;
+
+namespace {
+
+    void bbox_portable(const int32_t *xs, const int32_t *ys, size_t n,
+        int32_t *box) {
+        assert(n);
+        int32_t xmin = xs[0], xmax = xs[0], ymin = ys[0], ymax = ys[0];
+        for (size_t i = 1; i != n; ++i) {
+            xmin = min(xmin, xs[i]);
+            xmax = max(xmax, xs[i]);
+            ymin = min(ymin, ys[i]);
+            ymax = max(ymax, ys[i]);
+        }
+        box[0] = xmin;
+        box[1] = xmax;
+        box[2] = ymin;
+        box[3] = ymax;
+    }
+
+#if SEQPAIR_BBOX_KERNELS_X86
+
+    // Vector kernels load the last vector from n - width, overlapping the
+    // previous one, as min and max do not mind duplicates.
+
+    // SSE4.1 kernels.
+
+    __attribute__((target("sse4.1")))
+    inline int32_t reduce_min_sse41(__m128i v) {
+        v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(v);
+    }
+
+    __attribute__((target("sse4.1")))
+    inline int32_t reduce_max_sse41(__m128i v) {
+        v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(v);
+    }
+
+    __attribute__((target("sse4.1")))
+    void bbox_sse41(const int32_t *xs, const int32_t *ys, size_t n, int32_t *box) {
+        if (n < 4)
+            return bbox_portable(xs, ys, n, box);
+        __m128i xmin = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xs));
+        __m128i ymin = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ys));
+        __m128i xmax = xmin, ymax = ymin;
+        for (size_t i = 4; i < n; i += 4) {
+            size_t k = min(i, n - 4);
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xs + k));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ys + k));
+            xmin = _mm_min_epi32(xmin, x);
+            xmax = _mm_max_epi32(xmax, x);
+            ymin = _mm_min_epi32(ymin, y);
+            ymax = _mm_max_epi32(ymax, y);
+        }
+        box[0] = reduce_min_sse41(xmin);
+        box[1] = reduce_max_sse41(xmax);
+        box[2] = reduce_min_sse41(ymin);
+        box[3] = reduce_max_sse41(ymax);
+    }
+
+    // AVX2 kernels.
+
+    __attribute__((target("avx2")))
+    void bbox_avx2(const int32_t *xs, const int32_t *ys, size_t n, int32_t *box) {
+        if (n < 8)
+            return bbox_sse41(xs, ys, n, box);
+        __m256i xmin = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xs));
+        __m256i ymin = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ys));
+        __m256i xmax = xmin, ymax = ymin;
+        for (size_t i = 8; i < n; i += 8) {
+            size_t k = min(i, n - 8);
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xs + k));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ys + k));
+            xmin = _mm256_min_epi32(xmin, x);
+            xmax = _mm256_max_epi32(xmax, x);
+            ymin = _mm256_min_epi32(ymin, y);
+            ymax = _mm256_max_epi32(ymax, y);
+        }
+        box[0] = reduce_min_sse41(_mm_min_epi32(_mm256_castsi256_si128(xmin),
+            _mm256_extracti128_si256(xmin, 1)));
+        box[1] = reduce_max_sse41(_mm_max_epi32(_mm256_castsi256_si128(xmax),
+            _mm256_extracti128_si256(xmax, 1)));
+        box[2] = reduce_min_sse41(_mm_min_epi32(_mm256_castsi256_si128(ymin),
+            _mm256_extracti128_si256(ymin, 1)));
+        box[3] = reduce_max_sse41(_mm_max_epi32(_mm256_castsi256_si128(ymax),
+            _mm256_extracti128_si256(ymax, 1)));
+    }
+
+#endif  // SEQPAIR_BBOX_KERNELS_X86
+
+    const bbox_kernels kernel_table[] = {
+        { bbox_isa::PORTABLE, bbox_portable },
+#if SEQPAIR_BBOX_KERNELS_X86
+        { bbox_isa::SSE41, bbox_sse41 },
+        { bbox_isa::AVX2, bbox_avx2 },
+#endif
+    };
+
+}
+
+const char *seqpair::to_string(bbox_isa isa) noexcept {
+    switch (isa) {
+    case bbox_isa::PORTABLE:
+        return "portable";
+    case bbox_isa::SSE41:
+        return "sse4.1";
+    case bbox_isa::AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+bool seqpair::is_bbox_isa_supported(bbox_isa isa) noexcept {
+#if SEQPAIR_BBOX_KERNELS_X86
+    __builtin_cpu_init();
+    switch (isa) {
+    case bbox_isa::PORTABLE:
+        return true;
+    case bbox_isa::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case bbox_isa::AVX2:
+        return __builtin_cpu_supports("avx2");
+    }
+    return false;
+#else
+    return isa == bbox_isa::PORTABLE;
+#endif
+}
+
+const bbox_kernels &seqpair::get_bbox_kernels(bbox_isa isa) noexcept {
+    assert(is_bbox_isa_supported(isa));
+    return is_bbox_isa_supported(isa) ?
+        kernel_table[static_cast<size_t>(isa)] : kernel_table[0];
+}
+
+const bbox_kernels &seqpair::get_bbox_kernels() noexcept {
+    static const bbox_kernels &kernels = [] () -> const bbox_kernels & {
+        for (auto isa : { bbox_isa::AVX2, bbox_isa::SSE41 })
+            if (is_bbox_isa_supported(isa))
+                return get_bbox_kernels(isa);
+        return get_bbox_kernels(bbox_isa::PORTABLE);
+    }();
+    return kernels;
+}
@@ -0,0 +1,41 @@
+// bbox_kernels.h: bounding boxes of point sets, vectorised.
+// Author: LYL (Aureliano Lee)
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEQPAIR_BBOX_KERNELS_X86 1
+#else
+#define SEQPAIR_BBOX_KERNELS_X86 0
+#endif
+
+namespace seqpair {
+    // Instruction sets of bounding box kernels.
+    enum class bbox_isa {
+        PORTABLE, SSE41, AVX2
+    };
+
+    // Writes the bounding box of the points (xs[i], ys[i]), i in [0, n),
+    // n > 0, to box as { xmin, xmax, ymin, ymax }. Coordinates are
+    // structures of arrays, so that the reductions run on whole vectors.
+    using bbox_function = void (*)(const std::int32_t *xs,
+        const std::int32_t *ys, std::size_t n, std::int32_t *box);
+
+    struct bbox_kernels {
+        bbox_isa isa;
+        bbox_function bbox;
+    };
+
+    const char *to_string(bbox_isa isa) noexcept;
+
+    // Checks whether the CPU runs kernels of isa.
+    bool is_bbox_isa_supported(bbox_isa isa) noexcept;
+
+    // Kernels of isa, which must be supported.
+    const bbox_kernels &get_bbox_kernels(bbox_isa isa) noexcept;
+
+    // Kernels of the best supported isa, detected at the first call.
+    const bbox_kernels &get_bbox_kernels() noexcept;
+}
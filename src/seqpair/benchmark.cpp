@@ -0,0 +1,119 @@
+// benchmark.cpp: per-move cost of the sequence pair evaluators.
+// Author: LYL (Aureliano Lee)
+
+#include "xseqpair.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "layout.h"
+#include "pack_generator.h"
+#include "verification.h"
+
+using namespace std;
+using namespace seqpair;
+namespace po = boost::program_options;
+
+namespace {
+
+    using char_allocator = std::allocator<char>;
+
+    // Runs change-evaluate-rollback cycles on a random layout for at least
+    // min_seconds (and at least min_moves cycles).
+    // Returns: average microseconds per move.
+    template<typename Generator>
+    double time_moves(const Layout<> &init_layout, double min_seconds,
+        size_t min_moves, default_random_engine &eng) {
+        using clock = chrono::steady_clock;
+        auto layout = init_layout;
+        typename Generator::unbuffered_generator_t gen;
+        gen.construct(layout.widths(), layout.heights(), eng);
+        auto res = gen.make_resource();
+        PackGeneratorBase::default_change_distribution chg_dist;
+
+        gen(layout, eng, res, chg_dist);    // Warm up
+        gen.rollback();
+
+        size_t moves = 0;
+        auto t0 = clock::now();
+        chrono::duration<double> elapsed(0);
+        while (moves < min_moves || elapsed.count() < min_seconds) {
+            gen(layout, eng, res, chg_dist);
+            gen.rollback();
+            ++moves;
+            elapsed = clock::now() - t0;
+        }
+        return elapsed.count() * 1e6 / moves;
+    }
+
+    template<typename Generator>
+    void report(const char *name, size_t size, size_t max_size,
+        const Layout<> &layout, double min_seconds, default_random_engine &eng) {
+        cout << setw(12) << name << setw(10) << size;
+        if (size > max_size)
+            cout << setw(16) << "skipped" << "\n";
+        else
+            cout << setw(16) << fixed << setprecision(2) <<
+                time_moves<Generator>(layout, min_seconds, 3, eng) << "\n";
+    }
+
+}
+
+int main(int argc, char **argv) {
+    po::options_description desc("Options");
+    desc.add_options()
+        ("help,h",
+            "show help message")
+        ("sizes,n", po::value< vector<size_t> >()->multitoken(),
+            "numbers of rectangles (default 1000 3000 10000 30000 100000)")
+        ("max-dag", po::value<size_t>()->default_value(1000),
+            "largest size run with the DAG evaluator (O(n^2) edges)")
+        ("max-flat-dag", po::value<size_t>()->default_value(10000),
+            "largest size run with the flat DAG evaluator (O(n^2) time)")
+        ("seconds,s", po::value<double>()->default_value(0.5),
+            "minimum measuring time per evaluator and size")
+        ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        cout << desc << "\n";
+        return 1;
+    }
+
+    vector<size_t> sizes{ 1000, 3000, 10000, 30000, 100000 };
+    if (vm.count("sizes"))
+        sizes = vm["sizes"].as<vector<size_t>>();
+    auto max_dag = vm["max-dag"].as<size_t>();
+    auto max_flat_dag = vm["max-flat-dag"].as<size_t>();
+    auto seconds = vm["seconds"].as<double>();
+    constexpr size_t unlimited = static_cast<size_t>(-1);
+
+    default_random_engine eng(SEQPAIR_RANDOM_SEED());
+    cout << setw(12) << "method" << setw(10) << "size" << setw(16) << "us/move" << "\n";
+    for (auto sz : sizes) {
+        auto layout = verification::make_random_layout(sz, 1, 100, eng);
+        report<DagPackGenerator<char_allocator>>("dag", sz, max_dag,
+            layout, seconds, eng);
+        report<FlatDagPackGenerator<char_allocator>>("flat-dag", sz, max_flat_dag,
+            layout, seconds, eng);
+        report<LcsPackGenerator<char_allocator>>("lcs", sz, unlimited,
+            layout, seconds, eng);
+        report<FenwickLcsPackGenerator<char_allocator>>("lcs-fenwick", sz, unlimited,
+            layout, seconds, eng);
+        report<VebLcsPackGenerator<char_allocator>>("lcs-veb", sz, unlimited,
+            layout, seconds, eng);
+        report<IncrementalLcsPackGenerator<char_allocator>>("lcs-inc", sz, unlimited,
+            layout, seconds, eng);
+    }
+
+    return 0;
+}
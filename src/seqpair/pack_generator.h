@@ -1,5 +1,7 @@
-// pack_generator.h: class DagPackGenerator, class LcsPackGenerator 
-//      and helper functions.
+// pack_generator.h: class DagPackGenerator, class LcsPackGenerator, 
+//      class FlatDagPackGenerator, class FenwickLcsPackGenerator,
+//      class VebLcsPackGenerator, class IncrementalLcsPackGenerator and 
+//      helper functions.
 // Rewritten by LYL (Aureliano Lee)
 
 #pragma once
@@ -8,11 +10,14 @@
 #include <array>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <numeric>
 #include <random>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 #include <boost/container/pmr/map.hpp>
@@ -20,9 +25,15 @@
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/dag_shortest_paths.hpp>
 #include <boost/graph/graph_traits.hpp>
+#include <boost/optional.hpp>
+#include "adaptive_distribution.h"
 #include "toolbox.h"
 #include "layout.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace seqpair {
     namespace detail {
         // Makes left inversion of range [first, last) that is permutation 
@@ -50,6 +61,26 @@ namespace seqpair {
             return match;
         }
 
+        // Inserts match value p of a component with length len into the LCS
+        // frontier pq, and erases the entries it dominates.
+        // Returns: position of the component.
+        template<typename Map, typename T>
+        auto insert_frontier(Map &pq, std::ptrdiff_t p, T len) {
+            auto it = pq.emplace(p, 0).first;   // .second is bool
+            auto pos = std::prev(it)->second;
+            auto t = pos + len;
+            it->second = t;
+            ++it;
+            while (it != pq.end()) {
+                if (it->second <= t) {
+                    it = pq.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            return pos;
+        }
+
         // Fast LCS evaluation in O(nlogn).
         template<typename FwdIt0, typename FwdIt1,
             typename RanIt0, typename RanIt1,
@@ -68,29 +99,357 @@ namespace seqpair {
             auto sz = std::distance(y_begin, y_end);
             for (decltype(sz) i = 0; i != sz; ++i) {
                 auto b = *x_begin++;
-                auto p = match[i];
-                auto it = pq.emplace(p, 0).first;   // .second is bool
-                pos[b] = std::prev(it)->second;
-                auto t = pos[b] + len[b];
-                it->second = t;
-                ++it;
-                while (it != pq.end()) {
-                    if (it->second <= t) {
-                        it = pq.erase(it);
-                    } else {
-                        ++it;
-                    }
-                }
+                pos[b] = insert_frontier(pq, match[i], len[b]);
             }
 
             assert(!pq.empty());
             return pq.rbegin()->second;
         }
 
+        // Fused evaluation of both coordinates in O(nlogn). The match is made
+        // once: the horizontal pass visits x in order and the vertical pass 
+        // visits x in reverse, which reads the same match backwards, so both 
+        // frontiers advance in a single sweep.
+        // Returns: (width, height)
+        template<typename FwdIt, typename RanIt0,
+            typename RanIt1, typename RanIt2,
+            typename RanIt3, typename RanIt4,
+            typename RanIt5, typename RanIt6,
+            typename Map0, typename Map1>
+            auto eval_sp2_fused(FwdIt y_begin, FwdIt y_end,    // in
+                RanIt0 x_begin, RanIt1 widths, RanIt2 heights,  // in
+                RanIt3 xs, RanIt4 ys,                           // out
+                RanIt5 buffer, RanIt6 match,                    // auxilary
+                Map0 &&pq_x, Map1 &&pq_y) {                     // auxilary
+            static_assert(std::is_signed<typename std::decay_t<Map0>::key_type>::value &&
+                std::is_signed<typename std::decay_t<Map1>::key_type>::value,
+                "Map must support signed keys");
+
+            seqpair::detail::make_match(y_begin, y_end, x_begin, match, buffer);
+
+            pq_x.clear();
+            pq_x.emplace(-1, 0);
+            pq_y.clear();
+            pq_y.emplace(-1, 0);
+            std::size_t sz = std::distance(y_begin, y_end);
+            for (std::size_t i = 0, k = sz - 1; i != sz; ++i, --k) {
+                auto bx = x_begin[i];
+                xs[bx] = insert_frontier(pq_x, match[i], widths[bx]);
+                auto by = x_begin[k];
+                ys[by] = insert_frontier(pq_y, match[k], heights[by]);
+            }
+
+            assert(!pq_x.empty() && !pq_y.empty());
+            return std::make_pair(pq_x.rbegin()->second, pq_y.rbegin()->second);
+        }
+
+        // Fast LCS evaluation in O(nlogn) without node allocation. The frontier
+        // of eval_sp2 is replaced by a prefix-maximum Fenwick tree indexed
+        // by match values. Assuming tree is big enough to hold [0, n).
+        template<typename FwdIt0, typename FwdIt1,
+            typename RanIt0, typename RanIt1,
+            typename RanIt2, typename RanIt3, typename RanIt4>
+            auto eval_sp2_fenwick(FwdIt0 y_begin, FwdIt0 y_end,    // in
+                FwdIt1 x_begin, RanIt0 len,                     // in
+                RanIt1 pos,                                     // out
+                RanIt2 buffer, RanIt3 match, RanIt4 tree) {     // auxilary
+            using value_type = typename std::iterator_traits<RanIt4>::value_type;
+
+            seqpair::detail::make_match(y_begin, y_end, x_begin, match, buffer);
+
+            std::size_t sz = std::distance(y_begin, y_end);
+            std::fill(tree, tree + sz, value_type());
+            value_type ans = value_type();
+            for (std::size_t i = 0; i != sz; ++i) {
+                auto b = *x_begin++;
+                std::size_t p = match[i];
+                // Maximum over [0, p)
+                value_type t = value_type();
+                for (auto k = p; k != 0; k &= k - 1)
+                    t = std::max(t, tree[k - 1]);
+                pos[b] = t;
+                t += len[b];
+                ans = std::max(ans, t);
+                // Raise [p, n)
+                for (auto k = p + 1; k <= sz; k += k & (~k + 1))
+                    tree[k - 1] = std::max(tree[k - 1], t);
+            }
+            return ans;
+        }
+
+        // Fused variant of eval_sp2_fenwick, see eval_sp2_fused. Assuming 
+        // tree_x and tree_y are big enough to hold [0, n).
+        // Returns: (width, height)
+        template<typename FwdIt, typename RanIt0,
+            typename RanIt1, typename RanIt2,
+            typename RanIt3, typename RanIt4,
+            typename RanIt5, typename RanIt6, typename RanIt7>
+            auto eval_sp2_fenwick_fused(FwdIt y_begin, FwdIt y_end,    // in
+                RanIt0 x_begin, RanIt1 widths, RanIt2 heights,  // in
+                RanIt3 xs, RanIt4 ys,                           // out
+                RanIt5 buffer, RanIt6 match,                    // auxilary
+                RanIt7 tree_x, RanIt7 tree_y) {                 // auxilary
+            using value_type = typename std::iterator_traits<RanIt7>::value_type;
+
+            seqpair::detail::make_match(y_begin, y_end, x_begin, match, buffer);
+
+            std::size_t sz = std::distance(y_begin, y_end);
+            std::fill(tree_x, tree_x + sz, value_type());
+            std::fill(tree_y, tree_y + sz, value_type());
+            value_type w = value_type(), h = value_type();
+            for (std::size_t i = 0, j = sz - 1; i != sz; ++i, --j) {
+                std::size_t px = match[i], py = match[j];
+                value_type tx = value_type(), ty = value_type();
+                for (auto k = px; k != 0; k &= k - 1)
+                    tx = std::max(tx, tree_x[k - 1]);
+                for (auto k = py; k != 0; k &= k - 1)
+                    ty = std::max(ty, tree_y[k - 1]);
+                auto bx = x_begin[i], by = x_begin[j];
+                xs[bx] = tx;
+                ys[by] = ty;
+                tx += widths[bx];
+                ty += heights[by];
+                w = std::max(w, tx);
+                h = std::max(h, ty);
+                for (auto k = px + 1; k <= sz; k += k & (~k + 1))
+                    tree_x[k - 1] = std::max(tree_x[k - 1], tx);
+                for (auto k = py + 1; k <= sz; k += k & (~k + 1))
+                    tree_y[k - 1] = std::max(tree_y[k - 1], ty);
+            }
+            return std::make_pair(w, h);
+        }
+
+        // Incremental variant of eval_sp2_fenwick, where step i visits
+        // component x_begin[i] whose match value is match_begin[i]. Steps
+        // [0, first) are assumed unchanged since the last call, so their 
+        // positions are read from pos and loaded into the tree by a linear
+        // build; only steps [first, n) are recomputed. Every recomputed 
+        // position that differs from pos is pushed to log as
+        // (component, old position) before being overwritten.
+        // Assuming tree is big enough to hold [0, n).
+        template<typename FwdIt0, typename FwdIt1, typename RanIt0,
+            typename RanIt1, typename RanIt2, typename Log>
+            auto eval_sp2_fenwick_from(FwdIt0 x_begin, FwdIt1 match_begin, // in
+                std::size_t sz, std::size_t first, RanIt0 len,  // in
+                RanIt1 pos,                                     // in, out
+                RanIt2 tree, Log &log) {                        // auxilary, out
+            using value_type = typename std::iterator_traits<RanIt2>::value_type;
+
+            std::fill(tree, tree + sz, value_type());
+            value_type ans = value_type();
+            std::size_t i = 0;
+            for (; i != first; ++i) {
+                auto b = *x_begin++;
+                value_type t = pos[b] + len[b];
+                tree[*match_begin++] = t;
+                ans = std::max(ans, t);
+            }
+            if (first != 0) {
+                // Linear build of the prefix maximum tree
+                for (std::size_t k = 1; k <= sz; ++k) {
+                    auto parent = k + (k & (~k + 1));
+                    if (parent <= sz)
+                        tree[parent - 1] = std::max(tree[parent - 1], tree[k - 1]);
+                }
+            }
+            for (; i != sz; ++i) {
+                auto b = *x_begin++;
+                std::size_t p = *match_begin++;
+                value_type t = value_type();
+                for (auto k = p; k != 0; k &= k - 1)
+                    t = std::max(t, tree[k - 1]);
+                value_type old = pos[b];
+                if (old != t) {
+                    log.emplace_back(b, old);
+                    pos[b] = t;
+                }
+                t += len[b];
+                ans = std::max(ans, t);
+                for (auto k = p + 1; k <= sz; k += k & (~k + 1))
+                    tree[k - 1] = std::max(tree[k - 1], t);
+            }
+            return ans;
+        }
+
+        // Index of the lowest set bit, x != 0.
+        inline unsigned lowest_bit(std::uint64_t x) noexcept {
+            assert(x);
+#ifdef _MSC_VER
+            unsigned long k;
+            _BitScanForward64(&k, x);
+            return static_cast<unsigned>(k);
+#else
+            return static_cast<unsigned>(__builtin_ctzll(x));
+#endif
+        }
+
+        // Index of the highest set bit, x != 0.
+        inline unsigned highest_bit(std::uint64_t x) noexcept {
+            assert(x);
+#ifdef _MSC_VER
+            unsigned long k;
+            _BitScanReverse64(&k, x);
+            return static_cast<unsigned>(k);
+#else
+            return 63u - static_cast<unsigned>(__builtin_clzll(x));
+#endif
+        }
+
+        // Word-level van Emde Boas set over [0, n), stored in an external 
+        // buffer of words. Each level is a bitmap summarizing the non-empty 
+        // words of the level below, so insert, erase, predecessor and 
+        // successor take O(log_64 n) word operations (at most 4 levels for 
+        // n < 2^24).
+        class VebSet {
+        public:
+            static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+            // Number of words needed for universe [0, n).
+            static std::size_t words_needed(std::size_t n) noexcept {
+                std::size_t total = 0;
+                do {
+                    n = (n + 63) >> 6;
+                    total += n;
+                } while (n > 1);
+                return total;
+            }
+
+            // Constructs an empty set.
+            // Requires: words holds at least words_needed(n) words.
+            VebSet(std::uint64_t *words, std::size_t n) noexcept : 
+                words_(words), num_levels_(0) {
+                std::size_t offset = 0;
+                do {
+                    n = (n + 63) >> 6;
+                    assert(num_levels_ != max_levels);
+                    offsets_[num_levels_++] = offset;
+                    offset += n;
+                } while (n > 1);
+                std::fill(words_, words_ + offset, std::uint64_t());
+            }
+
+            void insert(std::size_t k) noexcept {
+                for (unsigned l = 0; l != num_levels_; ++l) {
+                    auto &w = word(l, k >> 6);
+                    bool was_empty = !w;
+                    w |= std::uint64_t(1) << (k & 63);
+                    if (!was_empty)
+                        break;
+                    k >>= 6;
+                }
+            }
+
+            void erase(std::size_t k) noexcept {
+                for (unsigned l = 0; l != num_levels_; ++l) {
+                    auto &w = word(l, k >> 6);
+                    w &= ~(std::uint64_t(1) << (k & 63));
+                    if (w)
+                        break;
+                    k >>= 6;
+                }
+            }
+
+            // Returns: largest element less than k, or npos.
+            std::size_t predecessor(std::size_t k) const noexcept {
+                unsigned l = 0;
+                for (;; ++l) {
+                    if (l == num_levels_)
+                        return npos;
+                    auto m = word(l, k >> 6) & 
+                        ((std::uint64_t(1) << (k & 63)) - 1);
+                    if (m) {
+                        k = (k & ~std::size_t(63)) | highest_bit(m);
+                        break;
+                    }
+                    k >>= 6;
+                }
+                while (l-- != 0)
+                    k = (k << 6) | highest_bit(word(l, k));
+                return k;
+            }
+
+            // Returns: smallest element greater than k, or npos.
+            std::size_t successor(std::size_t k) const noexcept {
+                unsigned l = 0;
+                for (;; ++l) {
+                    if (l == num_levels_)
+                        return npos;
+                    auto m = (k & 63) == 63 ? std::uint64_t() :
+                        word(l, k >> 6) & (~std::uint64_t() << ((k & 63) + 1));
+                    if (m) {
+                        k = (k & ~std::size_t(63)) | lowest_bit(m);
+                        break;
+                    }
+                    k >>= 6;
+                }
+                while (l-- != 0)
+                    k = (k << 6) | lowest_bit(word(l, k));
+                return k;
+            }
+
+        private:
+            static constexpr unsigned max_levels = 11;  // 64^11 > 2^64
+
+            std::uint64_t &word(unsigned l, std::size_t i) noexcept {
+                return words_[offsets_[l] + i];
+            }
+
+            std::uint64_t word(unsigned l, std::size_t i) const noexcept {
+                return words_[offsets_[l] + i];
+            }
+
+            std::uint64_t *words_;
+            std::size_t offsets_[max_levels];
+            unsigned num_levels_;
+        };
+
+        // LCS evaluation after Tang and Wong (FAST-SP) in O(n log_64 n). The 
+        // frontier of eval_sp2 is kept as a VebSet of match values, whose 
+        // lengths are stored in values. Assuming words holds 
+        // VebSet::words_needed(n) and values holds n elements.
+        template<typename FwdIt0, typename FwdIt1,
+            typename RanIt0, typename RanIt1,
+            typename RanIt2, typename RanIt3, typename RanIt4>
+            auto eval_sp2_veb(FwdIt0 y_begin, FwdIt0 y_end,         // in
+                FwdIt1 x_begin, RanIt0 len,                     // in
+                RanIt1 pos,                                     // out
+                RanIt2 buffer, RanIt3 match,                    // auxilary
+                std::uint64_t *words, RanIt4 values) {          // auxilary
+            using value_type = typename std::iterator_traits<RanIt4>::value_type;
+
+            seqpair::detail::make_match(y_begin, y_end, x_begin, match, buffer);
+
+            std::size_t sz = std::distance(y_begin, y_end);
+            VebSet pq(words, sz);
+            value_type ans = value_type();
+            for (std::size_t i = 0; i != sz; ++i) {
+                auto b = *x_begin++;
+                std::size_t p = match[i];
+                auto q = pq.predecessor(p);
+                pos[b] = q == VebSet::npos ? value_type() : values[q];
+                value_type t = pos[b] + len[b];
+                ans = std::max(ans, t);
+                pq.insert(p);
+                values[p] = t;
+                // Erase dominated entries
+                for (q = pq.successor(p); q != VebSet::npos && values[q] <= t;
+                    q = pq.successor(q))
+                    pq.erase(q);
+            }
+            return ans;
+        }
+
         // Empty tags to identify whether I'm buffered.
         struct UnbufferedGeneratorTag { };
         struct BufferedGeneratorTag { };
 
+        // Bound of eval_bounded that never gives up.
+        struct never_exceeds {
+            bool operator()(int, int) const noexcept {
+                return false;
+            }
+        };
+
         // Base class to define enum change_t and functor default_change_distribution
         struct PackGeneratorBase {
             // Enum of next move.
@@ -211,10 +570,88 @@ namespace seqpair {
                     return df_[static_cast<size_t>(change_t::none)] == 0;
                 }
 
+                // Probability of change chg.
+                double probability(change_t chg) const {
+                    auto k = static_cast<size_t>(chg);
+                    return k ? df_[k] - df_[k - 1] : df_[k];
+                }
+
             protected:
                 array_t df_;  // Distribution function
             };
 
+            // ChangeDistribution starting from the probabilities of a 
+            // default_change_distribution, and adapting them to the outcomes
+            // of the changes drawn: feedback(...) reports an outcome, and 
+            // update() reweights the changes, e.g., per temperature (see 
+            // aureliano::adaptive_discrete_distribution).
+            class adaptive_change_distribution {
+            public:
+                using result_type = change_t;
+
+                adaptive_change_distribution() :
+                    adaptive_change_distribution(default_change_distribution()) { }
+
+                // Changes of probability (about) 0 in prior are never drawn.
+                explicit adaptive_change_distribution(const default_change_distribution &prior,
+                    double learning_rate = 0.3, double min_share = 0.1) {
+                    auto weights = make_weights(prior);
+                    dist_ = aureliano::adaptive_discrete_distribution(weights.cbegin(),
+                        weights.cend(), learning_rate, min_share);
+                }
+
+                template<typename Eng>
+                result_type operator()(Eng &&eng) const {
+                    return static_cast<result_type>(dist_(std::forward<Eng>(eng)));
+                }
+
+                bool maybe_none() const {
+                    return probability(change_t::none) > 0;
+                }
+
+                double probability(change_t chg) const {
+                    return dist_.probability(static_cast<std::size_t>(chg));
+                }
+
+                // Records an outcome of change chg: whether it is accepted,
+                // and how much it decreases the energy.
+                void feedback(change_t chg, bool accepted, double gain) noexcept {
+                    dist_.feedback(static_cast<std::size_t>(chg), accepted, gain);
+                }
+
+                void update() {
+                    dist_.update();
+                }
+
+                // Prints the changes that can be drawn with their probabilities.
+                friend std::ostream &operator<<(std::ostream &out,
+                    const adaptive_change_distribution &dist) {
+                    static const char *names[change_t_size] = { 
+                        "none", "rotate", "swap_x", "swap_y", "swap_xy",
+                        "reverse_x", "reverse_y", "reverse_xy",
+                        "rotate_x", "rotate_y", "rotate_xy"
+                    };
+                    for (size_t k = 0; k != change_t_size; ++k)
+                        if (dist.dist_.probability(k) > 0)
+                            out << names[k] << ": " << dist.dist_.probability(k) << "\n";
+                    return out;
+                }
+
+            protected:
+                // default_change_distribution adds epsilon to every weight.
+                static std::array<double, change_t_size> make_weights(
+                    const default_change_distribution &prior) {
+                    std::array<double, change_t_size> weights;
+                    for (size_t k = 0; k != change_t_size; ++k) {
+                        auto p = prior.probability(static_cast<change_t>(k));
+                        weights[k] = p > std::numeric_limits<double>::epsilon() ? p : 0;
+                    }
+                    return weights;
+                }
+
+                aureliano::adaptive_discrete_distribution dist_;
+            };
+
             // Factory of default_change_distribution.
             template<typename... Types>
             static default_change_distribution 
@@ -251,17 +688,23 @@ namespace seqpair {
         }
 
         // Graph-based sequence-pair packing generator which does not own buffer resource.
+        // Derived (if not void) is the most derived generator, whose eval is 
+        // invoked by operator(...).
         // Note: modified allocator<void> to allocator<void *>, for compilation with g++.
-        template<typename Alloc = std::allocator<void *>>
+        template<typename Alloc = std::allocator<void *>, typename Derived = void>
         class DagPackGeneratorBase : public PackGeneratorBase {
-            using self_t = DagPackGeneratorBase<Alloc>;
+            using self_t = DagPackGeneratorBase<Alloc, Derived>;
             using base_t = PackGeneratorBase;
+            using derived_t = std::conditional_t<std::is_void<Derived>::value,
+                self_t, Derived>;
 
         protected:
             using int_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<int>;
             using size_t_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<size_t>;
+            using bool_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<bool>;
             using size_vector_t = std::vector<int, int_alloc_t>;
             using sequence_pair_t = std::vector<std::size_t, size_t_alloc_t>;
+            using rotation_bits_t = std::vector<bool, bool_alloc_t>;
             using momento_t = std::tuple<change_t, std::size_t, std::size_t>;
 
         public:
@@ -270,6 +713,13 @@ namespace seqpair {
             using allocator_type = Alloc;
             using resource_t = std::vector<char, allocator_type>;
             using generator_tag = UnbufferedGeneratorTag;
+
+            // State of a generator to be restored: the sequence pair and 
+            // which components are rotated (see save and restore).
+            struct checkpoint_t {
+                sequence_pair_t sp_x, sp_y;
+                rotation_bits_t rotated;
+            };
             
             DagPackGeneratorBase() : DagPackGeneratorBase(allocator_type()) { }
 
@@ -278,7 +728,7 @@ namespace seqpair {
 
             explicit DagPackGeneratorBase(const allocator_type &alloc) : 
                 widths_(alloc), heights_(alloc), sp_x_(alloc), sp_y_(alloc),
-                last_change_(change_t::none, 0, 0) { }
+                rotated_(alloc), last_change_(change_t::none, 0, 0) { }
 
             template<typename Cont0, typename Cont1, typename Eng>
                 DagPackGeneratorBase(Cont0 &&widths, Cont1 &&heights,
@@ -288,10 +738,12 @@ namespace seqpair {
                 heights_(std::begin(std::forward<Cont1>(heights)),
                     std::end(std::forward<Cont1>(heights)), alloc),
                 sp_x_(this->size(), alloc), sp_y_(this->size(), alloc),
+                rotated_(this->size(), false, alloc),
                 last_change_(change_t::none, 0, 0) {
                 assert(widths_.size() == heights_.size());
                 std::iota(sp_x_.begin(), sp_x_.end(), 0);
                 std::iota(sp_y_.begin(), sp_y_.end(), 0);
+                reset_max_short_side();
                 this->shuffle(std::forward<Eng>(eng));
             }
 
@@ -317,8 +769,10 @@ namespace seqpair {
                 auto sz = widths_.size();
                 sp_x_.resize(sz);
                 sp_y_.resize(sz);
+                rotated_.assign(sz, false);
                 iota(sp_x_.begin(), sp_x_.end(), 0);
                 iota(sp_y_.begin(), sp_y_.end(), 0);
+                reset_max_short_side();
                 this->shuffle(std::forward<Eng>(eng));
                 last_change_ = forward_as_tuple(change_t::none, 0, 0);
             }
@@ -336,7 +790,115 @@ namespace seqpair {
                 // Synchronize widths and heights
                 unguarded_copy_layout_sizes(layout);
                 // Evaluate current state
-                return eval(layout, std::forward<Eng>(eng), res);
+                return derived().eval(layout, std::forward<Eng>(eng), res);
+            }
+
+            // As operator(...), but may give up evaluating once exceeds(w, h)
+            // holds for lower bounds w and h of the width and height of the
+            // packing, i.e., once the packing is known to be rejected. The 
+            // positions of layout are then unspecified, and the change is to
+            // be rolled back before the next evaluation.
+            // Returns: (width, height), or none if given up.
+            template<typename LayoutAlloc, typename Eng, typename ChgDist,
+                typename Pred>
+                boost::optional<std::pair<int, int>> eval_bounded(
+                    Layout<LayoutAlloc> &layout, Eng &&eng, resource_t &res,
+                    ChgDist &&chg_dist, Pred &&exceeds) {
+                assert(layout.size() == this->size());
+                change(std::forward<Eng>(eng), std::forward<ChgDist>(chg_dist));
+                unguarded_copy_layout_sizes(layout);
+                return derived().eval_until(layout, std::forward<Eng>(eng), res,
+                    std::forward<Pred>(exceeds));
+            }
+
+            // Result of a candidate change evaluated by eval_batch.
+            struct candidate_t {
+                momento_t change;
+                int width, height;
+                double energy;
+            };
+
+            // Evaluates k candidate changes of the current state, each of 
+            // which is rolled back right after its evaluation, so that they 
+            // share the resource and whatever state the evaluator keeps. For
+            // each candidate, writes candidate_t with energy computed by 
+            // energy_func(layout, width, height) to out. This invalidates the
+            // subsequent call to rollback, and leaves the positions of layout
+            // unspecified until the next evaluation.
+            // Returns: out past the last candidate.
+            template<typename LayoutAlloc, typename Eng, typename ChgDist,
+                typename EFunc, typename OutIt>
+                OutIt eval_batch(Layout<LayoutAlloc> &layout, Eng &&eng, resource_t &res,
+                    ChgDist &&chg_dist, std::size_t k, EFunc &&energy_func, OutIt out) {
+                assert(layout.size() == this->size());
+                for (std::size_t t = 0; t != k; ++t) {
+                    bool changed = change(eng, chg_dist);
+                    unguarded_copy_layout_sizes(layout);
+                    int w, h;
+                    std::tie(w, h) = derived().eval(layout, eng, res);
+                    // An unchanged candidate replays as no change.
+                    *out++ = candidate_t{ changed ? last_change_ :
+                        momento_t(change_t::none, 0, 0), w, h, energy_func(layout, w, h) };
+                    if (changed)
+                        derived().rollback();
+                }
+                unguarded_copy_layout_sizes(layout);
+                return out;
+            }
+
+            // Replays a candidate made by eval_batch from the same state, and
+            // evaluates it as operator(...) does.
+            // Returns: (width, height)
+            template<typename LayoutAlloc, typename Eng>
+            std::pair<int, int> apply(const candidate_t &cand, Layout<LayoutAlloc> &layout,
+                Eng &&eng, resource_t &res) {
+                assert(layout.size() == this->size());
+                change_t chg; std::size_t i, j;
+                std::tie(chg, i, j) = cand.change;
+                apply_change(chg, i, j, true);
+                last_change_ = cand.change;
+                unguarded_copy_layout_sizes(layout);
+                return derived().eval(layout, std::forward<Eng>(eng), res);
+            }
+
+            // Evaluates the current state without changing it, and writes the
+            // packing to layout.
+            // Returns: (width, height)
+            template<typename LayoutAlloc, typename Eng>
+            std::pair<int, int> evaluate(Layout<LayoutAlloc> &layout, Eng &&eng,
+                resource_t &res) {
+                assert(layout.size() == this->size());
+                unguarded_copy_layout_sizes(layout);
+                return derived().eval(layout, std::forward<Eng>(eng), res);
+            }
+
+            // Saves the current state to cp, reusing its storage, or the 
+            // state before the last change if before_last_change, so that a
+            // state can be saved once a move leaves it.
+            void save(checkpoint_t &cp, bool before_last_change = false) const {
+                cp.sp_x.assign(sp_x_.cbegin(), sp_x_.cend());
+                cp.sp_y.assign(sp_y_.cbegin(), sp_y_.cend());
+                cp.rotated.assign(rotated_.cbegin(), rotated_.cend());
+                if (!before_last_change)
+                    return;
+                change_t chg; std::size_t i, j;
+                std::tie(chg, i, j) = last_change_;
+                if (chg == change_t::rotate)
+                    cp.rotated[i].flip();
+                else
+                    undo_sp_change(chg, i, j, cp.sp_x, cp.sp_y);
+            }
+
+            // Restores the state saved in cp by a generator of the same
+            // components. This invalidates the subsequent call to rollback.
+            void restore(const checkpoint_t &cp) {
+                assert(cp.sp_x.size() == size());
+                std::copy(cp.sp_x.cbegin(), cp.sp_x.cend(), sp_x_.begin());
+                std::copy(cp.sp_y.cbegin(), cp.sp_y.cend(), sp_y_.begin());
+                for (std::size_t k = 0; k != size(); ++k)
+                    if (rotated_[k] != cp.rotated[k])
+                        unrotate_component(k);
+                last_change_ = std::forward_as_tuple(change_t::none, 0, 0);
             }
 
             // One-shot rollback. If cannot rollback, does nothing.
@@ -392,12 +954,17 @@ namespace seqpair {
                 bernoulli_distribution rand_bool(p_rotate);
                 for (size_t i = 0; i != this->size(); ++i)
                     if (rand_bool(eng))
-                        swap(widths_[i], heights_[i]);
+                        unrotate_component(i);
                 std::shuffle(sp_x_.begin(), sp_x_.end(), eng);
                 std::shuffle(sp_y_.begin(), sp_y_.end(), eng);
                 last_change_ = forward_as_tuple(change_t::none, 0, 0);
             }
 
+            // Type of the last change, none after a rollback.
+            change_t last_change_type() const noexcept {
+                return std::get<0>(last_change_);
+            }
+
             auto size() const noexcept {
                 return widths_.size();
             }
@@ -410,11 +977,19 @@ namespace seqpair {
                 return gen.print(out);
             }
 
-            template<typename Alloc0, typename Alloc1>
-            friend void unguarded_copy_unbuffered_generator(const DagPackGeneratorBase<Alloc0> &src,
-                DagPackGeneratorBase<Alloc1> &dest);
+            template<typename Alloc0, typename Derived0, typename Alloc1, typename Derived1>
+            friend void unguarded_copy_unbuffered_generator(
+                const DagPackGeneratorBase<Alloc0, Derived0> &src,
+                DagPackGeneratorBase<Alloc1, Derived1> &dest);
 
         protected:
+            derived_t &derived() noexcept {
+                return static_cast<derived_t &>(*this);
+            }
+
+            const derived_t &derived() const noexcept {
+                return static_cast<const derived_t &>(*this);
+            }
 
             template<typename LayoutAlloc>
             void unguarded_copy_layout_sizes(Layout<LayoutAlloc> &layout) const {
@@ -426,8 +1001,8 @@ namespace seqpair {
                     std::addressof(*layout.heights_begin()));
             }
 
-            template<typename Alloc1>
-            void unguarded_assign(const DagPackGeneratorBase<Alloc1> &src) {
+            template<typename Alloc1, typename Derived1>
+            void unguarded_assign(const DagPackGeneratorBase<Alloc1, Derived1> &src) {
                 using namespace std;
                 assert(size() == src.size());
                 auto sz = size();
@@ -435,9 +1010,31 @@ namespace seqpair {
                 copy(src.sp_y_.data(), src.sp_y_.data() + sz, sp_y_.data());
                 copy(src.widths_.data(), src.widths_.data() + sz, widths_.data());
                 copy(src.heights_.data(), src.heights_.data() + sz, heights_.data());
+                copy(src.rotated_.cbegin(), src.rotated_.cend(), rotated_.begin());
+                max_short_side_ = src.max_short_side_;
                 last_change_ = src.last_change_;
             }
 
+            // Components can rotate, but neither the width nor the height of
+            // a packing is less than the shorter side of any component.
+            void reset_max_short_side() noexcept {
+                max_short_side_ = 0;
+                for (std::size_t i = 0; i != size(); ++i)
+                    max_short_side_ = std::max(max_short_side_,
+                        std::min(widths_[i], heights_[i]));
+            }
+
+            // Implements the evaluation stage of eval_bounded(...), which 
+            // gives up only after the full evaluation by default.
+            template<typename LayoutAlloc, typename Eng, typename Pred>
+            boost::optional<std::pair<int, int>> eval_until(Layout<LayoutAlloc> &layout,
+                Eng &&eng, resource_t &res, Pred &&exceeds) {
+                auto sln_area = derived().eval(layout, std::forward<Eng>(eng), res);
+                if (exceeds(sln_area.first, sln_area.second))
+                    return boost::none;
+                return sln_area;
+            }
+
             // Implements the evaluation stage of operator(...). 
             // Requires: widths and heights between this object and layout have
             //      been synchronized.
@@ -527,6 +1124,8 @@ namespace seqpair {
 
                 switch (chg) {
                 case change_t::none:
+                    // Nothing to roll back, nor to undo by a lazy save.
+                    last_change_ = std::forward_as_tuple(change_t::none, 0, 0);
                     ans = false;
                     break;
 
@@ -574,11 +1173,16 @@ namespace seqpair {
             }
 
             void unswap_sp(size_t i, size_t j, change_t chg) {
+                unswap_sp(i, j, chg, sp_x_, sp_y_);
+            }
+
+            static void unswap_sp(size_t i, size_t j, change_t chg,
+                sequence_pair_t &sp_x, sequence_pair_t &sp_y) {
                 using std::swap;
                 if (chg == change_t::swap_x || chg == change_t::swap_xy)
-                    swap(sp_x_[i], sp_x_[j]);
+                    swap(sp_x[i], sp_x[j]);
                 if (chg == change_t::swap_y || chg == change_t::swap_xy)
-                    swap(sp_y_[i], sp_y_[j]);
+                    swap(sp_y[i], sp_y[j]);
             }
 
             template<typename Eng>
@@ -603,10 +1207,15 @@ namespace seqpair {
             }
 
             void unrotate_sp(size_t i, size_t j, change_t chg) {
+                unrotate_sp(i, j, chg, sp_x_, sp_y_);
+            }
+
+            static void unrotate_sp(size_t i, size_t j, change_t chg,
+                sequence_pair_t &sp_x, sequence_pair_t &sp_y) {
                 if (chg == change_t::rotate_x || chg == change_t::rotate_xy)
-                    std::rotate(sp_x_.data() + i, sp_x_.data() + j - 1, sp_x_.data() + j);
+                    std::rotate(sp_x.data() + i, sp_x.data() + j - 1, sp_x.data() + j);
                 if (chg == change_t::rotate_y || chg == change_t::rotate_xy)
-                    std::rotate(sp_y_.data() + i, sp_y_.data() + j - 1, sp_y_.data() + j);
+                    std::rotate(sp_y.data() + i, sp_y.data() + j - 1, sp_y.data() + j);
             }
 
             template<typename Eng>
@@ -626,10 +1235,42 @@ namespace seqpair {
             }
 
             void unreverse_sp(size_t i, size_t j, change_t chg) {
+                unreverse_sp(i, j, chg, sp_x_, sp_y_);
+            }
+
+            static void unreverse_sp(size_t i, size_t j, change_t chg,
+                sequence_pair_t &sp_x, sequence_pair_t &sp_y) {
                 if (chg == change_t::reverse_x || chg == change_t::reverse_xy)
-                    std::reverse(sp_x_.data() + i, sp_x_.data() + j);
+                    std::reverse(sp_x.data() + i, sp_x.data() + j);
                 if (chg == change_t::reverse_y || chg == change_t::reverse_xy)
-                    std::reverse(sp_y_.data() + i, sp_y_.data() + j);
+                    std::reverse(sp_y.data() + i, sp_y.data() + j);
+            }
+
+            // Undoes a change of the sequence pair (sp_x, sp_y), as rollback.
+            static void undo_sp_change(change_t chg, size_t i, size_t j,
+                sequence_pair_t &sp_x, sequence_pair_t &sp_y) {
+                switch (chg) {
+                case change_t::swap_x:
+                case change_t::swap_y:
+                case change_t::swap_xy:
+                    unswap_sp(i, j, chg, sp_x, sp_y);
+                    break;
+
+                case change_t::reverse_x:
+                case change_t::reverse_y:
+                case change_t::reverse_xy:
+                    unreverse_sp(i, j, chg, sp_x, sp_y);
+                    break;
+
+                case change_t::rotate_x:
+                case change_t::rotate_y:
+                case change_t::rotate_xy:
+                    unrotate_sp(i, j, chg, sp_x, sp_y);
+                    break;
+
+                default:
+                    break;
+                }
             }
 
             template<typename Eng>
@@ -644,6 +1285,47 @@ namespace seqpair {
             void unrotate_component(size_t k) {
                 using std::swap;
                 swap(widths_[k], heights_[k]);
+                rotated_[k].flip();
+            }
+
+            // Applies the change (forward) or its inverse to the sequence pair
+            // and the component sizes, without touching last_change_.
+            void apply_change(change_t chg, std::size_t i, std::size_t j, bool forward) {
+                switch (chg) {
+                case change_t::rotate:
+                    unrotate_component(i);
+                    break;
+
+                case change_t::swap_x:
+                case change_t::swap_y:
+                case change_t::swap_xy:
+                    unswap_sp(i, j, chg);
+                    break;
+
+                case change_t::reverse_x:
+                case change_t::reverse_y:
+                case change_t::reverse_xy:
+                    unreverse_sp(i, j, chg);
+                    break;
+
+                case change_t::rotate_x:
+                case change_t::rotate_y:
+                case change_t::rotate_xy:
+                    if (!forward) {
+                        unrotate_sp(i, j, chg);
+                        break;
+                    }
+                    if (chg != change_t::rotate_y)
+                        std::rotate(sp_x_.data() + i, sp_x_.data() + i + 1,
+                            sp_x_.data() + j);
+                    if (chg != change_t::rotate_x)
+                        std::rotate(sp_y_.data() + i, sp_y_.data() + i + 1,
+                            sp_y_.data() + j);
+                    break;
+
+                default:
+                    break;
+                }
             }
 
             std::ostream &print(std::ostream &out) const {
@@ -660,14 +1342,18 @@ namespace seqpair {
 
             size_vector_t widths_, heights_;    // Copies of component sizes
             sequence_pair_t sp_x_, sp_y_;
+            rotation_bits_t rotated_;           // Whether sizes are swapped
             momento_t last_change_;   // One-shot info of last change 
+            int max_short_side_ = 0;  // See reset_max_short_side
         };
 
         // LCS-based sequence-pair packing generator which does not own buffer resource.
         template<typename Alloc = std::allocator<void *>>
-        class LcsPackGeneratorBase : public DagPackGeneratorBase<Alloc> {
+        class LcsPackGeneratorBase : 
+            public DagPackGeneratorBase<Alloc, LcsPackGeneratorBase<Alloc>> {
             using self_t = LcsPackGeneratorBase<Alloc>;
-            using base_t = DagPackGeneratorBase<Alloc>;
+            using base_t = DagPackGeneratorBase<Alloc, self_t>;
+            friend base_t;
 
         protected:
             using typename base_t::size_vector_t;
@@ -703,14 +1389,14 @@ namespace seqpair {
                 // Evaluate current state.
                 using map_alloc_t = typename std::allocator_traits<allocator_type>
                     ::template rebind_alloc<std::pair<const ptrdiff_t, ptrdiff_t>>;
-                std::map<ptrdiff_t, ptrdiff_t, less<ptrdiff_t>, map_alloc_t>
-                    pq(std::less<ptrdiff_t>(), this->widths_.get_allocator());  
-                auto w = detail::eval_sp2(this->sp_y_.cbegin(), this->sp_y_.cend(),
-                    this->sp_x_.cbegin(), this->widths_.cbegin(), layout.x_begin(),
-                    buffer, match, pq);
-                auto h = detail::eval_sp2(this->sp_y_.cbegin(), this->sp_y_.cend(),
-                    this->sp_x_.crbegin(), this->heights_.cbegin(), layout.y_begin(),
-                    buffer, match, pq);
+                using map_t = std::map<ptrdiff_t, ptrdiff_t, less<ptrdiff_t>, map_alloc_t>;
+                map_t pq_x(std::less<ptrdiff_t>(), this->widths_.get_allocator());
+                map_t pq_y(std::less<ptrdiff_t>(), this->widths_.get_allocator());
+                ptrdiff_t w, h;
+                std::tie(w, h) = detail::eval_sp2_fused(this->sp_y_.cbegin(), 
+                    this->sp_y_.cend(), this->sp_x_.cbegin(), this->widths_.cbegin(),
+                    this->heights_.cbegin(), layout.x_begin(), layout.y_begin(),
+                    buffer, match, pq_x, pq_y);
 
                 assert(match == reinterpret_cast<size_t *>(res.data()));
                 auto sln_area = make_pair(static_cast<int>(w), static_cast<int>(h));
@@ -727,56 +1413,681 @@ namespace seqpair {
             }
         };
 
-        template<typename Alloc0, typename Alloc1>
-        void unguarded_copy_generator(const DagPackGeneratorBase<Alloc0> &src,
-            DagPackGeneratorBase<Alloc1> &dest) {
-            unguarded_copy_unbuffered_generator(src, dest);
-        }
-
-        template<typename Alloc0, typename Alloc1>
-        void unguarded_copy_unbuffered_generator(const DagPackGeneratorBase<Alloc0> &src,
-            DagPackGeneratorBase<Alloc1> &dest) {
-            dest.unguarded_assign(src);
-        }
-
-        // Pack generator which owns resource made by its base class.
-        template<typename BaseGenerator>
-        class BufferedPackGenerator : public BaseGenerator {
-            using self_t = BufferedPackGenerator<BaseGenerator>;
-            using base_t = BaseGenerator;
+        // Graph-free sequence-pair packing generator which does not own buffer resource.
+        // It computes the same longest paths as DagPackGeneratorBase, but 
+        // visits the components in the order of sp_y (a topological order of
+        // both constraint graphs) and scans a flat array of predecessors, so
+        // that no graph is built and the only memory used is resource_t.
+        template<typename Alloc = std::allocator<void *>>
+        class FlatDagPackGeneratorBase :
+            public DagPackGeneratorBase<Alloc, FlatDagPackGeneratorBase<Alloc>> {
+            using self_t = FlatDagPackGeneratorBase<Alloc>;
+            using base_t = DagPackGeneratorBase<Alloc, self_t>;
+            friend base_t;
 
         protected:
-            using typename base_t::resource_t;
             using typename base_t::size_vector_t;
             using typename base_t::sequence_pair_t;
             using typename base_t::momento_t;
 
         public:
             using typename base_t::allocator_type;
+            using typename base_t::resource_t;
             using typename base_t::change_t;
             using typename base_t::default_change_distribution;
-            using unbuffered_generator_t = base_t;
-            using buffered_generator_t = self_t;
-            using generator_tag = BufferedGeneratorTag;
-
-            BufferedPackGenerator() : BufferedPackGenerator(allocator_type()) { }
-
-            explicit BufferedPackGenerator(const allocator_type &alloc) : 
-                base_t(alloc), resource_(base_t::make_resource()) { }
+            using generator_tag = UnbufferedGeneratorTag;
 
-            template<typename Cont0, typename Cont1, typename Eng>
-                BufferedPackGenerator(Cont0 &&widths, Cont1 &&heights,
-                    Eng &&eng, const allocator_type &alloc = allocator_type()) :
-                base_t(std::forward<Cont0>(widths), std::forward<Cont1>(heights),
-                    std::forward<Eng>(eng), alloc),
-                resource_(base_t::make_resource()) { }
+            using base_t::DagPackGeneratorBase;
 
-            template<typename LayoutAlloc, typename Eng,
-                typename ChgDist = default_change_distribution, typename OtherAlloc>
-                std::pair<int, int> operator()(Layout<LayoutAlloc> &layout,
-                    Eng &&eng, ChgDist &&chg_dist) {
-                return base_t::operator()(layout, std::forward<Eng>(eng), resource_,
-                    std::forward<ChgDist>(chg_dist));
+            // Makes a resource object that can be shared.  
+            resource_t make_resource() const {
+                return resource_t(min_buffer_size(), this->widths_.get_allocator());
+            }
+
+        protected:
+            // Implements the evaluation stage of operator(...).
+            // Requires: widths and heights between this object and layout have
+            //      been synchronized.
+            template<typename LayoutAlloc, typename Eng>
+            std::pair<int, int> eval(Layout<LayoutAlloc> &layout,
+                Eng &&eng, resource_t &res) {
+                return *eval_until(layout, std::forward<Eng>(eng), res, never_exceeds());
+            }
+
+            // Implements the evaluation stage of eval_bounded(...). The 
+            // extents of the components visited so far bound the packing.
+            template<typename LayoutAlloc, typename Eng, typename Pred>
+            boost::optional<std::pair<int, int>> eval_until(Layout<LayoutAlloc> &layout,
+                Eng &&eng, resource_t &res, Pred &&exceeds) {
+                using namespace std;
+                if (layout.empty())
+                    return make_pair(0, 0);
+                auto min_buf_size = min_buffer_size();
+                if (res.size() < min_buf_size)
+                    res.resize(min_buf_size);
+                auto mem_src = res.data();
+                const auto sz = this->size();
+
+                // sx: position map of sp_x; keys, rights, tops: sx, right edge
+                // and top edge of components visited so far, in the order of sp_y.
+                auto sx = reinterpret_cast<size_t *>(mem_src);
+                mem_src += sz * sizeof(size_t);
+                auto keys = reinterpret_cast<size_t *>(mem_src);
+                mem_src += sz * sizeof(size_t);
+                auto rights = reinterpret_cast<int *>(mem_src);
+                mem_src += sz * sizeof(int);
+                auto tops = reinterpret_cast<int *>(mem_src);
+                detail::make_left_inverse(this->sp_x_.cbegin(), this->sp_x_.cend(), sx);
+
+                auto xs = layout.x_begin();
+                auto ys = layout.y_begin();
+                int w = 0, h = 0;
+                for (size_t k = 0; k != sz; ++k) {
+                    auto b = this->sp_y_[k];
+                    auto key = sx[b];
+                    int x = 0, y = 0;
+                    // Every visited component l precedes b in sp_y, so it is 
+                    // either to the left of b or below b.
+                    for (size_t l = 0; l != k; ++l) {
+                        if (keys[l] < key)
+                            x = max(x, rights[l]);
+                        else
+                            y = max(y, tops[l]);
+                    }
+                    keys[k] = key;
+                    rights[k] = x + this->widths_[b];
+                    tops[k] = y + this->heights_[b];
+                    xs[b] = x;
+                    ys[b] = y;
+                    w = max(w, rights[k]);
+                    h = max(h, tops[k]);
+                    if (exceeds(max(w, this->max_short_side_), max(h, this->max_short_side_)))
+                        return boost::none;
+                }
+
+                assert(make_pair(w, h) == layout.get_area());
+                return make_pair(w, h);
+            }
+
+            // Determines size of resource_t in bytes, which is the sum of 
+            // variables sx, keys, rights and tops.
+            auto min_buffer_size() const noexcept {
+                return 2 * this->size() * (sizeof(std::size_t) + sizeof(int));
+            }
+        };
+
+        // LCS-based sequence-pair packing generator which does not own buffer
+        // resource. Unlike LcsPackGeneratorBase, it keeps the LCS frontier in a
+        // Fenwick tree inside resource_t, so evaluation never allocates.
+        template<typename Alloc = std::allocator<void *>>
+        class FenwickLcsPackGeneratorBase :
+            public DagPackGeneratorBase<Alloc, FenwickLcsPackGeneratorBase<Alloc>> {
+            using self_t = FenwickLcsPackGeneratorBase<Alloc>;
+            using base_t = DagPackGeneratorBase<Alloc, self_t>;
+            friend base_t;
+
+        protected:
+            using typename base_t::size_vector_t;
+            using typename base_t::sequence_pair_t;
+            using typename base_t::momento_t;
+
+        public:
+            using typename base_t::allocator_type;
+            using typename base_t::resource_t;
+            using typename base_t::change_t;
+            using typename base_t::default_change_distribution;
+            using generator_tag = UnbufferedGeneratorTag;
+
+            using base_t::DagPackGeneratorBase;
+
+            // Makes a resource object that can be shared.  
+            resource_t make_resource() const {
+                return resource_t(min_buffer_size(), this->widths_.get_allocator());
+            }
+
+        protected:
+            // Implements the evaluation stage of operator(...).
+            template<typename LayoutAlloc, typename Eng>
+            std::pair<int, int> eval(Layout<LayoutAlloc> &layout,
+                Eng &&eng, resource_t &res) {
+                using namespace std;
+
+                // Deal with auxilary buffer.
+                auto min_buf_size = min_buffer_size();
+                if (res.size() < min_buf_size)
+                    res.resize(min_buf_size);
+                auto mem_src = res.data();
+                auto match = reinterpret_cast<size_t *>(mem_src);
+                mem_src += this->size() * sizeof(size_t);
+                auto buffer = reinterpret_cast<size_t *>(mem_src);
+                mem_src += this->size() * sizeof(size_t);
+                auto tree_x = reinterpret_cast<int *>(mem_src);
+                mem_src += this->size() * sizeof(int);
+                auto tree_y = reinterpret_cast<int *>(mem_src);
+
+                // Evaluate current state.
+                auto sln_area = detail::eval_sp2_fenwick_fused(this->sp_y_.cbegin(), 
+                    this->sp_y_.cend(), this->sp_x_.cbegin(), this->widths_.cbegin(),
+                    this->heights_.cbegin(), layout.x_begin(), layout.y_begin(),
+                    buffer, match, tree_x, tree_y);
+                assert(sln_area == layout.get_area());
+                return sln_area;
+            }
+
+            // Determines size of resource_t in bytes, which is the sum of 
+            // variables match, buffer, tree_x and tree_y.
+            auto min_buffer_size() const noexcept {
+                return 2 * this->size() * (sizeof(std::size_t) + sizeof(int));
+            }
+        };
+
+        // LCS-based sequence-pair packing generator which does not own buffer
+        // resource, using the O(n log_64 n) VebSet frontier of eval_sp2_veb.
+        template<typename Alloc = std::allocator<void *>>
+        class VebLcsPackGeneratorBase :
+            public DagPackGeneratorBase<Alloc, VebLcsPackGeneratorBase<Alloc>> {
+            using self_t = VebLcsPackGeneratorBase<Alloc>;
+            using base_t = DagPackGeneratorBase<Alloc, self_t>;
+            friend base_t;
+
+        protected:
+            using typename base_t::size_vector_t;
+            using typename base_t::sequence_pair_t;
+            using typename base_t::momento_t;
+
+        public:
+            using typename base_t::allocator_type;
+            using typename base_t::resource_t;
+            using typename base_t::change_t;
+            using typename base_t::default_change_distribution;
+            using generator_tag = UnbufferedGeneratorTag;
+
+            using base_t::DagPackGeneratorBase;
+
+            // Makes a resource object that can be shared.  
+            resource_t make_resource() const {
+                return resource_t(min_buffer_size(), this->widths_.get_allocator());
+            }
+
+        protected:
+            // Implements the evaluation stage of operator(...).
+            template<typename LayoutAlloc, typename Eng>
+            std::pair<int, int> eval(Layout<LayoutAlloc> &layout,
+                Eng &&eng, resource_t &res) {
+                return *eval_until(layout, std::forward<Eng>(eng), res, never_exceeds());
+            }
+
+            // Implements the evaluation stage of eval_bounded(...), giving up
+            // between the passes if the width is too large.
+            template<typename LayoutAlloc, typename Eng, typename Pred>
+            boost::optional<std::pair<int, int>> eval_until(Layout<LayoutAlloc> &layout,
+                Eng &&eng, resource_t &res, Pred &&exceeds) {
+                using namespace std;
+                if (layout.empty())
+                    return make_pair(0, 0);
+
+                // Deal with auxilary buffer.
+                auto min_buf_size = min_buffer_size();
+                if (res.size() < min_buf_size)
+                    res.resize(min_buf_size);
+                auto mem_src = res.data();
+                auto match = reinterpret_cast<size_t *>(mem_src);
+                mem_src += this->size() * sizeof(size_t);
+                auto buffer = reinterpret_cast<size_t *>(mem_src);
+                mem_src += this->size() * sizeof(size_t);
+                auto words = reinterpret_cast<uint64_t *>(mem_src);
+                mem_src += VebSet::words_needed(this->size()) * sizeof(uint64_t);
+                auto values = reinterpret_cast<int *>(mem_src);
+
+                // Evaluate current state.
+                auto w = detail::eval_sp2_veb(this->sp_y_.cbegin(), this->sp_y_.cend(),
+                    this->sp_x_.cbegin(), this->widths_.cbegin(), layout.x_begin(),
+                    buffer, match, words, values);
+                if (exceeds(w, this->max_short_side_))
+                    return boost::none;
+                auto h = detail::eval_sp2_veb(this->sp_y_.cbegin(), this->sp_y_.cend(),
+                    this->sp_x_.crbegin(), this->heights_.cbegin(), layout.y_begin(),
+                    buffer, match, words, values);
+
+                auto sln_area = make_pair(w, h);
+                assert(sln_area == layout.get_area());
+                return sln_area;
+            }
+
+            // Determines size of resource_t in bytes, which is the sum of 
+            // variables match, buffer, words and values.
+            auto min_buffer_size() const noexcept {
+                return this->size() * (2 * sizeof(std::size_t) + sizeof(int)) +
+                    VebSet::words_needed(this->size()) * sizeof(std::uint64_t);
+            }
+        };
+
+        template<typename Alloc>
+        class IncrementalLcsPackGeneratorBase;
+
+        template<typename Alloc0, typename Derived0, typename Alloc1>
+        void unguarded_copy_unbuffered_generator(
+            const DagPackGeneratorBase<Alloc0, Derived0> &src,
+            IncrementalLcsPackGeneratorBase<Alloc1> &dest);
+
+        // LCS-based sequence-pair packing generator which does not own buffer
+        // resource, and re-evaluates incrementally. The layout of the last 
+        // evaluation serves as the cache of positions. From last_change_ it
+        // derives the first step of each LCS pass that the move can affect,
+        // and recomputes only the steps after it (see eval_sp2_fenwick_from).
+        // Positions actually changed are logged, so that a rollback costs 
+        // O(changed): the layout is restored from the log at the next 
+        // evaluation. Once the cache is invalidated, the next evaluation 
+        // costs two full ones.
+        // Requires: the same layout is passed to successive calls of 
+        //      operator(...), unless construct, shuffle or a copy to this 
+        //      generator has intervened, after which the next evaluation 
+        //      rewrites it fully. The layout is stale after rollback until the
+        //      next evaluation.
+        template<typename Alloc = std::allocator<void *>>
+        class IncrementalLcsPackGeneratorBase :
+            public DagPackGeneratorBase<Alloc, IncrementalLcsPackGeneratorBase<Alloc>> {
+            using self_t = IncrementalLcsPackGeneratorBase<Alloc>;
+            using base_t = DagPackGeneratorBase<Alloc, self_t>;
+            friend base_t;
+
+        protected:
+            using typename base_t::size_vector_t;
+            using typename base_t::sequence_pair_t;
+            using typename base_t::momento_t;
+            using log_alloc_t = typename std::allocator_traits<Alloc>::template
+                rebind_alloc<std::pair<std::size_t, int>>;
+            using log_t = std::vector<std::pair<std::size_t, int>, log_alloc_t>;
+
+        public:
+            using typename base_t::allocator_type;
+            using typename base_t::resource_t;
+            using typename base_t::change_t;
+            using typename base_t::default_change_distribution;
+            using generator_tag = UnbufferedGeneratorTag;
+
+            // A pass whose unchanged prefix is shorter than size() / 
+            // full_eval_divisor is recomputed from scratch, skipping the build.
+            static constexpr std::size_t full_eval_divisor = 8;
+
+            using base_t::DagPackGeneratorBase;
+
+            // Makes a resource object that can be shared.
+            resource_t make_resource() const {
+                return resource_t(min_buffer_size(), this->widths_.get_allocator());
+            }
+
+            // Constructs from given args. This invalidates the subsequent call
+            // to rollback and the cache.
+            template<typename Cont0, typename Cont1, typename Eng>
+            void construct(Cont0 &&widths, Cont1 &&heights, Eng &&eng) {
+                base_t::construct(std::forward<Cont0>(widths),
+                    std::forward<Cont1>(heights), std::forward<Eng>(eng));
+                invalidate_cache();
+            }
+
+            // One-shot rollback. If cannot rollback, does nothing.
+            // The layout is restored by the next evaluation.
+            bool rollback() {
+                change_t chg; std::size_t i, j;
+                std::tie(chg, i, j) = this->last_change_;
+                if (!base_t::rollback())
+                    return false;
+                if (cache_valid_) {
+                    sync_cache(chg, i, j);
+                    undo_pending_ = true;
+                }
+                return true;
+            }
+
+            // Random shuffle. This invalidates the subsequent call to rollback
+            // and the cache.
+            template<typename Eng>
+            void shuffle(Eng &&eng, double p_rotate = 0.5) {
+                base_t::shuffle(std::forward<Eng>(eng), p_rotate);
+                invalidate_cache();
+            }
+
+            // Restores a saved state. This invalidates the subsequent call to
+            // rollback and the cache.
+            void restore(const typename base_t::checkpoint_t &cp) {
+                base_t::restore(cp);
+                invalidate_cache();
+            }
+
+            template<typename Alloc0, typename Derived0, typename Alloc1>
+            friend void unguarded_copy_unbuffered_generator(
+                const DagPackGeneratorBase<Alloc0, Derived0> &src,
+                IncrementalLcsPackGeneratorBase<Alloc1> &dest);
+
+        protected:
+            // Implements the evaluation stage of operator(...).
+            template<typename LayoutAlloc, typename Eng>
+            std::pair<int, int> eval(Layout<LayoutAlloc> &layout,
+                Eng &&eng, resource_t &res) {
+                return *eval_until(layout, std::forward<Eng>(eng), res, never_exceeds());
+            }
+
+            // Implements the evaluation stage of eval_bounded(...), giving up
+            // between the passes if the width is too large. Then the height 
+            // pass has overwritten nothing, so a rollback restores the layout
+            // as usual.
+            template<typename LayoutAlloc, typename Eng, typename Pred>
+            boost::optional<std::pair<int, int>> eval_until(Layout<LayoutAlloc> &layout,
+                Eng &&eng, resource_t &res, Pred &&exceeds) {
+                using namespace std;
+                const auto sz = this->size();
+                if (sz == 0)
+                    return make_pair(0, 0);
+
+                auto min_buf_size = min_buffer_size();
+                if (res.size() < min_buf_size)
+                    res.resize(min_buf_size);
+                auto tree = reinterpret_cast<int *>(res.data());
+                auto xs = layout.x_begin();
+                auto ys = layout.y_begin();
+
+                // Undo the evaluation that has been rolled back.
+                if (undo_pending_) {
+                    for (auto &e : x_log_)
+                        xs[e.first] = e.second;
+                    for (auto &e : y_log_)
+                        ys[e.first] = e.second;
+                    undo_pending_ = false;
+                }
+
+                change_t chg; size_t i, j;
+                std::tie(chg, i, j) = this->last_change_;
+                if (!cache_valid_) {
+                    // Evaluate the state before the change in full, so that
+                    // the change can be rolled back like any other.
+                    this->apply_change(chg, i, j, false);
+                    reset_cache();
+                    eval_from(xs, ys, tree, 0, 0, never_exceeds());
+                    this->apply_change(chg, i, j, true);
+                }
+
+                // Find the first dirty step of either pass.
+                sync_cache(chg, i, j);
+                size_t x_first, y_first;
+                std::tie(x_first, y_first) = dirty_steps(chg, i, j);
+                if (x_first < sz / full_eval_divisor)
+                    x_first = 0;
+                if (y_first < sz / full_eval_divisor)
+                    y_first = 0;
+                auto sln_area = eval_from(xs, ys, tree, x_first, y_first, exceeds);
+                assert(!sln_area || *sln_area == layout.get_area());
+                return sln_area;
+            }
+
+            // Recomputes the width pass from step x_first and the height pass
+            // from step y_first, logging the positions overwritten. Gives up
+            // before the height pass if exceeds(w, max_short_side_) holds.
+            template<typename RanIt, typename Pred>
+            boost::optional<std::pair<int, int>> eval_from(RanIt xs, RanIt ys, int *tree,
+                std::size_t x_first, std::size_t y_first, Pred &&exceeds) {
+                const auto sz = this->size();
+                x_log_.clear();
+                y_log_.clear();
+                auto w = detail::eval_sp2_fenwick_from(this->sp_x_.cbegin(), match_.cbegin(),
+                    sz, x_first, this->widths_.cbegin(), xs, tree, x_log_);
+                if (exceeds(w, this->max_short_side_))
+                    return boost::none;
+                auto h = detail::eval_sp2_fenwick_from(this->sp_x_.crbegin(), match_.crbegin(),
+                    sz, y_first, this->heights_.cbegin(), ys, tree, y_log_);
+                return std::make_pair(w, h);
+            }
+
+            // Returns: first steps of the width pass (in the order of sp_x) and
+            // of the height pass (in the reversed order of sp_x) that can be 
+            // affected by the change. Requires: the cache is synchronized.
+            std::pair<std::size_t, std::size_t> dirty_steps(change_t chg,
+                std::size_t i, std::size_t j) const {
+                using namespace std;
+                const auto sz = this->size();
+                size_t lo = sz, hi = 0;     // Affected indices of sp_x
+                auto touch = [&](size_t k) {
+                    lo = min(lo, k);
+                    hi = max(hi, k + 1);
+                };
+
+                switch (chg) {
+                case change_t::none:
+                    break;
+
+                case change_t::rotate:
+                    touch(ix_[i]);
+                    break;
+
+                case change_t::swap_x:
+                case change_t::swap_y:
+                case change_t::swap_xy:
+                    // Only relations with the swapped components change.
+                    if (chg != change_t::swap_y) {
+                        touch(i);
+                        touch(j);
+                    }
+                    if (chg != change_t::swap_x) {
+                        touch(ix_[this->sp_y_[i]]);
+                        touch(ix_[this->sp_y_[j]]);
+                    }
+                    break;
+
+                case change_t::rotate_x:
+                case change_t::rotate_y:
+                case change_t::rotate_xy:
+                    if (chg != change_t::rotate_y) {
+                        touch(i);
+                        touch(j - 1);
+                    }
+                    // Only relations with the moved component change.
+                    if (chg != change_t::rotate_x)
+                        touch(ix_[this->sp_y_[j - 1]]);
+                    break;
+
+                case change_t::reverse_x:
+                case change_t::reverse_y:
+                case change_t::reverse_xy:
+                    if (chg != change_t::reverse_y) {
+                        touch(i);
+                        touch(j - 1);
+                    }
+                    if (chg != change_t::reverse_x)
+                        for (auto k = i; k != j; ++k)
+                            touch(ix_[this->sp_y_[k]]);
+                    break;
+
+                default:
+                    assert(("no match for switch", false));
+                }
+
+                if (lo == sz)
+                    return { sz, sz };
+                return { lo, sz - hi };
+            }
+
+            // Updates inverse sequences and match after the change, or its 
+            // rollback, in O(changed).
+            void sync_cache(change_t chg, std::size_t i, std::size_t j) {
+                bool on_x = false, on_y = false;
+                switch (chg) {
+                case change_t::swap_x:
+                case change_t::swap_y:
+                case change_t::swap_xy:
+                    on_x = chg != change_t::swap_y;
+                    on_y = chg != change_t::swap_x;
+                    for (auto k : { i, j }) {
+                        if (on_x)
+                            ix_[this->sp_x_[k]] = k;
+                        if (on_y)
+                            iy_[this->sp_y_[k]] = k;
+                    }
+                    for (auto k : { i, j }) {
+                        if (on_x)
+                            match_[k] = iy_[this->sp_x_[k]];
+                        if (on_y)
+                            match_[ix_[this->sp_y_[k]]] = k;
+                    }
+                    return;
+
+                case change_t::rotate_x:
+                case change_t::reverse_x:
+                    on_x = true;
+                    break;
+
+                case change_t::rotate_y:
+                case change_t::reverse_y:
+                    on_y = true;
+                    break;
+
+                case change_t::rotate_xy:
+                case change_t::reverse_xy:
+                    on_x = on_y = true;
+                    break;
+
+                default:
+                    return;
+                }
+
+                for (auto k = i; k != j; ++k) {
+                    if (on_x)
+                        ix_[this->sp_x_[k]] = k;
+                    if (on_y)
+                        iy_[this->sp_y_[k]] = k;
+                }
+                for (auto k = i; k != j; ++k) {
+                    if (on_x)
+                        match_[k] = iy_[this->sp_x_[k]];
+                    if (on_y)
+                        match_[ix_[this->sp_y_[k]]] = k;
+                }
+            }
+
+            void invalidate_cache() noexcept {
+                cache_valid_ = false;
+                undo_pending_ = false;
+            }
+
+            // Rebuilds inverse sequences and match.
+            void reset_cache() {
+                const auto sz = this->size();
+                ix_.resize(sz);
+                iy_.resize(sz);
+                match_.resize(sz);
+                detail::make_left_inverse(this->sp_x_.cbegin(), this->sp_x_.cend(), ix_.begin());
+                detail::make_match(this->sp_y_.cbegin(), this->sp_y_.cend(), 
+                    this->sp_x_.cbegin(), match_.begin(), iy_.begin());
+                x_log_.reserve(sz);
+                y_log_.reserve(sz);
+                cache_valid_ = true;
+            }
+
+            // Determines size of resource_t in bytes, which is variable tree.
+            auto min_buffer_size() const noexcept {
+                return this->size() * sizeof(int);
+            }
+
+            sequence_pair_t ix_, iy_;   // Left inversions of sp_x and sp_y
+            sequence_pair_t match_;     // inv(sp_y) * sp_x
+            log_t x_log_, y_log_;       // Positions overwritten by the last eval
+            bool cache_valid_ = false;
+            bool undo_pending_ = false; // Whether the logs are to be undone
+        };
+
+        template<typename Alloc0, typename Derived0, typename Alloc1, typename Derived1>
+        void unguarded_copy_generator(const DagPackGeneratorBase<Alloc0, Derived0> &src,
+            DagPackGeneratorBase<Alloc1, Derived1> &dest) {
+            unguarded_copy_unbuffered_generator(src, dest);
+        }
+
+        template<typename Alloc0, typename Derived0, typename Alloc1, typename Derived1>
+        void unguarded_copy_unbuffered_generator(
+            const DagPackGeneratorBase<Alloc0, Derived0> &src,
+            DagPackGeneratorBase<Alloc1, Derived1> &dest) {
+            dest.unguarded_assign(src);
+        }
+
+        // Copies the sequence pair only, so the cache of dest is invalidated.
+        template<typename Alloc0, typename Derived0, typename Alloc1>
+        void unguarded_copy_unbuffered_generator(
+            const DagPackGeneratorBase<Alloc0, Derived0> &src,
+            IncrementalLcsPackGeneratorBase<Alloc1> &dest) {
+            using dest_base_t = DagPackGeneratorBase<Alloc1,
+                IncrementalLcsPackGeneratorBase<Alloc1>>;
+            unguarded_copy_unbuffered_generator(src, static_cast<dest_base_t &>(dest));
+            dest.invalidate_cache();
+        }
+
+        template<typename Alloc0, typename Derived0, typename Alloc1>
+        void unguarded_copy_generator(const DagPackGeneratorBase<Alloc0, Derived0> &src,
+            IncrementalLcsPackGeneratorBase<Alloc1> &dest) {
+            unguarded_copy_unbuffered_generator(src, dest);
+        }
+
+        // Pack generator which owns resource made by its base class.
+        template<typename BaseGenerator>
+        class BufferedPackGenerator : public BaseGenerator {
+            using self_t = BufferedPackGenerator<BaseGenerator>;
+            using base_t = BaseGenerator;
+
+        protected:
+            using typename base_t::resource_t;
+            using typename base_t::size_vector_t;
+            using typename base_t::sequence_pair_t;
+            using typename base_t::momento_t;
+
+        public:
+            using typename base_t::allocator_type;
+            using typename base_t::change_t;
+            using typename base_t::default_change_distribution;
+            using unbuffered_generator_t = base_t;
+            using buffered_generator_t = self_t;
+            using generator_tag = BufferedGeneratorTag;
+
+            BufferedPackGenerator() : BufferedPackGenerator(allocator_type()) { }
+
+            explicit BufferedPackGenerator(const allocator_type &alloc) : 
+                base_t(alloc), resource_(base_t::make_resource()) { }
+
+            template<typename Cont0, typename Cont1, typename Eng>
+                BufferedPackGenerator(Cont0 &&widths, Cont1 &&heights,
+                    Eng &&eng, const allocator_type &alloc = allocator_type()) :
+                base_t(std::forward<Cont0>(widths), std::forward<Cont1>(heights),
+                    std::forward<Eng>(eng), alloc),
+                resource_(base_t::make_resource()) { }
+
+            template<typename LayoutAlloc, typename Eng,
+                typename ChgDist = default_change_distribution, typename OtherAlloc>
+                std::pair<int, int> operator()(Layout<LayoutAlloc> &layout,
+                    Eng &&eng, ChgDist &&chg_dist) {
+                return base_t::operator()(layout, std::forward<Eng>(eng), resource_,
+                    std::forward<ChgDist>(chg_dist));
+            }
+
+            template<typename LayoutAlloc, typename Eng, typename ChgDist,
+                typename EFunc, typename OutIt>
+                OutIt eval_batch(Layout<LayoutAlloc> &layout, Eng &&eng, ChgDist &&chg_dist,
+                    std::size_t k, EFunc &&energy_func, OutIt out) {
+                return base_t::eval_batch(layout, std::forward<Eng>(eng), resource_,
+                    std::forward<ChgDist>(chg_dist), k, std::forward<EFunc>(energy_func), out);
+            }
+
+            template<typename LayoutAlloc, typename Eng, typename ChgDist, typename Pred>
+                boost::optional<std::pair<int, int>> eval_bounded(Layout<LayoutAlloc> &layout,
+                    Eng &&eng, ChgDist &&chg_dist, Pred &&exceeds) {
+                return base_t::eval_bounded(layout, std::forward<Eng>(eng), resource_,
+                    std::forward<ChgDist>(chg_dist), std::forward<Pred>(exceeds));
+            }
+
+            template<typename LayoutAlloc, typename Eng>
+            std::pair<int, int> apply(const typename base_t::candidate_t &cand,
+                Layout<LayoutAlloc> &layout, Eng &&eng) {
+                return base_t::apply(cand, layout, std::forward<Eng>(eng), resource_);
+            }
+
+            template<typename LayoutAlloc, typename Eng>
+            std::pair<int, int> evaluate(Layout<LayoutAlloc> &layout, Eng &&eng) {
+                return base_t::evaluate(layout, std::forward<Eng>(eng), resource_);
             }
 
             template<typename BaseGenerator0, typename BaseGenerator1>
@@ -797,6 +2108,22 @@ namespace seqpair {
     template<typename Alloc = std::allocator<void *>>
     using LcsPackGenerator = detail::BufferedPackGenerator<detail::LcsPackGeneratorBase<Alloc>>;
 
+    template<typename Alloc = std::allocator<void *>>
+    using FlatDagPackGenerator = 
+        detail::BufferedPackGenerator<detail::FlatDagPackGeneratorBase<Alloc>>;
+
+    template<typename Alloc = std::allocator<void *>>
+    using FenwickLcsPackGenerator = 
+        detail::BufferedPackGenerator<detail::FenwickLcsPackGeneratorBase<Alloc>>;
+
+    template<typename Alloc = std::allocator<void *>>
+    using VebLcsPackGenerator = 
+        detail::BufferedPackGenerator<detail::VebLcsPackGeneratorBase<Alloc>>;
+
+    template<typename Alloc = std::allocator<void *>>
+    using IncrementalLcsPackGenerator = 
+        detail::BufferedPackGenerator<detail::IncrementalLcsPackGeneratorBase<Alloc>>;
+
     using seqpair::detail::PackGeneratorBase;
 
     namespace detail {
@@ -0,0 +1,324 @@
+// pt_packer.h: PtPacker (optimizer) using parallel tempering.
+// Author: LYL (Aureliano Lee)
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "deadline.h"
+#include "thread_pool.h"
+#include "layout.h"
+#include "pack_generator.h"
+#include "sa_packer.h"
+
+namespace seqpair {
+    // Base of PtPacker with default types.
+    struct PtPackerBase : public SaPackerBase {
+        // Options for parallel tempering. Of options_t,
+        // initial_accepting_probability decides the highest temperature, and
+        // simulaions_per_temperature the moves of each replica between two
+        // exchanges.
+        struct tempering_options_t {
+            std::size_t num_threads = 1;
+            std::size_t num_replicas = 0;               // 0 for one per thread
+            double lowest_temperature_ratio = 1e-3;     // Lowest / highest
+            std::size_t stable_rounds = 20;             // Rounds to stop
+        };
+    };
+
+    std::ostream &operator<<(std::ostream &out,
+        const typename PtPackerBase::tempering_options_t &opts) {
+        out << "num_threads: " << opts.num_threads << "\n";
+        out << "num_replicas: " << opts.num_replicas << "\n";
+        out << "lowest_temperature_ratio: " << opts.lowest_temperature_ratio << "\n";
+        out << "stable_rounds: " << opts.stable_rounds << "\n";
+        return out;
+    }
+
+    // Parallel tempering (replica exchange) packer. Replicas of the generator
+    // and the layout anneal at fixed temperatures, spaced geometrically,
+    // on a thread pool. After each round, replicas at neighbouring
+    // temperatures are exchanged with the Metropolis rule, and it stops
+    // when the best energy has not improved for stable_rounds rounds, or
+    // the deadline has passed, which also cuts the current round short.
+    // Note: energy function and change distribution are invoked concurrently,
+    //      so each replica works on copies of them.
+    template<typename Generator, typename EFunc =
+        typename PtPackerBase::default_energy_function>
+    class PtPacker : public PtPackerBase {
+        using self_t = PtPacker;
+        using base_t = PtPackerBase;
+
+    public:
+        using typename base_t::options_t;
+        using typename base_t::tempering_options_t;
+        using typename base_t::default_energy_function;
+        using generator_t = typename Generator::unbuffered_generator_t;
+        using energy_function_t = EFunc;
+
+    protected:
+        using generator_allocator_type = typename generator_t::allocator_type;
+        using generator_default_change_distribution =
+            typename generator_t::default_change_distribution;
+
+    public:
+        explicit PtPacker(const options_t &opts = options_t(),
+            const tempering_options_t &pt_opts = tempering_options_t(),
+            const energy_function_t &func = energy_function_t(),
+            const generator_allocator_type &alloc = generator_allocator_type()) :
+            opts_(check_option(opts)), pt_opts_(check_option(pt_opts)),
+            energy_func_(func), eng_(SEQPAIR_RANDOM_SEED()), generator_(alloc) { }
+
+        const options_t &options() const {
+            return opts_;
+        }
+
+        void set_options(const options_t &opts) {
+            opts_ = check_option(opts);
+        }
+
+        const tempering_options_t &tempering_options() const {
+            return pt_opts_;
+        }
+
+        void set_tempering_options(const tempering_options_t &pt_opts) {
+            pt_opts_ = check_option(pt_opts);
+        }
+
+        const energy_function_t &energy_function() const {
+            return energy_func_;
+        }
+
+        void set_energy_function(const energy_function_t &func) {
+            energy_func_ = func;
+        }
+
+        const aureliano::deadline &deadline() const {
+            return deadline_;
+        }
+
+        // Sets the wall-clock budget of the following runs. The temperatures
+        // are fixed, so it only cuts the rounds.
+        void set_deadline(const aureliano::deadline &d) {
+            deadline_ = d;
+        }
+
+        // Generates the solution and writes it to layout.
+        template<typename LayoutAlloc, typename FwdIt,
+            typename ChgDist = generator_default_change_distribution>
+            double operator()(Layout<LayoutAlloc> &layout, FwdIt first_line, FwdIt last_line,
+                ChgDist &&chg_dist = ChgDist(), int verbose_level = 1) {
+            using namespace std;
+            using layout_t = Layout<LayoutAlloc>;
+            using chg_dist_t = decay_t<ChgDist>;
+
+            struct replica_t {
+                generator_t gen;
+                typename generator_t::resource_t res;
+                layout_t layout, best_layout;
+                default_random_engine eng;
+                chg_dist_t chg_dist;
+                energy_function_t energy_func;
+                double energy, best_energy;
+                size_t num_acceptions;
+            };
+
+            if (layout.empty())
+                return 0;
+
+            // Deferred generator construction from layout, and the highest
+            // temperature determined as SaPacker does.
+            generator_.construct(layout.widths(), layout.heights(), eng_);
+            auto res = generator_.make_resource();
+            auto local_layout = layout;
+            double sum_energies = 0, sum_sqrs = 0;
+            constexpr size_t init_sims = 64;
+            for (size_t i = 0; i != init_sims; ++i) {
+                int w, h;
+                std::tie(w, h) = generator_(local_layout, eng_, res, chg_dist);
+                auto e = energy_func_(local_layout, first_line, last_line, w, h);
+                detail::commit_energy(energy_func_, 0);
+                sum_energies += e;
+                sum_sqrs += e * e;
+                generator_.shuffle(eng_);
+            }
+            auto stddev = sqrt(max(0.0, (sum_sqrs - sum_energies * sum_energies / init_sims) /
+                (init_sims - 1)));
+            double max_temp = (stddev + numeric_limits<double>().epsilon()) /
+                log(1.0 / opts_.initial_accepting_probability);
+
+            // Replicas, where replica slots[k] runs at temps[k] (ascending).
+            aureliano::thread_pool pool(pt_opts_.num_threads);
+            auto num_replicas = pt_opts_.num_replicas ? pt_opts_.num_replicas : pool.size();
+            vector<double> temps(num_replicas);
+            for (size_t k = 0; k != num_replicas; ++k) {
+                auto t = num_replicas == 1 ? 0.0 :
+                    static_cast<double>(num_replicas - 1 - k) / (num_replicas - 1);
+                temps[k] = max_temp * pow(pt_opts_.lowest_temperature_ratio, t);
+            }
+            vector<replica_t> replicas;
+            replicas.reserve(num_replicas);
+            for (size_t k = 0; k != num_replicas; ++k) {
+                replicas.push_back(replica_t{ generator_, generator_.make_resource(),
+                    local_layout, local_layout, default_random_engine(eng_()),
+                    chg_dist_t(chg_dist), energy_func_, 0, 0, 0 });
+                auto &r = replicas.back();
+                r.gen.shuffle(r.eng);
+                int w, h;
+                std::tie(w, h) = r.gen(r.layout, r.eng, r.res, r.chg_dist);
+                r.energy = r.best_energy = r.energy_func(r.layout, first_line, last_line, w, h);
+                detail::commit_energy(r.energy_func, 0);
+                detail::unguarded_copy_layout(r.layout, r.best_layout);
+            }
+            vector<size_t> slots(num_replicas);
+            iota(slots.begin(), slots.end(), 0);
+
+            if (verbose_level) {
+                cerr << "\n";
+                cerr << "Replicas: " << num_replicas << ", threads: " << pool.size() << "\n";
+                cerr << "Temperatures: " << temps.front() << " - " << temps.back() << "\n";
+                if (verbose_level >= 2)
+                    cerr << "\n";
+            }
+
+            // Main simulation process.
+            auto best = min_element(replicas.begin(), replicas.end(),
+                [](const auto &a, const auto &b) { return a.best_energy < b.best_energy; });
+            double min_energy = best->best_energy;
+            auto best_layout = best->best_layout;
+            size_t num_rounds = 0, num_stable_rounds = 0;
+            size_t num_exchanges = 0, num_tries = 0;
+            auto local_deadline = deadline_;
+            bool timed_out = false;
+
+            while (num_stable_rounds < pt_opts_.stable_rounds && 
+                !(timed_out = local_deadline.expired_now())) {
+                pool.parallel_for(num_replicas, [&](size_t k) {
+                    auto &r = replicas[slots[k]];
+                    auto temp = temps[k];
+                    auto replica_deadline = local_deadline;
+                    uniform_real_distribution<> rand_double(0, 1);
+                    r.num_acceptions = 0;
+                    for (size_t i = 0; i != opts_.simulaions_per_temperature &&
+                        !replica_deadline.expired(); ++i) {
+                        int w, h;
+                        std::tie(w, h) = r.gen(r.layout, r.eng, r.res, r.chg_dist);
+                        auto new_energy = r.energy_func(r.layout, first_line, last_line, w, h);
+                        if (new_energy < r.energy ||
+                            rand_double(r.eng) < exp((r.energy - new_energy) / temp)) {
+                            detail::commit_energy(r.energy_func, 0);
+                            if (new_energy < r.best_energy) {
+                                detail::unguarded_copy_layout(r.layout, r.best_layout);
+                                r.best_energy = new_energy;
+                            }
+                            r.energy = new_energy;
+                            ++r.num_acceptions;
+                        } else {
+                            detail::rollback_energy(r.energy_func, 0);
+                            auto b = r.gen.rollback();
+                            assert(detail::may_change_be_none(r.chg_dist) || b);
+                            (void)b;
+                        }
+                    }
+                });
+                ++num_rounds;
+
+                ++num_stable_rounds;
+                for (auto &r : replicas) {
+                    if (r.best_energy < min_energy) {
+                        detail::unguarded_copy_layout(r.best_layout, best_layout);
+                        min_energy = r.best_energy;
+                        num_stable_rounds = 0;
+                    }
+                }
+
+                // Exchange neighbouring replicas, alternating even and odd pairs.
+                uniform_real_distribution<> rand_double(0, 1);
+                for (size_t k = num_rounds & 1; k + 1 < num_replicas; k += 2) {
+                    auto &r0 = replicas[slots[k]], &r1 = replicas[slots[k + 1]];
+                    auto delta = (r1.energy - r0.energy) * (1 / temps[k] - 1 / temps[k + 1]);
+                    ++num_tries;
+                    if (delta <= 0 || rand_double(eng_) < exp(-delta)) {
+                        swap(slots[k], slots[k + 1]);
+                        ++num_exchanges;
+                    }
+                }
+
+                if (verbose_level >= 2) {
+                    cerr << "Round: " << num_rounds << ", min energy: " << min_energy <<
+                        ", acception rates:";
+                    for (size_t k = 0; k != num_replicas; ++k)
+                        cerr << " " << static_cast<double>(replicas[slots[k]].num_acceptions) /
+                            opts_.simulaions_per_temperature;
+                    cerr << "\n";
+                }
+            }
+
+            // Output results
+            if (verbose_level) {
+                cerr << "\n";
+                cerr << "Finishing energy: " << min_energy << "\n";
+                cerr << "Total rounds: " << num_rounds << "\n";
+                cerr << "Total simulations: " <<
+                    num_rounds * num_replicas * opts_.simulaions_per_temperature << "\n";
+                cerr << "Exchange rate: " << (num_tries ?
+                    static_cast<double>(num_exchanges) / num_tries : 0.0) << "\n";
+                if (timed_out)
+                    cerr << "Time limit reached." << "\n";
+            }
+            layout = std::move(best_layout);
+            return min_energy;
+        }
+
+    protected:
+        // Checks option.
+        bool is_option_valid(const options_t &opts) const noexcept {
+            return opts.initial_accepting_probability > 0 &&
+                opts.initial_accepting_probability < 1 &&
+                opts.simulaions_per_temperature;
+        }
+
+        // Checks option.
+        bool is_option_valid(const tempering_options_t &opts) const noexcept {
+            return opts.lowest_temperature_ratio > 0 &&
+                opts.lowest_temperature_ratio <= 1 &&
+                opts.stable_rounds;
+        }
+
+        // Throws on invalid option.
+        template<typename Options>
+        const Options &check_option(const Options &opts) const {
+            if (!is_option_valid(opts))
+                throw std::invalid_argument("Invalid argument");
+            return opts;
+        }
+
+        options_t opts_;
+        tempering_options_t pt_opts_;
+        energy_function_t energy_func_;
+        std::default_random_engine eng_;
+        generator_t generator_;
+        aureliano::deadline deadline_;
+    };
+
+    // Helper function for constructing PtPacker.
+    template<typename Generator, typename EFunc =
+        typename PtPackerBase::default_energy_function, typename... Types>
+        PtPacker<Generator, std::decay_t<EFunc>>
+        makePtPacker(const typename PtPackerBase::options_t &opts =
+            typename PtPackerBase::options_t(),
+            const typename PtPackerBase::tempering_options_t &pt_opts =
+            typename PtPackerBase::tempering_options_t(), EFunc &&func = EFunc(),
+            Types &&...args) {
+        return PtPacker<Generator, std::decay_t<EFunc>>(opts, pt_opts,
+            std::forward<EFunc>(func), std::forward<Types>(args)...);
+    }
+}
@@ -12,13 +12,17 @@
 #include <boost/program_options.hpp>
 #include <boost/pool/pool_alloc.hpp>
 
+#include "deadline.h"
 #include "timeit.h"
 #include "toolbox.h"
 #include "layout.h"
 #include "pack_generator.h"
 #include "sa_packer.h"
+#include "pt_packer.h"
+#include "wirelength.h"
 #include "verification.h"
 #include "interpreter.h"
+#include "netlist.h"
 
 using namespace std;
 using namespace seqpair;
@@ -26,8 +30,8 @@ namespace po = boost::program_options;
 
 namespace {
 
-    template<typename Generator, typename Alloc, typename FwdIt>
-    void run_packer(SaPacker<Generator> &packer, Layout<Alloc> &layout, 
+    template<typename Packer, typename Alloc, typename FwdIt>
+    void run_packer(Packer &packer, Layout<Alloc> &layout, 
         FwdIt first_line, FwdIt last_line, ostream &out, 
         int verbose_level) {
         using namespace seqpair::verification;
@@ -59,7 +63,7 @@ namespace {
         }
         cerr << "Utilization: " << 1.0 * sum_rect_areas /
             (sln_area.first * sln_area.second) << "\n";
-        auto wirelen = sum_manhattan_distances(layout, first_line, last_line);
+        auto wirelen = packer.energy_function().hpwl.evaluate(layout);
         cerr << "Wirelength: " << wirelen << "\n";
         cerr << "Cost: " << cost << "\n";
 
@@ -76,6 +80,29 @@ namespace {
         out << layout.format(format_policy::no_delim);
     }
 
+    // Runs SaPacker, or PtPacker on num_threads threads if num_threads > 1,
+    // either of which stops with its best solution by the deadline.
+    // Note: replicas of PtPacker run concurrently, so they allocate from
+    //      std::allocator rather than the shared pool.
+    template<template<typename> class Generator, typename EFunc, typename Alloc,
+        typename FwdIt>
+    void run_method(const SaPackerBase::options_t &opts, size_t num_threads,
+        const aureliano::deadline &deadline, const EFunc &func, Layout<Alloc> &layout,
+        FwdIt first_line, FwdIt last_line, ostream &out, int verbose_level) {
+        if (num_threads > 1) {
+            PtPackerBase::tempering_options_t pt_opts;
+            pt_opts.num_threads = num_threads;
+            cerr << pt_opts;
+            auto packer = makePtPacker<Generator<std::allocator<char>>>(opts, pt_opts, func);
+            packer.set_deadline(deadline);
+            run_packer(packer, layout, first_line, last_line, out, verbose_level);
+        } else {
+            auto packer = makeSaPacker<Generator<boost::fast_pool_allocator<char>>>(opts, func);
+            packer.set_deadline(deadline);
+            run_packer(packer, layout, first_line, last_line, out, verbose_level);
+        }
+    }
+
     unordered_map<string, size_t> make_modulename_index(const yal::Interpreter &i) {
         unordered_map<string, size_t> map;
         map.reserve(i.modules().size());
@@ -99,8 +126,16 @@ int main(int argc, char **argv) {
             "output placement file (default cout)")
         ("option,O", po::value< vector<string> >(), 
             "option file")
+        ("candidates,k", po::value<size_t>()->default_value(1), 
+            "candidate moves per step, the best of which is tested")
+        ("threads,t", po::value<size_t>()->default_value(1), 
+            "threads of parallel tempering (1 for simulated annealing)")
+        ("alpha", po::value<double>()->default_value(1.0), 
+            "weight of area against wirelength in the cost (0-1)")
+        ("time-limit", po::value<double>()->default_value(0), 
+            "wall-clock budget in seconds (0 unlimited)")
         ("method,m", po::value< vector<string> >(), 
-            "method (lcs/dag, default lcs)")
+            "method (lcs/lcs-fenwick/lcs-veb/lcs-inc/dag/flat-dag, default lcs)")
         ("verbose,v", po::value<int>()->default_value(1)->implicit_value(2), 
             "verbose level (0-2)")
         ;
@@ -115,25 +150,29 @@ int main(int argc, char **argv) {
     }
 
     try {
+        auto time_limit = vm["time-limit"].as<double>();
+        if (!(time_limit >= 0))
+            throw runtime_error("Invalid time limit");
+        auto deadline = time_limit > 0 ?
+            aureliano::deadline(chrono::duration<double>(time_limit)) :
+            aureliano::deadline();
+
         string method = "lcs";
         if (vm.count("method")) {
             method = vm["method"].as<vector<string>>().back();
             for (auto &e : method)
                 e = tolower(e);
-            if (method != "lcs" && method != "dag")
+            if (method != "lcs" && method != "lcs-fenwick" && method != "lcs-veb"
+                && method != "lcs-inc"
+                && method != "dag" && method != "flat-dag")
                 throw runtime_error("Unrecognized method: " + method);
         }
         
         yal::Interpreter interpreter;
-        ifstream fin;
-        if (vm.count("input")) {
-            auto &&v = vm["input"].as<vector<string>>();
-            fin.open(vm["input"].as<vector<string>>().back());
-            if (!fin.is_open())
-                throw runtime_error("Cannot open file");
-            interpreter.switch_input_stream(fin);
-        } 
-        interpreter.parse();
+        if (vm.count("input"))
+            interpreter.parse_file(vm["input"].as<vector<string>>().back());
+        else
+            interpreter.parse();
 
         unordered_map<string, size_t> name_map = make_modulename_index(interpreter);
         Layout<> layout;
@@ -156,6 +195,7 @@ int main(int argc, char **argv) {
             opts.simulaions_per_temperature
                 = max(30 * layout.size(), static_cast<size_t>(1024));
         }
+        opts.candidates_per_move = vm["candidates"].as<size_t>();
 
         ostream *out = &cout;
         ofstream fout;
@@ -165,22 +205,50 @@ int main(int argc, char **argv) {
         }
 
         int verbose_level = vm["verbose"].as<int>();
+        auto num_threads = vm["threads"].as<size_t>();
+
+        auto alpha = vm["alpha"].as<double>();
+        if (!(alpha >= 0 && alpha <= 1))
+            throw runtime_error("Invalid alpha");
 
+        yal::Netlist netlist(interpreter.modules(), interpreter.parent_module(),
+            interpreter.make_module_index());
+        // Nets are bound to the energy function rather than passed as lines.
         vector<pair<size_t, size_t>> nets;
 
         cerr << "Rectangles: " << layout.size() << "\n";
-        SaPackerBase::default_energy_function func(1.0);
+        cerr << "Nets: " << netlist.num_nets() << ", pins: " << netlist.num_pins() << "\n";
+        cerr << "Alpha: " << alpha << "\n";
+        if (alpha < 1)
+            cerr << "Bbox kernels: " << to_string(get_bbox_kernels().isa) << "\n";
+        hpwl_energy_function func(alpha, IncrementalHpwl(netlist.net_offsets(),
+            netlist.pin_modules(), netlist.pin_x(), netlist.pin_y(), layout.widths(),
+            layout.heights()));
 
         if (method == "dag") {
             cerr << "Method: DAG" << "\n";
-            auto packer = makeSaPacker<
-                DagPackGenerator<boost::fast_pool_allocator<char>>>(opts, func);
-            run_packer(packer, layout, begin(nets), end(nets), *out, verbose_level);
+            run_method<DagPackGenerator>(opts, num_threads, deadline, func, layout,
+                begin(nets), end(nets), *out, verbose_level);
         } else if (method == "lcs") {
             cerr << "Method: LCS" << "\n";
-            auto packer = makeSaPacker<
-                LcsPackGenerator<boost::fast_pool_allocator<char>>>(opts, func);
-            run_packer(packer, layout, begin(nets), end(nets), *out, verbose_level);
+            run_method<LcsPackGenerator>(opts, num_threads, deadline, func, layout,
+                begin(nets), end(nets), *out, verbose_level);
+        } else if (method == "lcs-fenwick") {
+            cerr << "Method: LCS (Fenwick)" << "\n";
+            run_method<FenwickLcsPackGenerator>(opts, num_threads, deadline, func, layout,
+                begin(nets), end(nets), *out, verbose_level);
+        } else if (method == "lcs-veb") {
+            cerr << "Method: LCS (vEB)" << "\n";
+            run_method<VebLcsPackGenerator>(opts, num_threads, deadline, func, layout,
+                begin(nets), end(nets), *out, verbose_level);
+        } else if (method == "lcs-inc") {
+            cerr << "Method: LCS (incremental)" << "\n";
+            run_method<IncrementalLcsPackGenerator>(opts, num_threads, deadline, func, layout,
+                begin(nets), end(nets), *out, verbose_level);
+        } else if (method == "flat-dag") {
+            cerr << "Method: flat DAG" << "\n";
+            run_method<FlatDagPackGenerator>(opts, num_threads, deadline, func, layout,
+                begin(nets), end(nets), *out, verbose_level);
         } else {
             assert(false);
         }
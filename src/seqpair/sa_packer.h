@@ -2,15 +2,18 @@
 // Author: LYL (Aureliano Lee)
 
 #pragma once
+#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <condition_variable>
 #include <iostream>
+#include <limits>
 #include <mutex>
 #include <random>
 #include <thread>
 #include <vector>
 #include <boost/pool/pool_alloc.hpp>
+#include "deadline.h"
 #include "layout.h"
 #include "pack_generator.h"
 
@@ -43,6 +46,28 @@ namespace seqpair {
         return alpha * area + (1 - alpha) * len;
     }
 
+    namespace detail {
+        // Tells an energy function keeping state across packings (e.g.,
+        // hpwl_energy_function) that the last packing is accepted.
+        template<typename EFunc>
+        auto commit_energy(EFunc &func, int) -> decltype(func.commit(), void()) {
+            func.commit();
+        }
+
+        template<typename EFunc>
+        void commit_energy(const EFunc &, long) noexcept { }
+
+        // Tells an energy function keeping state across packings that the
+        // packings since the last commit are rejected.
+        template<typename EFunc>
+        auto rollback_energy(EFunc &func, int) -> decltype(func.rollback(), void()) {
+            func.rollback();
+        }
+
+        template<typename EFunc>
+        void rollback_energy(const EFunc &, long) noexcept { }
+    }
+
     // Base of SaPacker with default types.
     struct SaPackerBase {
         // Evaluation function (packing_cost with binded alpha). 
@@ -57,6 +82,14 @@ namespace seqpair {
                 return packing_cost(layout, first, last, w, h, alpha);
             }
 
+            // Lower bound of the energy of packings at least w wide and h 
+            // high (wirelength being at least 0).
+            double lower_bound(int w, int h) const noexcept {
+                if (alpha > 1)
+                    return std::numeric_limits<double>::lowest();
+                return alpha * w * h;
+            }
+
             double alpha;
         };
 
@@ -76,6 +109,9 @@ namespace seqpair {
             double decreasing_ratio = 0.9;
             double restart_ratio = 2;
             double stopping_accepting_probability = 0.05;
+            // Number of candidate moves evaluated per step, of which the best
+            // one is put to the acceptance test (1 for plain SA).
+            std::size_t candidates_per_move = 1;
         };
     };
 
@@ -95,6 +131,7 @@ namespace seqpair {
         cerr << "decreasing_ratio: " << opts.decreasing_ratio << "\n";
         cerr << "restart_ratio: " << opts.restart_ratio << "\n";
         cerr << "stopping_accepting_probability: " << opts.stopping_accepting_probability << "\n";
+        cerr << "candidates_per_move: " << opts.candidates_per_move << "\n";
         return out;
     }
 
@@ -143,6 +180,17 @@ namespace seqpair {
             return generator_;
         }
 
+        const aureliano::deadline &deadline() const {
+            return deadline_;
+        }
+
+        // Sets the wall-clock budget of the following runs, which stop with
+        // the best solution so far when it runs out, and cool down faster
+        // when the remaining temperatures would not fit in it.
+        void set_deadline(const aureliano::deadline &d) {
+            deadline_ = d;
+        }
+
         // Generates the solution and writes it to layout.
         template<typename LayoutAlloc, typename FwdIt,
             typename ChgDist = generator_default_change_distribution>
@@ -157,12 +205,14 @@ namespace seqpair {
 
             // Deferred generator construction from layout.
             generator_.construct(layout.widths(), layout.heights(), eng_); 
-            auto best_gen = generator_;
+            // The best state is saved lazily: at_best tells that it is the 
+            // current state, which is saved only when a move leaves it.
+            typename generator_t::checkpoint_t best_state;
+            bool at_best = false;
             auto res = generator_.make_resource();
             
             // Initial loop for determining starting temperature.
             auto local_layout = layout;
-            auto best_layout = layout;
             double min_energy = numeric_limits<double>().max(), 
                 max_energy = numeric_limits<double>().min();
             double curr_energy, last_energy;
@@ -174,10 +224,10 @@ namespace seqpair {
                 int w, h;
                 std::tie(w, h) = generator_(local_layout, eng_, res, chg_dist);
                 curr_energy = energy_func_(local_layout, first_line, last_line, w, h);
+                detail::commit_energy(energy_func_, 0);
                 ++num_simulations;
                 if (curr_energy < min_energy) {
-                    detail::unguarded_copy_layout(local_layout, best_layout);
-                    detail::unguarded_copy_generator(generator_, best_gen);
+                    generator_.save(best_state);
                     min_energy = curr_energy;
                 }
                 sum_energies += curr_energy;
@@ -205,35 +255,95 @@ namespace seqpair {
             constexpr double temp_guard = 1.0;
             uniform_real_distribution<> rand_double(0, 1);
             size_t num_restarts = 0;
-
+            using candidate_t = typename generator_t::candidate_t;
+            vector<candidate_t> candidates(opts_.candidates_per_move);
+            auto candidate_energy = [&](const auto &l, int w, int h) {
+                // Candidates are evaluated from the same state.
+                auto e = energy_func_(l, first_line, last_line, w, h);
+                detail::rollback_energy(energy_func_, 0);
+                return e;
+            };
+
+            auto local_deadline = deadline_;
+            bool timed_out = false;
             for (;;) {
                 size_t num_acceptions = 0;
-                double my_sum_energies = 0;
+                double my_sum_energies = 0;     // Of the moves evaluated in full
+                size_t num_evaluated = 0;
+                auto temp_start = local_deadline.elapsed();
 
                 for (size_t i = 0; i != opts_.simulaions_per_temperature; ++i) {
-                    int w, h;
-                    std::tie(w, h) = generator_(local_layout, eng_, res, chg_dist);
-                    ++num_simulations;
-                    auto new_energy = energy_func_(local_layout, first_line, last_line, w, h);
-                    my_sum_energies += new_energy;
-
-                    if (new_energy < curr_energy ||
-                        rand_double(eng_) < exp((curr_energy - new_energy) / temp)) {
+                    if (local_deadline.expired()) {
+                        timed_out = true;
+                        break;
+                    }
+                    // The Metropolis test (new_energy < curr_energy or rand < 
+                    // exp((curr_energy - new_energy) / temp)) is drawn first,
+                    // as a ceiling of new_energy, so that the evaluation can
+                    // give up once a lower bound of the energy reaches it.
+                    double ceiling = curr_energy - temp * log(rand_double(eng_));
+                    double new_energy;
+                    auto best = candidates.begin();
+                    bool evaluated = true;
+                    if (candidates.size() == 1) {
+                        auto exceeds = [&](int w, int h) {
+                            new_energy = energy_lower_bound(w, h, 0);
+                            return new_energy >= ceiling;
+                        };
+                        auto sln_area = generator_.eval_bounded(local_layout, eng_, res,
+                            chg_dist, exceeds);
+                        // Otherwise new_energy is the lower bound.
+                        evaluated = static_cast<bool>(sln_area);
+                        if (evaluated)
+                            new_energy = energy_func_(local_layout, first_line, last_line,
+                                sln_area->first, sln_area->second);
+                    } else {
+                        // Best of the candidates, evaluated from the same state.
+                        generator_.eval_batch(local_layout, eng_, res, chg_dist,
+                            candidates.size(), candidate_energy, candidates.begin());
+                        best = min_element(candidates.begin(), candidates.end(),
+                            [](const auto &a, const auto &b) { return a.energy < b.energy; });
+                        new_energy = best->energy;
+                    }
+                    num_simulations += candidates.size();
+                    if (evaluated) {
+                        // Lower bounds of abandoned moves are not energies.
+                        my_sum_energies += new_energy;
+                        ++num_evaluated;
+                    }
+                    auto chg = candidates.size() == 1 ? generator_.last_change_type()
+                        : std::get<0>(best->change);
+
+                    if (evaluated && new_energy < ceiling) {
+                        report_change(chg_dist, chg, true, curr_energy - new_energy, 0);
+                        detail::commit_energy(energy_func_, 0);
+                        if (candidates.size() != 1)
+                            generator_.apply(*best, local_layout, eng_, res);
                         if (new_energy < min_energy) {
-                            detail::unguarded_copy_layout(local_layout, best_layout);
-                            detail::unguarded_copy_generator(generator_, best_gen);
+                            at_best = true;
                             min_energy = new_energy;
+                        } else if (at_best) {
+                            generator_.save(best_state, true);
+                            at_best = false;
                         }
                         curr_energy = new_energy;
                         ++num_acceptions;
                     } else {
-                        check_undo(std::forward<ChgDist>(chg_dist));
+                        report_change(chg_dist, chg, false, 0.0, 0);
+                        detail::rollback_energy(energy_func_, 0);
+                        if (candidates.size() == 1)
+                            check_undo(std::forward<ChgDist>(chg_dist));
                     }
                 }
+                report_temperature(chg_dist, 0);
+                if (timed_out)
+                    break;
+                double mean_energy = num_evaluated ?
+                    my_sum_energies / num_evaluated : curr_energy;
                 
                 if (verbose_level >= 2) {
                     cerr << "Temperature: " << temp << ", average energy: " <<
-                        my_sum_energies / opts_.simulaions_per_temperature <<
+                        mean_energy <<
                         ", acception rate: " << static_cast<double>(num_acceptions) /
                         opts_.simulaions_per_temperature << "\n";
                 }
@@ -247,16 +357,18 @@ namespace seqpair {
                 // Restart if necessary
                 // Note: based on average or current? (experiment shows that average-based 
                 // restart is better)
-                if (my_sum_energies / opts_.simulaions_per_temperature >
-                    opts_.restart_ratio * min_energy) {
-                    detail::unguarded_copy_layout(best_layout, local_layout);  // Not compulsory
-                    detail::unguarded_copy_generator(best_gen, generator_);
+                if (mean_energy > opts_.restart_ratio * min_energy) {
+                    if (!at_best)
+                        generator_.restore(best_state);
+                    at_best = true;
                     curr_energy = min_energy;
                     ++num_restarts;
                 }
 
-                // Drop temperature
-                temp *= opts_.decreasing_ratio;
+                // Drop temperature, faster if the rest would not fit in time.
+                temp *= compressed_ratio(local_deadline, 
+                    local_deadline.elapsed() - temp_start, temp,
+                    static_cast<double>(num_acceptions) / opts_.simulaions_per_temperature);
             }
 
             // Output results
@@ -266,12 +378,76 @@ namespace seqpair {
                 cerr << "Finishing energy: " << curr_energy << "\n";
                 cerr << "Total simulations: " << num_simulations << "\n";
                 cerr << "Total restarts: " << num_restarts << "\n";
+                if (timed_out)
+                    cerr << "Time limit reached." << "\n";
             }
-            layout = std::move(best_layout);
+            // Rebuild the best layout.
+            if (!at_best)
+                generator_.restore(best_state);
+            generator_.evaluate(local_layout, eng_, res);
+            layout = std::move(local_layout);
             return min_energy;
         }
 
     protected: 
+        // Reports the outcome of a change to chg_dist, if it adapts to them
+        // (see PackGeneratorBase::adaptive_change_distribution).
+        template<typename ChgDist>
+        static auto report_change(ChgDist &chg_dist, typename generator_t::change_t chg,
+            bool accepted, double gain, int) ->
+            decltype(chg_dist.feedback(chg, accepted, gain), void()) {
+            chg_dist.feedback(chg, accepted, gain);
+        }
+
+        template<typename ChgDist>
+        static void report_change(const ChgDist &, typename generator_t::change_t,
+            bool, double, long) noexcept { }
+
+        // Ends a temperature for chg_dist, if it adapts to outcomes.
+        template<typename ChgDist>
+        static auto report_temperature(ChgDist &chg_dist, int) ->
+            decltype(chg_dist.update(), void()) {
+            chg_dist.update();
+        }
+
+        template<typename ChgDist>
+        static void report_temperature(const ChgDist &, long) noexcept { }
+
+        // Lower bound of the energy of packings at least w wide and h high,
+        // if energy_function_t provides one.
+        template<typename F = energy_function_t>
+        auto energy_lower_bound(int w, int h, int) const ->
+            decltype(std::declval<const F &>().lower_bound(w, h)) {
+            return energy_func_.lower_bound(w, h);
+        }
+
+        double energy_lower_bound(int, int, long) const noexcept {
+            return std::numeric_limits<double>::lowest();
+        }
+
+        // Ratio of the next temperature to temp, given the time the last one
+        // took and its acceptance rate. The temperature where the search
+        // stops is extrapolated, and if decreasing_ratio would not reach it
+        // in the remaining time, the ratio is lowered so that it does.
+        // Note: uphill deltas shrink along with the energy, so -log of the
+        //      acceptance rate grows about as 1 / sqrt(temp) rather than
+        //      1 / temp in practice.
+        double compressed_ratio(const aureliano::deadline &d,
+            aureliano::deadline::duration step, double temp,
+            double accept_rate) const noexcept {
+            using namespace std;
+            double ratio = opts_.decreasing_ratio;
+            if (d.unlimited() || !(accept_rate > opts_.stopping_accepting_probability &&
+                accept_rate < 1))
+                return ratio;
+            double end_temp = temp * pow(log(accept_rate) / 
+                log(opts_.stopping_accepting_probability), 2);
+            auto steps = max(d.steps_left(step), size_t(1));
+            if (log(end_temp / temp) / log(ratio) > steps)
+                ratio = pow(end_temp / temp, 1.0 / steps);
+            return ratio;
+        }
+
         // Checks option.
         bool is_option_valid(const options_t &opts) const noexcept {
             return opts.initial_accepting_probability > 0 &&
@@ -281,7 +457,8 @@ namespace seqpair {
                 opts.decreasing_ratio < 1 &&
                 opts.restart_ratio > 1 &&
                 opts.stopping_accepting_probability > 0 &&
-                opts.stopping_accepting_probability <= 1;
+                opts.stopping_accepting_probability <= 1 &&
+                opts.candidates_per_move;
         }
 
         // Throws on invalid option.
@@ -310,6 +487,7 @@ namespace seqpair {
         energy_function_t energy_func_; 
         std::default_random_engine eng_;
         generator_t generator_;
+        aureliano::deadline deadline_;
     };
 
     // Helper function for constructing SaPacker.
@@ -0,0 +1,103 @@
+// wirelength.h: half-perimeter wirelength of nets, kept incrementally.
+// Author: LYL (Aureliano Lee)
+
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "bbox_kernels.h"
+#include "hpwl.h"
+#include "layout.h"
+
+namespace seqpair {
+    // hpwl of nets over pins of components (see aureliano::incremental_hpwl),
+    // kept incrementally over the layouts it is applied to: only the pins
+    // of the components which moved since the last layout, and the nets of
+    // these pins, are recounted, with the best bbox_kernels of the CPU.
+    class IncrementalHpwl : public AURELIANO incremental_hpwl {
+    public:
+        IncrementalHpwl() = default;
+
+        // Pins at the centres of num_modules components.
+        IncrementalHpwl(std::vector<std::size_t> net_offsets,
+            std::vector<std::size_t> pin_modules, std::size_t num_modules) :
+            incremental_hpwl(std::move(net_offsets), std::move(pin_modules),
+                num_modules, get_bbox_kernels().bbox) { }
+
+        // Pin j at (pin_x[j], pin_y[j]) from the lower left corner of its
+        // component m unrotated, widths[m] wide and heights[m] high.
+        IncrementalHpwl(std::vector<std::size_t> net_offsets,
+            std::vector<std::size_t> pin_modules, const std::vector<int> &pin_x,
+            const std::vector<int> &pin_y, std::vector<int> widths,
+            std::vector<int> heights) :
+            incremental_hpwl(std::move(net_offsets), std::move(pin_modules), pin_x,
+                pin_y, std::move(widths), std::move(heights), get_bbox_kernels().bbox) { }
+
+        // Updates to layout.
+        // Returns: hpwl of layout.
+        template<typename Alloc>
+        double operator()(const Layout<Alloc> &layout) {
+            assert(layout.size() == num_modules());
+            for (std::size_t m = 0; m != num_modules(); ++m)
+                place(m, layout.x()[m], layout.y()[m], layout.widths()[m],
+                    layout.heights()[m]);
+            auto hpwl = update();
+            if (!valid_) {
+                commit();
+                valid_ = true;
+            }
+            return hpwl;
+        }
+
+        // hpwl of layout computed from scratch, leaving the cache as it is.
+        template<typename Alloc>
+        double evaluate(const Layout<Alloc> &layout) const {
+            assert(layout.size() == num_modules());
+            return incremental_hpwl::evaluate([&layout](std::size_t m) {
+                return place_type{ layout.x()[m], layout.y()[m],
+                    layout.widths()[m], layout.heights()[m] };
+            });
+        }
+
+    private:
+        bool valid_ = false;                    // Whether the first layout is committed
+    };
+
+    // packing_cost with the hpwl of nets as the wirelength, ignoring the
+    // lines it is passed. Packers commit() the wirelength after accepting
+    // a packing and rollback() after rejecting one.
+    struct hpwl_energy_function {
+        hpwl_energy_function() :
+            hpwl_energy_function(1.0) { }
+        explicit hpwl_energy_function(double alpha,
+            IncrementalHpwl hpwl = IncrementalHpwl()) :
+            alpha(alpha), hpwl(std::move(hpwl)) { }
+
+        template<typename Alloc, typename FwdIt>
+        double operator()(const Layout<Alloc> &layout, FwdIt, FwdIt, int w, int h) {
+            if (alpha == 1)
+                return 1.0 * w * h;
+            return alpha * w * h + (1 - alpha) * hpwl(layout);
+        }
+
+        // Lower bound of the energy of packings at least w wide and h high.
+        double lower_bound(int w, int h) const noexcept {
+            if (alpha > 1)
+                return std::numeric_limits<double>::lowest();
+            return alpha * w * h;
+        }
+
+        void commit() noexcept {
+            hpwl.commit();
+        }
+
+        void rollback() noexcept {
+            hpwl.rollback();
+        }
+
+        double alpha;
+        IncrementalHpwl hpwl;
+    };
+}
@@ -0,0 +1,448 @@
+// fast_parser.cpp: hand-written front end of YAL files, reading them in place
+// Author: LYL
+
+#include "fast_parser.h"
+#include "interpreter.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define YAL_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define YAL_HAS_MMAP 0
+#include <fstream>
+#endif
+
+using namespace yal;
+
+namespace {
+
+    // Contents of a file, mapped into memory where the platform allows, or
+    // else (e.g., for pipes) read into a buffer.
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string &path) {
+#if YAL_HAS_MMAP
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Cannot open file: " + path);
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+                auto size = static_cast<std::size_t>(st.st_size);
+                void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    ::madvise(addr, size, MADV_SEQUENTIAL);
+                    m_addr = addr;
+                    m_size = size;
+                    ::close(fd);
+                    return;
+                }
+            }
+            char chunk[1 << 16];
+            ssize_t count;
+            while ((count = ::read(fd, chunk, sizeof(chunk))) > 0)
+                m_buffer.insert(m_buffer.end(), chunk, chunk + count);
+            ::close(fd);
+            if (count < 0)
+                throw std::runtime_error("Cannot read file: " + path);
+#else
+            std::ifstream fin(path, std::ios::binary);
+            if (!fin.is_open())
+                throw std::runtime_error("Cannot open file: " + path);
+            m_buffer.assign(std::istreambuf_iterator<char>(fin),
+                std::istreambuf_iterator<char>());
+#endif
+            m_size = m_buffer.size();
+        }
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile() {
+#if YAL_HAS_MMAP
+            if (m_addr)
+                ::munmap(m_addr, m_size);
+#endif
+        }
+
+        const char *data() const noexcept {
+            return m_addr ? static_cast<const char *>(m_addr) : m_buffer.data();
+        }
+
+        std::size_t size() const noexcept {
+            return m_size;
+        }
+
+    private:
+        void *m_addr = nullptr;
+        std::size_t m_size = 0;
+        std::vector<char> m_buffer;
+    };
+
+    bool is_digit(char c) noexcept {
+        return c >= '0' && c <= '9';
+    }
+
+    bool is_alpha(char c) noexcept {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    const char *skip_digits(const char *first, const char *last) noexcept {
+        while (first != last && is_digit(*first))
+            ++first;
+        return first;
+    }
+
+}
+
+void FastParser::parse(const char *first, const char *last) {
+    m_first = m_cur = first;
+    m_last = last;
+    next();
+    while (m_token != Token::END) {
+        if (m_token != Token::MODULE)
+            unexpected("MODULE or end of file");
+        parse_module();
+    }
+}
+
+void FastParser::parse_file(const std::string &path) {
+    MappedFile file(path);
+    parse(file.data(), file.data() + file.size());
+}
+
+FastParser::Token FastParser::keyword(boost::string_ref text) noexcept {
+    // Keywords are upper case and at most 10 long.
+    if (text.size() > 10 || !(text[0] >= 'A' && text[0] <= 'Z'))
+        return Token::STRING;
+    for (auto k = static_cast<int>(Token::MODULE);
+        k <= static_cast<int>(Token::METAL2); ++k) {
+        auto t = static_cast<Token>(k);
+        if (text == name(t))
+            return t;
+    }
+    return Token::STRING;
+}
+
+const char *FastParser::name(Token t) noexcept {
+    // As the tokens are named in parser.y.
+    static const char *const names[] = {
+        "end of file", "identifier", "integer", "double", "semicolon",
+        "MODULE", "ENDMODULE", "TYPE", "DIMENSIONS", "IOLIST", "ENDIOLIST",
+        "NETWORK", "ENDNETWORK",
+        "CURRENT", "VOLTAGE", "STANDARD", "PAD", "GENERAL", "PARENT",
+        "B", "PI", "PO", "PB", "F", "PWR", "GND",
+        "PDIFF", "NDIFF", "POLY", "METAL1", "METAL2"
+    };
+    return names[static_cast<int>(t)];
+}
+
+void FastParser::next() {
+    static const char close[] = "*/";
+    const char *p = m_cur;
+    // Skip whitespace and comments.
+    while (p != m_last) {
+        char c = *p;
+        if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+            ++p;
+        } else if (c == '/' && p + 1 != m_last && p[1] == '/') {
+            p = std::find(p + 2, m_last, '\n');
+        } else if (c == '/' && p + 1 != m_last && p[1] == '*') {
+            auto q = std::search(p + 2, m_last, close, close + 2);
+            if (q == m_last)
+                error(p, 2, "Unterminated comment");
+            p = q + 2;
+        } else {
+            break;
+        }
+    }
+
+    m_cur = p;
+    if (p == m_last) {
+        m_token = Token::END;
+        m_text = boost::string_ref(p, 0);
+        return;
+    }
+    char c = *p;
+    if (c == ';') {
+        m_token = Token::SEMICOLON;
+        m_cur = p + 1;
+    } else if (is_alpha(c)) {
+        auto q = p + 1;
+        while (q != m_last && (is_alpha(*q) || is_digit(*q) || *q == '_'))
+            ++q;
+        m_cur = q;
+        m_token = keyword(boost::string_ref(p, q - p));
+    } else if (is_digit(c) || c == '+' || c == '-' || c == '.') {
+        scan_number();
+    }
+    if (m_cur == p)
+        error(p, 1, std::string("Unknown character ") + c);
+    m_text = boost::string_ref(p, m_cur - p);
+}
+
+void FastParser::scan_number() {
+    // The longest match of INTEGER [-+]?([1-9][0-9]*|0) and
+    // DOUBLE [-+]?[0-9]*\.?[0-9]+([eE][-+]?[0-9]+)?, INTEGER on a tie, as
+    // by the rules of scanner.l. Leaves m_cur if neither matches.
+    const char *first = m_cur, *s = first;
+    if (*s == '+' || *s == '-')
+        ++s;
+    auto digits = skip_digits(s, m_last);
+    const char *integer = s == digits ? nullptr : *s == '0' ? s + 1 : digits;
+    const char *real = nullptr;
+    if (digits != m_last && *digits == '.' && digits + 1 != m_last &&
+        is_digit(digits[1]))
+        real = skip_digits(digits + 1, m_last);
+    else if (digits != s)
+        real = digits;
+    if (real && real != m_last && (*real == 'e' || *real == 'E')) {
+        auto q = real + 1;
+        if (q != m_last && (*q == '+' || *q == '-'))
+            ++q;
+        auto r = skip_digits(q, m_last);
+        if (r != q)
+            real = r;
+    }
+
+    if (integer && integer >= real) {
+        std::int64_t value = 0;
+        for (auto q = s; q != integer; ++q) {
+            value = value * 10 + (*q - '0');
+            if (value > std::int64_t(1) << 31)
+                error(first, integer - first, "Integer out of range");
+        }
+        if (*first == '-')
+            value = -value;
+        if (value > INT32_MAX)
+            error(first, integer - first, "Integer out of range");
+        m_token = Token::INTEGER;
+        m_integer = static_cast<std::int32_t>(value);
+        m_cur = integer;
+    } else if (real) {
+        // Numbers are short; the copy terminates the text for strtod.
+        std::string text(first, real);
+        m_token = Token::DOUBLE;
+        m_double = std::strtod(text.c_str(), nullptr);
+        m_cur = real;
+    }
+}
+
+bool FastParser::accept(Token t) {
+    if (m_token != t)
+        return false;
+    next();
+    return true;
+}
+
+void FastParser::expect(Token t) {
+    if (!accept(t))
+        unexpected(name(t));
+}
+
+void FastParser::parse_module() {
+    expect(Token::MODULE);
+    auto name = parse_string();
+    expect(Token::SEMICOLON);
+
+    expect(Token::TYPE);
+    Module::ModuleType type;
+    switch (m_token) {
+    case Token::STANDARD:
+        type = Module::ModuleType::STANDARD;
+        break;
+    case Token::PAD:
+        type = Module::ModuleType::PAD;
+        break;
+    case Token::GENERAL:
+        type = Module::ModuleType::GENERAL;
+        break;
+    case Token::PARENT:
+        type = Module::ModuleType::PARENT;
+        break;
+    default:
+        unexpected("STANDARD or PAD or GENERAL or PARENT");
+    }
+    next();
+    expect(Token::SEMICOLON);
+
+    std::vector<int> xpos, ypos;
+    if (accept(Token::DIMENSIONS)) {
+        while (m_token == Token::INTEGER) {
+            xpos.push_back(parse_integer());
+            ypos.push_back(parse_integer());
+        }
+        expect(Token::SEMICOLON);
+    }
+
+    std::vector<Signal> iolist;
+    if (accept(Token::IOLIST)) {
+        expect(Token::SEMICOLON);
+        while (!accept(Token::ENDIOLIST)) {
+            iolist.push_back(parse_signal());
+            expect(Token::SEMICOLON);
+        }
+        expect(Token::SEMICOLON);
+    }
+
+    std::vector<ParentModule::NetworkEntry> network;
+    if (accept(Token::NETWORK)) {
+        expect(Token::SEMICOLON);
+        while (!accept(Token::ENDNETWORK)) {
+            network.push_back(parse_network_entry());
+            expect(Token::SEMICOLON);
+        }
+        expect(Token::SEMICOLON);
+    }
+
+    expect(Token::ENDMODULE);
+    expect(Token::SEMICOLON);
+
+    // As the action of Module in parser.y, moving rather than copying.
+    if (network.empty()) {
+        m_driver.m_modules.emplace_back();
+        Module &m = m_driver.m_modules.back();
+        m.name = std::move(name);
+        m.type = type;
+        m.xpos = std::move(xpos);
+        m.ypos = std::move(ypos);
+        m.iolist = std::move(iolist);
+    } else {
+        ParentModule &m = m_driver.m_parent;
+        m.name = std::move(name);
+        m.type = Module::ModuleType::PARENT;
+        m.xpos = std::move(xpos);
+        m.ypos = std::move(ypos);
+        m.iolist = std::move(iolist);
+        m.network = std::move(network);
+    }
+}
+
+std::string FastParser::parse_string() {
+    if (!is_string())
+        unexpected(name(Token::STRING));
+    auto s = m_text.to_string();
+    next();
+    return s;
+}
+
+std::int32_t FastParser::parse_integer() {
+    if (m_token != Token::INTEGER)
+        unexpected(name(Token::INTEGER));
+    auto value = m_integer;
+    next();
+    return value;
+}
+
+double FastParser::parse_double() {
+    double value;
+    if (m_token == Token::INTEGER)
+        value = m_integer;
+    else if (m_token == Token::DOUBLE)
+        value = m_double;
+    else
+        unexpected("double or integer");
+    next();
+    return value;
+}
+
+Signal FastParser::parse_signal() {
+    Signal s;
+    s.name = parse_string();
+    switch (m_token) {
+    case Token::B:
+        s.terminal_type = Signal::TerminalType::BIDIRECTIONAL;
+        break;
+    case Token::PI:
+        s.terminal_type = Signal::TerminalType::PAD_INPUT;
+        break;
+    case Token::PO:
+        s.terminal_type = Signal::TerminalType::PAD_OUTPUT;
+        break;
+    case Token::PB:
+        s.terminal_type = Signal::TerminalType::PAD_BIDIRECTIONAL;
+        break;
+    case Token::F:
+        s.terminal_type = Signal::TerminalType::FEEDTHROUGH;
+        break;
+    case Token::PWR:
+        s.terminal_type = Signal::TerminalType::POWER;
+        break;
+    case Token::GND:
+        s.terminal_type = Signal::TerminalType::GROUND;
+        break;
+    default:
+        unexpected("terminal type");
+    }
+    next();
+    s.xpos = parse_integer();
+    s.ypos = parse_integer();
+    s.width = parse_integer();
+    switch (m_token) {
+    case Token::PDIFF:
+        s.layer_type = Signal::LayerType::PDIFF;
+        break;
+    case Token::NDIFF:
+        s.layer_type = Signal::LayerType::NDIFF;
+        break;
+    case Token::POLY:
+        s.layer_type = Signal::LayerType::POLY;
+        break;
+    case Token::METAL1:
+        s.layer_type = Signal::LayerType::METAL1;
+        break;
+    case Token::METAL2:
+        s.layer_type = Signal::LayerType::METAL2;
+        break;
+    default:
+        unexpected("layer");
+    }
+    next();
+    s.current = accept(Token::CURRENT) ? parse_double() : Signal::NaN();
+    s.voltage = accept(Token::VOLTAGE) ? parse_double() : Signal::NaN();
+    return s;
+}
+
+ParentModule::NetworkEntry FastParser::parse_network_entry() {
+    auto instance = parse_string();
+    auto module = parse_string();
+    std::vector<std::string> signals;
+    while (m_token != Token::SEMICOLON) {
+        if (m_token == Token::INTEGER) {
+            signals.push_back(std::to_string(m_integer));
+            next();
+        } else {
+            signals.push_back(parse_string());
+        }
+    }
+    return ParentModule::NetworkEntry(std::move(instance), std::move(module),
+        std::move(signals));
+}
+
+void FastParser::unexpected(const std::string &expecting) const {
+    error(m_text.data(), m_text.size(), std::string("syntax error, unexpected ") +
+        name(m_token) + ", expecting " + expecting);
+}
+
+void FastParser::error(const char *at, std::size_t length,
+    const std::string &message) const {
+    // Count the location only now, lines from 1 and columns from 1.
+    auto lines = std::count(m_first, at, '\n');
+    auto line_begin = std::find(std::reverse_iterator<const char *>(at),
+        std::reverse_iterator<const char *>(m_first), '\n').base();
+    Parser::location_type loc;
+    loc.begin.line = static_cast<decltype(loc.begin.line)>(lines + 1);
+    loc.begin.column = static_cast<decltype(loc.begin.column)>(at - line_begin + 1);
+    loc.end = loc.begin;
+    loc.end.column += static_cast<decltype(loc.end.column)>(length);
+    throw Parser::syntax_error(loc, message);
+}
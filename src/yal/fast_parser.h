@@ -0,0 +1,91 @@
+// fast_parser.h: hand-written front end of YAL files, reading them in place
+// Author: LYL
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+
+#include "module.h"
+
+namespace yal {
+
+    class Interpreter;
+
+    // Parser of the YAL grammar of parser.y with its own scanner over text
+    // in memory: tokens are views into the text, so that only names kept
+    // in the modules are copied, and locations are only counted for the
+    // error thrown. It accepts what Interpreter::parse() accepts and fills
+    // the modules of the interpreter the same way.
+    class FastParser {
+    public:
+        explicit FastParser(Interpreter &driver) noexcept : m_driver(driver) {}
+
+        // Parse text [first, last).
+        // @throw yal::Parser::syntax_error when things go wrong
+        void parse(const char *first, const char *last);
+
+        // Parse a file, mapped into memory where the platform allows.
+        // @throw runtime_error if the file cannot be read
+        // @throw yal::Parser::syntax_error when things go wrong
+        void parse_file(const std::string &path);
+
+    private:
+        enum class Token {
+            END, STRING, INTEGER, DOUBLE, SEMICOLON,
+            MODULE, ENDMODULE, TYPE, DIMENSIONS, IOLIST, ENDIOLIST,
+            NETWORK, ENDNETWORK,
+            // Keywords from here on are also strings.
+            CURRENT, VOLTAGE, STANDARD, PAD, GENERAL, PARENT,
+            B, PI, PO, PB, F, PWR, GND,
+            PDIFF, NDIFF, POLY, METAL1, METAL2
+        };
+
+        static Token keyword(boost::string_ref text) noexcept;
+
+        static const char *name(Token t) noexcept;
+
+        // Scans the next token into m_token and m_text.
+        void next();
+
+        void scan_number();
+
+        bool accept(Token t);
+
+        void expect(Token t);
+
+        bool is_string() const noexcept {
+            return m_token == Token::STRING || m_token >= Token::CURRENT;
+        }
+
+        void parse_module();
+
+        std::string parse_string();
+
+        std::int32_t parse_integer();
+
+        double parse_double();
+
+        Signal parse_signal();
+
+        ParentModule::NetworkEntry parse_network_entry();
+
+        [[noreturn]] void unexpected(const std::string &expecting) const;
+
+        [[noreturn]] void error(const char *at, std::size_t length,
+            const std::string &message) const;
+
+        Interpreter &m_driver;
+        const char *m_first = nullptr, *m_last = nullptr;
+        const char *m_cur = nullptr;    // Past the current token
+        Token m_token = Token::END;
+        boost::string_ref m_text;       // Text of the current token
+        std::int32_t m_integer = 0;     // Value of an INTEGER
+        double m_double = 0;            // Value of a DOUBLE
+    };
+
+}
@@ -27,6 +27,7 @@
  */
 
 #include "interpreter.h"
+#include "fast_parser.h"
 #include "module.h"
 #include <unordered_map>
 
@@ -45,6 +46,10 @@ bool Interpreter::parse() {
     return !m_parser.parse();
 }
 
+void Interpreter::parse_file(const std::string &path) {
+    FastParser(*this).parse_file(path);
+}
+
 void Interpreter::clear() {
     m_location.initialize();
     m_modules.clear();
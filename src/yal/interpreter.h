@@ -57,6 +57,7 @@ namespace yal {
 
         friend class Parser;
         friend class Scanner;
+        friend class FastParser;
 
         Interpreter();
 
@@ -66,6 +67,12 @@ namespace yal {
         // @return true on success, false on failure
         // @throw yal::Parser::syntax_error when things go wrong
         bool parse();
+
+        // Run the hand-written parser over a file, mapped into memory, as
+        // a faster alternative to parse(). Results are stored inside.
+        // @throw runtime_error if the file cannot be read
+        // @throw yal::Parser::syntax_error when things go wrong
+        void parse_file(const std::string &path);
         
         // Clear AST.
         void clear();
@@ -89,6 +89,12 @@ namespace yal {
             const std::vector<int> &xpos, const std::vector<int> &ypos,
             const std::vector<Signal> &iolist);
 
+        // Declared, as the virtual destructor would suppress the moves.
+        Module(const Module &) = default;
+        Module(Module &&) = default;
+        Module &operator=(const Module &) = default;
+        Module &operator=(Module &&) = default;
+
         virtual ~Module() = default;
 
         std::ostream &print() const;
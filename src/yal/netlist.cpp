@@ -0,0 +1,102 @@
+// netlist.cpp: net hypergraph of a parent module
+// Author: LYL
+
+#include "netlist.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace yal;
+
+namespace {
+
+    bool is_supply(const Signal &s) noexcept {
+        return s.terminal_type == Signal::TerminalType::POWER ||
+            s.terminal_type == Signal::TerminalType::GROUND;
+    }
+
+    int lowest(const std::vector<int> &v) {
+        return v.empty() ? 0 : *std::min_element(v.cbegin(), v.cend());
+    }
+
+}
+
+Netlist::Netlist(const std::vector<Module> &modules, const ParentModule &parent,
+    const std::vector<std::size_t> &module_index) :
+    m_num_modules(parent.network.size()) {
+    constexpr auto npos = std::numeric_limits<std::size_t>::max();
+
+    // A single pass over the signals interns net names and records pins,
+    // which are then bucketed by net.
+    std::unordered_map<std::string, std::size_t> net_ids;
+    std::vector<const std::string *> names;
+    std::vector<std::size_t> sizes, spans, last_module;
+    std::vector<std::size_t> pin_nets, pin_modules;
+    std::vector<int> pin_x, pin_y;
+    for (std::size_t i = 0; i != parent.network.size(); ++i) {
+        const auto &entry = parent.network[i];
+        const auto &signals = ParentModule::get_signal_names(entry);
+        const Module &m = modules[module_index[i]];
+        if (signals.size() > m.iolist.size())
+            throw std::runtime_error("Too many signals of instance: " +
+                ParentModule::get_instance_name(entry));
+        int x0 = lowest(m.xpos), y0 = lowest(m.ypos);
+        for (std::size_t k = 0; k != signals.size(); ++k) {
+            const Signal &s = m.iolist[k];
+            if (is_supply(s))
+                continue;
+            auto ib = net_ids.emplace(signals[k], names.size());
+            auto net = ib.first->second;
+            if (ib.second) {
+                names.push_back(&signals[k]);
+                sizes.push_back(0);
+                spans.push_back(0);
+                last_module.push_back(npos);
+            }
+            ++sizes[net];
+            if (last_module[net] != i) {
+                last_module[net] = i;
+                ++spans[net];
+            }
+            pin_nets.push_back(net);
+            pin_modules.push_back(i);
+            pin_x.push_back(s.xpos - x0);
+            pin_y.push_back(s.ypos - y0);
+        }
+    }
+
+    // Renumber the nets kept, in order of appearance.
+    std::vector<std::size_t> new_ids(names.size(), npos);
+    for (std::size_t net = 0; net != names.size(); ++net) {
+        if (spans[net] < 2)
+            continue;
+        new_ids[net] = m_net_names.size();
+        m_net_names.push_back(*names[net]);
+        m_net_offsets.push_back(m_net_offsets.back() + sizes[net]);
+    }
+
+    auto num_pins = m_net_offsets.back();
+    m_pin_modules.resize(num_pins);
+    m_pin_x.resize(num_pins);
+    m_pin_y.resize(num_pins);
+    std::vector<std::size_t> next(m_net_offsets.cbegin(), m_net_offsets.cend() - 1);
+    for (std::size_t j = 0; j != pin_nets.size(); ++j) {
+        auto net = new_ids[pin_nets[j]];
+        if (net == npos)
+            continue;
+        auto pos = next[net]++;
+        m_pin_modules[pos] = pin_modules[j];
+        m_pin_x[pos] = pin_x[j];
+        m_pin_y[pos] = pin_y[j];
+    }
+}
+
+void Netlist::clear() {
+    m_net_offsets.assign(1, 0);
+    m_pin_modules.clear();
+    m_pin_x.clear();
+    m_pin_y.clear();
+    m_net_names.clear();
+    m_num_modules = 0;
+}
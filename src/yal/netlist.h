@@ -0,0 +1,81 @@
+// netlist.h: net hypergraph of a parent module
+// Author: LYL
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "module.h"
+
+namespace yal {
+
+    // Nets of the NETWORK of a parent module, as a hypergraph over its
+    // instances (numbered in NETWORK order) in compressed sparse row form:
+    // the pins of net i are [net_offsets()[i], net_offsets()[i + 1]), pin j
+    // lying on instance pin_modules()[j] at (pin_x()[j], pin_y()[j]) from
+    // the lower left corner of the instance.
+    // Power and ground pins are dropped, as are nets on fewer than 2
+    // instances, whose length does not depend on the placement. Pads of
+    // the parent module are not pins either.
+    class Netlist {
+    public:
+        Netlist() = default;
+
+        // The k-th signal of an instance connects the k-th entry of the
+        // IOLIST of its module, modules[module_index[i]] for instance i
+        // (see Interpreter::make_module_index).
+        // @throw runtime_error if an instance has more signals than its
+        //      module has IOLIST entries
+        Netlist(const std::vector<Module> &modules, const ParentModule &parent,
+            const std::vector<std::size_t> &module_index);
+
+        std::size_t num_nets() const noexcept {
+            return m_net_names.size();
+        }
+
+        std::size_t num_pins() const noexcept {
+            return m_pin_modules.size();
+        }
+
+        std::size_t num_modules() const noexcept {
+            return m_num_modules;
+        }
+
+        bool empty() const noexcept {
+            return m_net_names.empty();
+        }
+
+        // num_nets() + 1 offsets into the pin arrays.
+        const std::vector<std::size_t> &net_offsets() const noexcept {
+            return m_net_offsets;
+        }
+
+        const std::vector<std::size_t> &pin_modules() const noexcept {
+            return m_pin_modules;
+        }
+
+        const std::vector<int> &pin_x() const noexcept {
+            return m_pin_x;
+        }
+
+        const std::vector<int> &pin_y() const noexcept {
+            return m_pin_y;
+        }
+
+        const std::string &net_name(std::size_t net) const {
+            return m_net_names[net];
+        }
+
+        void clear();
+
+    private:
+        std::vector<std::size_t> m_net_offsets{ 0 };
+        std::vector<std::size_t> m_pin_modules;
+        std::vector<int> m_pin_x, m_pin_y;
+        std::vector<std::string> m_net_names;
+        std::size_t m_num_modules = 0;
+    };
+
+}